@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+#  Advanced Programming Course Assignment 1
+#  Command substitution capture benchmark
+#  Copyright (C) 2024  Roy Simanovich and Almog Shor
+#
+#  Measures the time it takes the shell to capture "$(cmd)" outputs from 1 byte to 100 MB,
+#  compared with running the same producer into /dev/null. Prints one JSON object per size.
+#
+#  Usage: bench/cmdsubst_bench.sh [path to myshell]
+#
+
+SHELL_BIN=${1:-./myshell}
+
+now_ns() {
+	date +%s%N
+}
+
+run_shell() {
+	printf '%s\nquit\n' "$1" | "$SHELL_BIN" > /dev/null
+}
+
+for size in 1 1024 1048576 10485760 104857600; do
+	producer="head -c $size /dev/zero | tr \"\\0\" a"
+
+	start=$(now_ns)
+	run_shell "$producer > /dev/null"
+	baseline=$(( $(now_ns) - start ))
+
+	start=$(now_ns)
+	run_shell "\$out = \"\$($producer)\""
+	capture=$(( $(now_ns) - start ))
+
+	printf '{"benchmark": "cmdsubst_capture", "bytes": %d, "baseline_ns": %d, "capture_ns": %d, "overhead_ns": %d}\n' \
+		"$size" "$baseline" "$capture" $(( capture - baseline ))
+done
@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+#  Advanced Programming Course Assignment 1
+#  Startup and per-command latency benchmark
+#  Copyright (C) 2024  Roy Simanovich and Almog Shor
+#
+#  Measures the time it takes the shell to start and exit on an empty input, and the mean latency
+#  of builtin, variable and external commands (and of the test and echo builtins against /usr/bin/test and /bin/echo)
+#  in a long non-interactive script.
+#  Prints one JSON object per measurement, so release and PGO builds can be compared with the default one.
+#
+#  Usage: bench/latency_bench.sh [path to myshell] [scale]
+#
+
+SHELL_BIN=${1:-./myshell}
+SCALE=${2:-1}
+SCRIPT=$(mktemp)
+
+trap 'rm -f "$SCRIPT"' EXIT
+
+now_ns() {
+	date +%s%N
+}
+
+# Start the shell on an empty input, many times.
+runs=$((200 * SCALE))
+start=$(now_ns)
+i=0
+while [ "$i" -lt "$runs" ]; do
+	"$SHELL_BIN" < /dev/null > /dev/null
+	i=$((i + 1))
+done
+total=$(( $(now_ns) - start ))
+
+printf '{"benchmark": "startup", "runs": %d, "mean_ns": %d}\n' "$runs" $(( total / runs ))
+
+# Run a script made of the same command repeated.
+# $1 - the benchmark name, $2 - the command, $3 - the number of commands.
+command_latency() {
+	awk -v cmd="$2" -v n="$3" 'BEGIN { for (i = 0; i < n; ++i) print cmd }' > "$SCRIPT"
+
+	start=$(now_ns)
+	"$SHELL_BIN" < "$SCRIPT" > /dev/null
+	total=$(( $(now_ns) - start ))
+
+	printf '{"benchmark": "%s", "commands": %d, "mean_ns": %d}\n' "$1" "$3" $(( total / $3 ))
+}
+
+command_latency "builtin_latency" "pwd" $((100000 * SCALE))
+command_latency "variable_latency" "\$var = \$?" $((100000 * SCALE))
+command_latency "external_latency" "/usr/bin/true" $((2000 * SCALE))
+command_latency "pipeline_latency" "/usr/bin/true | /usr/bin/true | /usr/bin/true" $((1000 * SCALE))
+command_latency "test_builtin_latency" "[ -f \"$SHELL_BIN\" -a 1 -lt 2 ]" $((100000 * SCALE))
+command_latency "test_external_latency" "/usr/bin/test -f \"$SHELL_BIN\" -a 1 -lt 2" $((2000 * SCALE))
+command_latency "echo_builtin_latency" "echo hello world" $((100000 * SCALE))
+command_latency "echo_external_latency" "/bin/echo hello world" $((2000 * SCALE))
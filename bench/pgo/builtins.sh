@@ -0,0 +1,22 @@
+$greeting = hello
+$name = world
+$count = 0
+prompt = pgo:
+pwd
+cd /
+pwd
+cd
+cd -
+read line
+this line is read by the read builtin
+echo $greeting $name $line
+$status = $?
+history
+history -t
+history --slowest 3
+stats
+stats -j
+stats -r
+$farewell = goodbye
+echo $farewell $name $status $undefined
+!!
@@ -0,0 +1,17 @@
+if true
+then
+echo taken
+else
+echo not taken
+fi
+if false
+then
+echo not taken
+else
+echo taken
+fi
+if ls / > /dev/null
+then
+$status = yes
+fi
+echo $status
@@ -0,0 +1,11 @@
+$dir = /tmp
+$files = "$(ls /)"
+echo $files
+echo $(echo one two three) "$(echo kept as one word)"
+$lines = $(seq 1 50 | wc -l)
+echo $lines $dir $? $undefined
+diff <(seq 1 10) <(seq 1 10)
+seq 1 5 | tee >(wc -l) > /dev/null
+echo $(pwd) "$(history)"
+$nested = $(echo $(echo nested))
+echo $nested
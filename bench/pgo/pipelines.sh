@@ -0,0 +1,11 @@
+ls -la / | sort | uniq | wc -l
+echo "quoted argument with spaces" 'single quoted' | cat | cat | cat | wc -c
+head -c 1048576 /dev/zero | cat | cat | wc -c
+seq 1 1000 | grep 7 | sort -r | head -5
+seq 1 100 |> wc -l |> tail -1
+true | false | true
+false | true
+nosuchcommand | cat
+ls /nonexistent 2>&1 | wc -l
+sleep 0.01 &
+echo done
@@ -0,0 +1,18 @@
+$out = /tmp/.myshell_pgo_out
+echo first > $out
+echo second >> $out
+cat < $out
+wc -l < $out > /dev/null 2>&1
+ls / /nonexistent > /dev/null 2> /dev/null
+ls /nonexistent 2>&1 | cat
+cat <<EOT
+here-document line $out
+second line
+EOT
+cat <<'EOT'
+literal $out
+EOT
+wc -w <<< "a here string"
+cat 0<> $out
+> $out
+rm -f $out
@@ -0,0 +1,46 @@
+#!/bin/sh
+#
+#  Advanced Programming Course Assignment 1
+#  Long pipeline stress benchmark
+#  Copyright (C) 2024  Roy Simanovich and Almog Shor
+#
+#  Runs "cat" chains of 10, 100 and 1000 stages through the shell, and checks that the data
+#  made it through every stage. Prints one JSON object per chain length.
+#
+#  Usage: bench/pipeline_stress.sh [path to myshell] [runs]
+#
+
+SHELL_BIN=${1:-./myshell}
+RUNS=${2:-5}
+
+now_ns() {
+	date +%s%N
+}
+
+# Build "echo payload | cat | cat | ... | wc -c" with the given number of stages.
+chain() {
+	line="echo payload"
+	i=2
+	while [ "$i" -lt "$1" ]; do
+		line="$line | cat"
+		i=$((i + 1))
+	done
+	printf '%s | wc -c' "$line"
+}
+
+for stages in 10 100 1000; do
+	script=$(chain "$stages")
+	ok=true
+
+	start=$(now_ns)
+	run=0
+	while [ "$run" -lt "$RUNS" ]; do
+		out=$(printf '%s\nquit\n' "$script" | "$SHELL_BIN" | tr -dc '0-9')
+		[ "$out" = "8" ] || ok=false
+		run=$((run + 1))
+	done
+	total=$(( $(now_ns) - start ))
+
+	printf '{"benchmark": "pipeline_stress", "stages": %d, "runs": %d, "mean_ns": %d, "correct": %s}\n' \
+		"$stages" "$RUNS" $(( total / RUNS )) "$ok"
+done
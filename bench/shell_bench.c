@@ -0,0 +1,649 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Benchmark Driver
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmarks the hot paths of the shell in-process, linked against the shell engine library.
+ * Prints one JSON object per benchmark, in the same format as the bench scripts.
+ *
+ * Usage: shell_bench [scale]
+ * The scale (default 1) multiplies the number of iterations of every benchmark.
+ */
+
+#include "../include/shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// The shell instance the benchmarks run on.
+static PShellContext ctx = NULL;
+
+/*
+ * @brief The synthetic command line used by the tokenizer benchmark.
+ */
+#define BENCH_TOKENIZE_LINE "ls -la \"quoted argument with spaces\" $HOME 'single quoted' | grep -v foo | sort -r > out.txt 2>&1"
+
+/*
+ * @brief The synthetic command line used by the variable expansion benchmark.
+ */
+#define BENCH_VARIABLES_LINE "echo $var0 $var1 $var2 $var3 $var4 $var5 $var6 $var7 literal $undefined $?"
+
+/*
+ * @brief The number of bytes sent through each pipeline in the pipeline benchmark.
+ */
+#define BENCH_PIPELINE_BYTES "268435456"
+
+/*
+ * @brief Get the current time.
+ * @return The time in nanoseconds, from a monotonic clock.
+ */
+static long long now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * @brief Build an argument array from a string literal, with the shell's tokenizer.
+ * @param command The command.
+ * @return The argument array.
+ */
+static char **make_argv(const char *command)
+{
+	char **argv = tokenize_command(command, count_tokens(command));
+
+	if (argv == NULL)
+	{
+		fprintf(stderr, "shell_bench: tokenize_command() failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return argv;
+}
+
+/*
+ * @brief Add a command to the history, as the parser does before the executor runs it.
+ * @param command The command.
+ */
+static void push_history(const char *command)
+{
+	PCommand cmd = create_command((char *)command, false, false);
+
+	if (cmd == NULL || addNode(ctx->commandHistory, cmd) == 1)
+	{
+		fprintf(stderr, "shell_bench: failed to add a command to the history\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+/*
+ * @brief Tokenizer throughput: count_tokens() and tokenize_command() on a synthetic line.
+ * @param iterations The number of lines to tokenize.
+ */
+static void bench_tokenize(long iterations)
+{
+	const size_t line_len = strlen(BENCH_TOKENIZE_LINE);
+	long long start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+	{
+		char **argv = make_argv(BENCH_TOKENIZE_LINE);
+		freeUpMem(&argv);
+	}
+
+	long long total = now_ns() - start;
+
+	printf("{\"benchmark\": \"tokenize_command\", \"iterations\": %ld, \"ns_per_line\": %lld, \"mb_per_sec\": %.2f}\n",
+		   iterations, total / iterations, (double)line_len * iterations / 1e6 / (total / 1e9));
+}
+
+/*
+ * @brief Variable expansion throughput: parse_variables() on a tokenized line.
+ * @param iterations The number of lines to expand.
+ */
+static void bench_parse_variables(long iterations)
+{
+	char name[32], value[32];
+
+	for (int i = 0; i < 8; ++i)
+	{
+		snprintf(name, sizeof(name), "var%d", i);
+		snprintf(value, sizeof(value), "value%d", i);
+		setVariable(ctx, name, value);
+	}
+
+	long long start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+	{
+		char **argv = make_argv(BENCH_VARIABLES_LINE);
+		parse_variables(&argv, ctx);
+		freeUpMem(&argv);
+	}
+
+	long long total = now_ns() - start;
+
+	printf("{\"benchmark\": \"parse_variables\", \"iterations\": %ld, \"variables\": %d, \"ns_per_line\": %lld}\n",
+		   iterations, 8, total / iterations);
+}
+
+/*
+ * @brief Arithmetic expansion: evaluating a cached expression, and compiling a new one.
+ * @param iterations The number of evaluations of each kind.
+ * @note The cached expression is a loop counter ("i += 1"), the new ones are distinct texts that miss the cache.
+ */
+static void bench_arith(long iterations)
+{
+	const char *counter = "i += 1", *cond = "(i * 3 + 7) % 11 < 5 && i != 0";
+	char expr[64];
+	long long value, sum = 0;
+
+	setVariable(ctx, "i", "0");
+
+	long long start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+	{
+		arith_eval(ctx, counter, strlen(counter), &value);
+		arith_eval(ctx, cond, strlen(cond), &value);
+		sum += value;
+	}
+
+	long long cached = now_ns() - start;
+	long long last = 0;
+
+	arith_eval(ctx, "i", 1, &last);
+	start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+	{
+		int len = snprintf(expr, sizeof(expr), "(i * 3 + %ld) %% 11 < 5 && i != 0", i);
+
+		arith_eval(ctx, expr, len, &value);
+	}
+
+	long long compiled = now_ns() - start;
+
+	printf("{\"benchmark\": \"arith\", \"iterations\": %ld, \"ns_per_cached_eval\": %lld, \"ns_per_compile_and_eval\": %lld, \"correct\": %s}\n",
+		   iterations, cached / (2 * iterations), compiled / iterations, (last == iterations && sum > 0) ? "true" : "false");
+}
+
+/*
+ * @brief Variable set and get at scale.
+ * @param count The number of distinct variables.
+ */
+static void bench_variables(long count)
+{
+	char name[64], value[32];
+	long long start = now_ns();
+
+	for (long i = 0; i < count; ++i)
+	{
+		snprintf(name, sizeof(name), "scale%ld_%ld", count, i);
+		snprintf(value, sizeof(value), "%ld", i);
+		setVariable(ctx, name, value);
+	}
+
+	long long set_total = now_ns() - start;
+	long misses = 0;
+
+	start = now_ns();
+
+	for (long i = 0; i < count; ++i)
+	{
+		snprintf(name, sizeof(name), "scale%ld_%ld", count, (i * 7919) % count);
+
+		if (get_variable(ctx->variableList, name) == NULL)
+			++misses;
+	}
+
+	long long get_total = now_ns() - start;
+
+	printf("{\"benchmark\": \"variables\", \"count\": %ld, \"set_ns_per_op\": %lld, \"get_ns_per_op\": %lld, \"correct\": %s}\n",
+		   count, set_total / count, get_total / count, (misses == 0) ? "true" : "false");
+}
+
+/*
+ * @brief Environment of a launch: the cached envp, and rebuilding it after an exported variable changed.
+ * @param iterations The number of cached lookups (a hundredth of them are rebuilds).
+ * @param num_exported The number of variables to export.
+ * @note Runs after the variable benchmarks, so the exported variables are a few among thousands.
+ */
+static void bench_env(long iterations, int num_exported)
+{
+	char name[32], value[32];
+	long rebuilds = iterations / 100 + 1, num_vars = 0;
+
+	for (int i = 0; i < num_exported; ++i)
+	{
+		snprintf(name, sizeof(name), "env%d", i);
+		snprintf(value, sizeof(value), "%d", i);
+		setVariable(ctx, name, value);
+		env_export(ctx, name);
+	}
+
+	for (PNode curr = ctx->variableList->head; curr != NULL; curr = curr->next)
+		++num_vars;
+
+	long long start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+		env_get(ctx);
+
+	long long cached = now_ns() - start;
+
+	start = now_ns();
+
+	for (long i = 0; i < rebuilds; ++i)
+	{
+		snprintf(value, sizeof(value), "%ld", i);
+		setVariable(ctx, "env0", value);
+		env_get(ctx);
+	}
+
+	long long rebuilt = now_ns() - start;
+	char **envp = env_get(ctx);
+	bool found = false;
+
+	for (; *envp != NULL; ++envp)
+		found |= (strncmp(*envp, "env0=", 5) == 0 && atol(*envp + 5) == rebuilds - 1);
+
+	printf("{\"benchmark\": \"env_get\", \"variables\": %ld, \"exported\": %d, \"ns_per_cached_get\": %lld, \"ns_per_rebuild\": %lld, \"correct\": %s}\n",
+		   num_vars, num_exported, cached / iterations, rebuilt / rebuilds, found ? "true" : "false");
+}
+
+/*
+ * @brief Alias expansion throughput: tokenizing a pipeline whose command words are aliases, and alias_expand() on it.
+ * @param iterations The number of lines to expand.
+ * @param num_aliases The number of aliases defined (0 measures the cost of the check alone).
+ */
+static void bench_aliases(long iterations, int num_aliases)
+{
+	char name[32], value[32];
+
+	for (int i = 0; i < num_aliases; ++i)
+	{
+		snprintf(name, sizeof(name), "al%d", i);
+		snprintf(value, sizeof(value), "cmd%d --flag%d", i, i);
+		alias_set(ctx, name, value);
+	}
+
+	long long start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+	{
+		char **argv = make_argv("al0 arg | al1 | al2 -x");
+		alias_expand(ctx, &argv);
+		freeUpMem(&argv);
+	}
+
+	long long total = now_ns() - start;
+
+	printf("{\"benchmark\": \"alias_expand\", \"iterations\": %ld, \"aliases\": %d, \"ns_per_line\": %lld}\n",
+		   iterations, num_aliases, total / iterations);
+
+	alias_free(ctx);
+}
+
+/*
+ * @brief Function call overhead: a one-line function, against the same command run directly.
+ * @param iterations The number of calls.
+ */
+static void bench_function_call(long iterations)
+{
+	char line[64];
+
+	function_define(ctx, "setfirst() { $first = $1 }");
+
+	// The parser changes the command line, so each run gets a fresh copy.
+	long long start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+	{
+		strcpy(line, "$first = value");
+		shell_run_command(ctx, line);
+	}
+
+	long long direct = now_ns() - start;
+
+	start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+	{
+		strcpy(line, "setfirst value");
+		shell_run_command(ctx, line);
+	}
+
+	long long total = now_ns() - start;
+	char *value = get_variable(ctx->variableList, "first");
+
+	printf("{\"benchmark\": \"function_call\", \"iterations\": %ld, \"ns_per_call\": %lld, \"ns_per_direct_command\": %lld, \"correct\": %s}\n",
+		   iterations, total / iterations, direct / iterations, (value != NULL && strcmp(value, "value") == 0) ? "true" : "false");
+
+	function_free(ctx);
+}
+
+/*
+ * @brief Glob expansion of a large directory: a pattern that matches every tenth entry, and one that matches none.
+ * @param num_files The number of files in the directory.
+ * @param runs The number of expansions of each pattern.
+ */
+static void bench_glob(long num_files, int runs)
+{
+	char dir[] = "/tmp/shell_bench_glob.XXXXXX", path[64], pattern[64];
+	long long some = 0, none = 0;
+	long matched = 0;
+
+	if (mkdtemp(dir) == NULL)
+	{
+		perror("shell_bench: mkdtemp");
+		return;
+	}
+
+	for (long i = 0; i < num_files; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/file%07ld.log", dir, i);
+		close(open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+	}
+
+	for (int r = 0; r < runs; ++r)
+	{
+		snprintf(pattern, sizeof(pattern), "ls %s/file*[0-9]3.log", dir);
+		char **argv = make_argv(pattern);
+		long long start = now_ns();
+
+		glob_expand(&argv);
+		some += now_ns() - start;
+
+		for (matched = 0; *(argv + matched + 1) != NULL; ++matched)
+			;
+
+		freeUpMem(&argv);
+
+		snprintf(pattern, sizeof(pattern), "ls %s/*.txt", dir);
+		argv = make_argv(pattern);
+		start = now_ns();
+
+		glob_expand(&argv);
+		none += now_ns() - start;
+
+		freeUpMem(&argv);
+	}
+
+	for (long i = 0; i < num_files; ++i)
+	{
+		snprintf(path, sizeof(path), "%s/file%07ld.log", dir, i);
+		unlink(path);
+	}
+
+	rmdir(dir);
+
+	printf("{\"benchmark\": \"glob\", \"entries\": %ld, \"matches\": %ld, \"ns_per_match_expand\": %lld, \"ns_per_empty_expand\": %lld, \"correct\": %s}\n",
+		   num_files, matched, some / runs, none / runs, (matched == num_files / 10) ? "true" : "false");
+}
+
+/*
+ * @brief Create or remove the tree of the recursive glob benchmark: 10x10x10 directories of files.
+ * @param root The root of the tree.
+ * @param files_per_dir The number of files in each leaf directory.
+ * @param create True to create the tree, false to remove it.
+ */
+static void glob_tree(const char *root, long files_per_dir, bool create)
+{
+	char path[128];
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		int len = snprintf(path, sizeof(path), "%s/d%d/d%d/d%d", root, i / 100, i / 10 % 10, i % 10);
+
+		for (int level = 3; create && level > 0; --level)
+		{
+			// Create the parents first.
+			*(path + len - 3 * (level - 1)) = '\0';
+			mkdir(path, 0755);
+			*(path + len - 3 * (level - 1)) = '/';
+		}
+
+		*(path + len) = '\0';
+
+		for (long j = 0; j < files_per_dir; ++j)
+		{
+			snprintf(path + len, sizeof(path) - len, "/file%ld.%s", j, (j % 10 == 7) ? "log" : "dat");
+
+			if (create)
+				close(open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+
+			else
+				unlink(path);
+		}
+
+		*(path + len) = '\0';
+
+		for (int level = 1; !create && level <= 3; ++level)
+		{
+			*(path + len - 3 * (level - 1)) = '\0';
+			rmdir(path);
+		}
+	}
+
+	if (!create)
+		rmdir(root);
+}
+
+/*
+ * @brief Recursive glob ("**") of a tree of files: a single walker against one walker for each CPU.
+ * @param num_files The number of files in the tree (in 1000 directories).
+ * @param runs The number of expansions with each number of walkers.
+ * @note Both walks must expand into the same arguments, in the same order.
+ */
+static void bench_glob_tree(long num_files, int runs)
+{
+	char root[] = "/tmp/shell_bench_tree.XXXXXX", line[64];
+	long long elapsed[2] = {0};
+	long matched[2] = {0};
+	char **result[2] = {NULL};
+	bool same = true;
+
+	if (mkdtemp(root) == NULL)
+	{
+		perror("shell_bench: mkdtemp");
+		return;
+	}
+
+	glob_tree(root, num_files / 1000, true);
+	snprintf(line, sizeof(line), "ls %s/**/*.log", root);
+
+	for (int mode = 0; mode < 2; ++mode)
+	{
+		glob_set_option("threads", (mode == 0) ? "1" : "0");
+
+		for (int r = 0; r < runs; ++r)
+		{
+			char **argv = make_argv(line);
+			long long start = now_ns();
+
+			glob_expand(&argv);
+			*(elapsed + mode) += now_ns() - start;
+
+			freeUpMem(result + mode);
+			*(result + mode) = argv;
+		}
+
+		for (*(matched + mode) = 0; *(*(result + mode) + *(matched + mode) + 1) != NULL; ++*(matched + mode))
+			;
+	}
+
+	for (long i = 0; same && i <= *matched; ++i)
+		same = (*(matched + 1) == *matched && strcmp(*(*result + i), *(*(result + 1) + i)) == 0);
+
+	freeUpMem(result);
+	freeUpMem(result + 1);
+	glob_set_option("threads", "0");
+	glob_tree(root, num_files / 1000, false);
+
+	printf("{\"benchmark\": \"glob_recursive\", \"files\": %ld, \"matches\": %ld, \"threads\": %ld, \"ns_single_thread\": %lld, \"ns_parallel\": %lld, \"correct\": %s}\n",
+		   num_files, *matched, sysconf(_SC_NPROCESSORS_ONLN), *elapsed / runs, *(elapsed + 1) / runs,
+		   (same && *matched == num_files / 10) ? "true" : "false");
+}
+
+/*
+ * @brief History append throughput.
+ * @param count The number of commands to append.
+ */
+static void bench_history(long count)
+{
+	long long start = now_ns();
+
+	for (long i = 0; i < count; ++i)
+		push_history(BENCH_TOKENIZE_LINE);
+
+	long long total = now_ns() - start;
+
+	printf("{\"benchmark\": \"history_append\", \"count\": %ld, \"ns_per_op\": %lld}\n", count, total / count);
+}
+
+/*
+ * @brief Fork/exec latency of a trivial command through execute_command().
+ * @param iterations The number of commands to run.
+ * @note The command is given by its path, a plain "true" is a builtin.
+ */
+static void bench_fork_exec(long iterations)
+{
+	char **argv = make_argv("/usr/bin/true");
+	long failures = 0;
+
+	push_history("/usr/bin/true");
+
+	long long start = now_ns();
+
+	for (long i = 0; i < iterations; ++i)
+	{
+		execute_command(ctx, argv);
+		failures += (((PCommand)ctx->commandHistory->tail->data)->status != 0);
+	}
+
+	long long total = now_ns() - start;
+
+	freeUpMem(&argv);
+
+	printf("{\"benchmark\": \"fork_exec\", \"iterations\": %ld, \"ns_per_command\": %lld, \"correct\": %s}\n",
+		   iterations, total / iterations, (failures == 0) ? "true" : "false");
+}
+
+/*
+ * @brief Pipeline throughput: a producer followed by cat stages, through execute_command().
+ * @param stages The number of stages of the pipeline.
+ * @param runs The number of runs.
+ */
+static void bench_pipeline(int stages, long runs)
+{
+	// "head -c N /dev/zero | cat | ... | cat > /dev/null"
+	size_t cap = 128 + (size_t)stages * 8;
+	char *line = (char *)malloc(cap);
+
+	if (line == NULL)
+	{
+		perror("shell_bench: malloc(3)");
+		exit(EXIT_FAILURE);
+	}
+
+	int len = snprintf(line, cap, "head -c " BENCH_PIPELINE_BYTES " /dev/zero");
+
+	for (int i = 1; i < stages; ++i)
+		len += snprintf(line + len, cap - len, " | cat");
+
+	snprintf(line + len, cap - len, " > /dev/null");
+	push_history(line);
+
+	long failures = 0;
+	long long start = now_ns();
+
+	for (long i = 0; i < runs; ++i)
+	{
+		// The redirections are removed from the arguments by the executor, so each run needs a fresh copy.
+		char **argv = make_argv(line);
+
+		execute_command(ctx, argv);
+		failures += (((PCommand)ctx->commandHistory->tail->data)->status != 0);
+		freeUpMem(&argv);
+	}
+
+	long long total = now_ns() - start;
+	double bytes = strtod(BENCH_PIPELINE_BYTES, NULL);
+
+	printf("{\"benchmark\": \"pipeline\", \"stages\": %d, \"runs\": %ld, \"mean_ns\": %lld, \"mb_per_sec\": %.2f, \"correct\": %s}\n",
+		   stages, runs, total / runs, bytes / 1e6 / (total / runs / 1e9), (failures == 0) ? "true" : "false");
+
+	free(line);
+}
+
+int main(int argc, char **args)
+{
+	long scale = (argc > 1) ? strtol(*(args + 1), NULL, 10) : 1;
+
+	if (scale <= 0)
+	{
+		fprintf(stderr, "Usage: %s [scale]\n", *args);
+		return EXIT_FAILURE;
+	}
+
+	if ((ctx = shell_init()) == NULL)
+		return EXIT_FAILURE;
+
+	// Results go to stdout, one per line, as soon as each benchmark finishes.
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	bench_tokenize(200000 * scale);
+
+	// Before the variable benchmarks, as every command updates the last status variable.
+	bench_function_call(100000 * scale);
+
+	bench_parse_variables(200000 * scale);
+	bench_arith(1000000 * scale);
+
+	for (long count = 100; count <= 10000; count *= 10)
+		bench_variables(count * scale);
+
+	bench_env(1000000 * scale, 100);
+
+	bench_aliases(200000 * scale, 0);
+	bench_aliases(200000 * scale, 100);
+
+	bench_glob(100000 * scale, 5);
+	bench_glob_tree(1000000, 3 * scale);
+
+	bench_history(100000 * scale);
+	bench_fork_exec(500 * scale);
+
+	bench_pipeline(1, 5 * scale);
+	bench_pipeline(3, 5 * scale);
+	bench_pipeline(10, 5 * scale);
+
+	shell_cleanup(ctx);
+	path_index_free();
+	stats_free();
+
+	return EXIT_SUCCESS;
+}
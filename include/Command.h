@@ -24,6 +24,8 @@
 /********************/
 #include "shell_def.h"
 #include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
 
 /*******************/
 /* Structs Section */
@@ -35,12 +37,26 @@
  * @param status The status of the command (0 if succeeded, 1 if failed).
  * @param isInternal True if the command is an internal command, False otherwise.
  * @param background True if the command is a background command, False otherwise.
+ * @param start_ns When the command started, in nanoseconds from a monotonic clock.
+ * @param end_ns When the command finished, in nanoseconds from a monotonic clock (0 if unknown, e.g. a background command).
+ * @param pids The process IDs of the command's pipeline stages (NULL for internal commands).
+ * @param num_pids The number of process IDs.
+ * @param timeout_ns The run time the command is bounded to by the timeout command, in nanoseconds (0 if unbounded).
+ * @param kill_after_ns The time the command gets to exit after SIGTERM, before SIGKILL, in nanoseconds.
+ * @param timed_out True if the command was stopped by the timeout command, False otherwise.
  */
 typedef struct Command {
     char *command;
     int status;
     bool isInternal;
     bool background;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    pid_t *pids;
+    int num_pids;
+    uint64_t timeout_ns;
+    uint64_t kill_after_ns;
+    bool timed_out;
 } Command, *PCommand;
 
 /*********************/
@@ -23,6 +23,7 @@
 /* Includes Section */
 /********************/
 #include "shell_def.h"
+#include <stdbool.h>
 
 /*******************/
 /* Structs Section */
@@ -32,11 +33,13 @@
  * @brief The variable struct.
  * @param name The name of the variable.
  * @param value The value of the variable.
+ * @param exported True if the variable is passed to the environment of the commands the shell executes.
  * @note The name and value pointers cannot be NULL.
  */
 typedef struct Variable {
     char *name;
     char *value;
+    bool exported;
 } Variable, *PVariable;
 
 /*********************/
@@ -23,39 +23,80 @@
 /* Includes Section */
 /********************/
 
+#include "shell_context.h"
 #include "shell_utils.h"
 #include "shell_internal_cmds.h"
+#include "shell_redirect.h"
+#include "shell_subst.h"
+#include "shell_fanout.h"
+#include "shell_lineedit.h"
+#include "shell_pathindex.h"
+#include "shell_stats.h"
+#include "shell_trace.h"
+#include "shell_alias.h"
+#include "shell_function.h"
+#include "shell_env.h"
+#include "shell_glob.h"
+#include "shell_arith.h"
+#include "shell_test.h"
+#include "shell_job.h"
 
 
 /*********************/
 /* Functions Section */
 /*********************/
 
+/*
+ * @brief Create a new shell instance.
+ * @return The shell context, or NULL on failure.
+ * @note The instance starts in the current working directory, with an empty history and the default prompt.
+ */
+PShellContext shell_init();
+
 /*
  * @brief Parse a command into arguments.
+ * @param ctx The shell context.
  * @param command The command to parse.
  * @param argv The array of arguments.
  * @return 0 if it an internal command, 1 if it is an external command.
  * @note This function will modify the argv array.
  * @note This function will execute internal commands.
  */
-CommandType parse_command(char *command, char ***argv);
+CommandType parse_command(PShellContext ctx, char *command, char ***argv);
+
+/*
+ * @brief Parse and execute a command line.
+ * @param ctx The shell context.
+ * @param command The command line (modified by the parser).
+ */
+void shell_run_command(PShellContext ctx, char *command);
 
 /*
  * @brief Execute change directory command.
+ * @param ctx The shell context.
  * @param path The path to change to.
  * @param argc The number of arguments.
  * @return Success if the command succeeded, Failure otherwise.
  * @note number of arguments must be 1.
  */
-Result cmdCD(char *path, int argc);
+Result cmdCD(PShellContext ctx, char *path, int argc);
 
 /*
  * @brief Execute a command.
+ * @param ctx The shell context.
  * @param argv The array of arguments.
  * @return void (nothing).
  */
-void execute_command(char **argv);
+void execute_command(PShellContext ctx, char **argv);
+
+/*
+ * @brief Run a command line in a subshell (a forked copy of the shell) and exit with its status.
+ * @param ctx The shell context.
+ * @param command The command line to run.
+ * @noreturn
+ * @note Must only be called in a child process.
+ */
+void run_subshell(PShellContext ctx, const char *command);
 
 /*
  * @brief A signal handler for the shell program.
@@ -66,14 +107,15 @@ void shell_sig_handler(int signum);
 
 /*
  * @brief A cleanup routine for the shell program.
- * @noreturn
+ * @param ctx The shell context, freed by this function.
  */
-void shell_cleanup();
+void shell_cleanup(PShellContext ctx);
 
 /*
  * @brief Update the status of the last command.
+ * @param ctx The shell context.
  * @param status The new status.
  */
-void update_laststatus(int status);
+void update_laststatus(PShellContext ctx, int status);
 
 #endif /* _SHELL_H */
\ No newline at end of file
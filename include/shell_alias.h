@@ -0,0 +1,106 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Aliases Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_ALIAS_H
+#define _SHELL_ALIAS_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include "shell_context.h"
+#include <stdio.h>
+#include <stdbool.h>
+
+/*******************/
+/* Structs Section */
+/*******************/
+
+/*
+ * @brief An alias.
+ * @param name The name of the alias, the key of the alias table (so it's the first member).
+ * @param value The value of the alias, as it was defined.
+ * @param tokens The value, already tokenized (NULL if the value is empty).
+ * @param num_tokens The number of tokens.
+ * @param in_use True while the alias is being expanded, so it's never expanded into itself.
+ * @param next_used The next alias that is being expanded at the same command word.
+ */
+typedef struct Alias {
+	char *name;
+	char *value;
+	char **tokens;
+	int num_tokens;
+	bool in_use;
+	struct Alias *next_used;
+} Alias, *PAlias;
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Define an alias, or replace its value.
+ * @param ctx The shell context.
+ * @param name The name of the alias.
+ * @param value The value of the alias. It's tokenized once, here.
+ * @return Success if the alias was defined, Failure otherwise.
+ */
+Result alias_set(PShellContext ctx, const char *name, const char *value);
+
+/*
+ * @brief Remove an alias.
+ * @param ctx The shell context.
+ * @param name The name of the alias.
+ * @return Success if the alias was removed, Failure if there is no such alias.
+ */
+Result alias_unset(PShellContext ctx, const char *name);
+
+/*
+ * @brief Find an alias.
+ * @param ctx The shell context.
+ * @param name The name of the alias.
+ * @return The alias, or NULL if there is no such alias.
+ */
+PAlias alias_lookup(PShellContext ctx, const char *name);
+
+/*
+ * @brief Print aliases, in a form that can be used to define them again.
+ * @param ctx The shell context.
+ * @param out The stream to print to.
+ * @param name The name of the alias to print, or NULL to print all of them (sorted by name).
+ * @return Success if the alias was printed, Failure if there is no such alias.
+ */
+Result alias_print(PShellContext ctx, FILE *out, const char *name);
+
+/*
+ * @brief Expand the aliases of the command words of a command.
+ * @param ctx The shell context.
+ * @param argv A pointer to the array of arguments. It's reallocated if an alias changes the number of words.
+ * @note The command words are the first word, the first word after each "|" or "|>", and the word after "if".
+ * 		 The tokens of the alias are spliced into the arguments as they are, and are checked for aliases again,
+ * 		 but an alias is never expanded inside its own expansion. Costs a single check when no aliases are defined.
+ */
+void alias_expand(PShellContext ctx, char ***argv);
+
+/*
+ * @brief Remove all the aliases and free their memory.
+ * @param ctx The shell context.
+ */
+void alias_free(PShellContext ctx);
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Arithmetic Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_ARITH_H
+#define _SHELL_ARITH_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include "shell_context.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/***********************/
+/* Definitions Section */
+/***********************/
+
+/*
+ * @brief The maximum depth of the evaluation stack of an expression (the nesting of its operands).
+ */
+#define ARITH_MAX_STACK 64
+
+/*
+ * @brief The maximum number of compiled expressions kept in the cache, it's emptied when it's full.
+ */
+#define ARITH_CACHE_MAX 1024
+
+/*******************/
+/* Structs Section */
+/*******************/
+
+/*
+ * @brief The type of an instruction of a compiled expression.
+ * @note The unary and binary operators replace their operands on the stack with the result.
+ */
+typedef enum _ArithOpType {
+	/*
+	 * @brief Push a number, or the value of a variable.
+	*/
+	ARITH_OP_NUM = 0,
+	ARITH_OP_VAR,
+
+	/*
+	 * @brief Apply an assignment (a compound one, if op isn't ARITH_OP_NUM) to a variable, and push the new value.
+	*/
+	ARITH_OP_ASSIGN,
+
+	/*
+	 * @brief The arithmetic, bitwise and comparison operators, like in C.
+	*/
+	ARITH_OP_NEG,
+	ARITH_OP_NOT,
+	ARITH_OP_BNOT,
+	ARITH_OP_MUL,
+	ARITH_OP_DIV,
+	ARITH_OP_MOD,
+	ARITH_OP_ADD,
+	ARITH_OP_SUB,
+	ARITH_OP_SHL,
+	ARITH_OP_SHR,
+	ARITH_OP_LT,
+	ARITH_OP_LE,
+	ARITH_OP_GT,
+	ARITH_OP_GE,
+	ARITH_OP_EQ,
+	ARITH_OP_NE,
+	ARITH_OP_BAND,
+	ARITH_OP_BXOR,
+	ARITH_OP_BOR,
+
+	/*
+	 * @brief Replace the top of the stack with 0 or 1 (the right operand of && and ||).
+	*/
+	ARITH_OP_BOOL,
+
+	/*
+	 * @brief The jumps of &&, || and ?:. AND_JUMP jumps if the top is 0 (keeping it), OR_JUMP jumps if it isn't
+	 * 		  (replacing it with 1), otherwise they pop it. JUMP_ZERO pops the top and jumps if it's 0.
+	*/
+	ARITH_OP_AND_JUMP,
+	ARITH_OP_OR_JUMP,
+	ARITH_OP_JUMP_ZERO,
+	ARITH_OP_JUMP
+} ArithOpType;
+
+/*
+ * @brief An instruction of a compiled expression.
+ * @param type The type of the instruction.
+ * @param op The operator of a compound assignment (e.g. ARITH_OP_ADD for "+="), ARITH_OP_NUM for "=".
+ * @param var The index of the variable of an ARITH_OP_VAR or ARITH_OP_ASSIGN instruction.
+ * @param value The number of an ARITH_OP_NUM instruction, or the target of a jump.
+ */
+typedef struct ArithOp {
+	uint8_t type;
+	uint8_t op;
+	uint16_t var;
+	long long value;
+} ArithOp, *PArithOp;
+
+/*
+ * @brief A compiled expression, a postfix program for a stack machine.
+ * @param source The text of the expression, the key of the cache.
+ * @param ops The instructions.
+ * @param num_ops The number of instructions.
+ * @param vars The names of the variables the expression references, each one once.
+ * @param num_vars The number of variables.
+ * @param next The next expression in the same hash bucket.
+ */
+typedef struct ArithProgram {
+	char *source;
+	PArithOp ops;
+	int num_ops;
+	char **vars;
+	int num_vars;
+	struct ArithProgram *next;
+} ArithProgram, *PArithProgram;
+
+/*
+ * @brief The compiled expressions of a shell, in a chained hash table keyed by their text.
+ * @param buckets The hash buckets.
+ * @param capacity The number of buckets, a power of two.
+ * @param count The number of expressions.
+ */
+typedef struct ArithCache {
+	PArithProgram *buckets;
+	size_t capacity;
+	size_t count;
+} ArithCache, *PArithCache;
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Evaluate an arithmetic expression (the text inside "$((...))").
+ * @param ctx The shell context.
+ * @param expr The expression.
+ * @param len The length of the expression.
+ * @param result Where to store the value of the expression.
+ * @return Success on success, Failure on a syntax error, a division by zero or a variable that isn't an integer.
+ * @note The expression is compiled once and cached by its text, so evaluating it again (e.g. in a loop or a
+ * 		 function's body) doesn't parse it. The variables are looked up on every evaluation.
+ * @note Supports integer literals (decimal, 0x hex and 0 octal), variables (with or without "$", unset ones are 0),
+ * 		 parentheses, the unary + - ! ~, the binary * / % + - << >> < <= > >= == != & ^ | && ||, ?: and
+ * 		 assignments (= *= /= %= += -= <<= >>= &= ^= |=), with C precedence.
+ */
+Result arith_eval(PShellContext ctx, const char *expr, size_t len, long long *result);
+
+/*
+ * @brief Free the compiled expressions.
+ * @param ctx The shell context.
+ */
+void arith_free(PShellContext ctx);
+
+#endif
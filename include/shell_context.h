@@ -0,0 +1,98 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Context Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_CONTEXT_H
+#define _SHELL_CONTEXT_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include "LinkedList.h"
+#include <stdbool.h>
+
+/*******************/
+/* Structs Section */
+/*******************/
+
+// The tables of the aliases and of the functions of a shell (see shell_utils.h).
+struct NameTable;
+
+// The frame of a running function call (see shell_function.h).
+struct ShellFrame;
+
+// The environment of the executed commands (see shell_env.h).
+struct ShellEnv;
+
+// The compiled arithmetic expressions (see shell_arith.h).
+struct ArithCache;
+
+/*
+ * @brief An open if block, on the stack of the nested if blocks.
+ * @param state The part of the block the shell is in (STATE_WANT_THEN, STATE_THEN_BLOCK or STATE_ELSE_BLOCK).
+ * @param taken True if the condition succeeded, so the then block runs and the else block doesn't.
+ * @param enclosing_runs True if the block itself is in code that runs, False if it's in a skipped branch.
+ */
+typedef struct IfBlock {
+	State state;
+	bool taken;
+	bool enclosing_runs;
+} IfBlock, *PIfBlock;
+
+/*
+ * @brief The state of a shell instance.
+ * @param homedir The home directory.
+ * @param cwd The current working directory.
+ * @param workingdir The previous working directory, before the last directory change.
+ * @param curr_prompt The current prompt (default is SHELL_DEFAULT_PROMPT).
+ * @param commandHistory The command history.
+ * @param variableList The shell variables.
+ * @param env The environment of the executed commands, built from the inherited and the exported variables.
+ * @param aliases The aliases (NULL until the first one is defined).
+ * @param functions The functions (NULL until the first one is defined).
+ * @param frame The frame of the innermost running function call (NULL outside of functions).
+ * @param arith The compiled arithmetic expressions (NULL until the first one is evaluated).
+ * @param if_stack The open if/then/else/fi blocks, the innermost one last.
+ * @param if_depth The number of open if blocks.
+ * @param if_base The number of open if blocks that belong to the callers of the running function (its body starts
+ * 		 outside of any if block).
+ * @param subst_status The status of the last command substitution of the running command, -1 if none ran.
+ * @param exit_requested True once the quit command was executed.
+ * @note Every function of the shell engine works on an explicit context, so several independent
+ * 		 shell instances can live in one process.
+ */
+typedef struct ShellContext {
+	char *homedir;
+	char *cwd;
+	char *workingdir;
+	char *curr_prompt;
+	PLinkedList commandHistory;
+	PLinkedList variableList;
+	struct ShellEnv *env;
+	struct NameTable *aliases;
+	struct NameTable *functions;
+	struct ShellFrame *frame;
+	struct ArithCache *arith;
+	IfBlock if_stack[SHELL_MAX_IF_DEPTH];
+	int if_depth;
+	int if_base;
+	int subst_status;
+	bool exit_requested;
+} ShellContext, *PShellContext;
+
+#endif /* _SHELL_CONTEXT_H */
@@ -22,7 +22,12 @@
 /*
  * Allow the GNU extensions of POSIX functions (such as getline) to be used.
  * This is required for the shell to work properly.
+ * @note Linux specific system calls (such as memfd_create) are only exposed under _GNU_SOURCE.
  */
+#if !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE
+#endif					  /* !_GNU_SOURCE */
+
 #if !defined(_XOPEN_SOURCE) && !defined(_POSIX_C_SOURCE)
 	#if __STDC_VERSION__ >= 199901L
 		#define _XOPEN_SOURCE 600 /* SUS v3, POSIX 1003.1 2004 (POSIX 2001 + Corrigenda) */
@@ -105,6 +110,93 @@
  */
 #define SHELL_CMD_READ "read"
 
+/*
+ * @brief Alias for the statistics command.
+ * @note Used to indicate that the user wants to print (or reset) the shell's internal counters.
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_STATS "stats"
+
+/*
+ * @brief Alias for the set command.
+ * @note Used to indicate that the user wants to change a shell option (e.g. set trace FILE).
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_SET "set"
+
+/*
+ * @brief Alias for the alias command.
+ * @note Used to indicate that the user wants to define or print aliases (e.g. alias ll="ls -la").
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_ALIAS "alias"
+
+/*
+ * @brief Alias for the unalias command.
+ * @note Used to indicate that the user wants to remove aliases.
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_UNALIAS "unalias"
+
+/*
+ * @brief Alias for the return command.
+ * @note Used to indicate that the user wants to return from a function, with an optional status.
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_RETURN "return"
+
+/*
+ * @brief Alias for the export command.
+ * @note Used to indicate that the user wants to pass variables to the environment of the executed commands.
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_EXPORT "export"
+
+/*
+ * @brief Alias for the unset command.
+ * @note Used to indicate that the user wants to remove variables (or functions, with -f).
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_UNSET "unset"
+
+/*
+ * @brief Aliases for the test command, and its closing brackets.
+ * @note Used to indicate that the user wants to check a condition (e.g. "[ -f file ]", "[[ $x == a* ]]").
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_TEST "test"
+#define SHELL_CMD_BRACKET "["
+#define SHELL_CMD_BRACKET_END "]"
+#define SHELL_CMD_DBRACKET "[["
+#define SHELL_CMD_DBRACKET_END "]]"
+
+/*
+ * @brief Utility commands, run by the shell itself (also as a pipeline stage, without an exec).
+ * @note Used to print text ("echo", "printf"), or to just return a status ("true", "false", ":").
+ * @note These are custom made commands and are not part of the assignment.
+ */
+#define SHELL_CMD_ECHO "echo"
+#define SHELL_CMD_PRINTF "printf"
+#define SHELL_CMD_TRUE "true"
+#define SHELL_CMD_FALSE "false"
+#define SHELL_CMD_COLON ":"
+
+/*
+ * @brief Alias for the timeout command.
+ * @note Used to indicate that the user wants to bound the run time of a command (e.g. "timeout 5 make | tee log").
+ * @note This is a custom made command and is not part of the assignment.
+ */
+#define SHELL_CMD_TIMEOUT "timeout"
+
+/*
+ * @brief Aliases for the job control commands.
+ * @note Used to resume a stopped job in the foreground ("fg") or in the background ("bg"), or to list the jobs ("jobs").
+ * @note These are custom made commands and are not part of the assignment.
+ */
+#define SHELL_CMD_FG "fg"
+#define SHELL_CMD_BG "bg"
+#define SHELL_CMD_JOBS "jobs"
+
 
 /**********************/
 /* Clean screen stuff */
@@ -127,40 +219,40 @@
 /******************/
 
 /*
- * @brief Can't redirect input twice error message.
- * @note Used to indicate that the user tried to redirect input twice.
+ * @brief Bad file descriptor in a redirection error message.
+ * @note Used to indicate that the user tried to duplicate or redirect an invalid file descriptor (e.g. 2>&x).
  */
-#define SHELL_ERR_REDIRECT_IN_TWICE "Shell internal error: Can't redirect input twice"
+#define SHELL_ERR_REDIRECT_BAD_FD "Shell internal error: Bad file descriptor in redirection"
 
 /*
- * @brief Can't redirect output twice error message.
- * @note Used to indicate that the user tried to redirect output twice.
+ * @brief Empty pipeline stage error message.
+ * @note Used to indicate that a pipeline has a stage without a command (e.g. ls | | wc).
  */
-#define SHELL_ERR_REDIRECT_OUT_TWICE "Shell internal error: Can't redirect output twice"
+#define SHELL_ERR_PIPE_EMPTY_STAGE "Shell internal error: syntax error: empty command in pipeline"
 
 /*
- * @brief Redirecting output to a file in the first pipe is not allowed.
- * @note Used to indicate that the user tried to redirect output to a file in the first pipe.
+ * @brief Redirecting without a file name is not allowed.
+ * @note Used to indicate that the user tried to redirect without a file name.
  */
-#define SHELL_ERR_REDIRECT_OUT_IN_FIRST_PIPE "Shell internal error: Redirecting output to a file in the first pipe is not allowed"
+#define SHELL_ERR_REDIRECT_NO_FILE "Shell internal error: Redirecting without a file name is not allowed"
 
 /*
- * @brief Redirecting between pipes is not allowed.
- * @note Used to indicate that the user tried to redirect between pipes.
+ * @brief Here-document delimited by end-of-file warning message.
+ * @note Used to indicate that the input ended before the here-document delimiter was found.
  */
-#define SHELL_ERR_REDIRECT_BETWEEN_PIPES "Shell internal error: Redirecting between pipes is not allowed"
+#define SHELL_ERR_HEREDOC_EOF "Shell internal error: here-document delimited by end-of-file"
 
 /*
- * @brief Redirecting input from a file in the last pipe is not allowed.
- * @note Used to indicate that the user tried to redirect input from a file in the last pipe.
+ * @brief Here-document too large error message.
+ * @note Used to indicate that a here-document body doesn't fit into the fallback pipe buffer.
  */
-#define SHELL_ERR_REDIRECT_IN_IN_LAST_PIPE "Shell internal error: Redirecting input from a file in the last pipe is not allowed"
+#define SHELL_ERR_HEREDOC_TOO_LARGE "Shell internal error: here-document is too large"
 
 /*
- * @brief Redirecting without a file name is not allowed.
- * @note Used to indicate that the user tried to redirect without a file name.
+ * @brief Command too long error message.
+ * @note Used to indicate that the user entered a command longer than SHELL_MAX_COMMAND_LENGTH.
  */
-#define SHELL_ERR_REDIRECT_NO_FILE "Shell internal error: Redirecting without a file name is not allowed"
+#define SHELL_ERR_COMMAND_TOO_LONG "Shell internal error: Command is too long"
 
 /*
  * @brief Change directory error message: no such file or directory.
@@ -192,6 +284,137 @@
  */
 #define SHELL_ERR_CMD_SET_SYNTAX "Shell internal error: Syntax error in set command"
 
+/*
+ * @brief Usage message for the statistics command.
+ * @note Used to indicate that the user passed an unknown option to the stats command.
+ */
+#define SHELL_ERR_CMD_STATS_USAGE "stats: Usage: stats [-j|--json] [-r|--reset]"
+
+/*
+ * @brief Usage message for the set command.
+ * @note Used to indicate that the user passed an unknown option to the set command.
+ */
+#define SHELL_ERR_CMD_SET_USAGE "set: Usage: set trace FILE|off, set glob threads N|hidden on|off|ignore NAME[:NAME...]|off"
+
+/*
+ * @brief Usage message for the history command.
+ * @note Used to indicate that the user passed an unknown option to the history command.
+ */
+#define SHELL_ERR_CMD_HISTORY_USAGE "history: Usage: history [-t | --slowest N]"
+
+/*
+ * @brief Alias not found error message.
+ * @note Used to indicate that the user tried to print or remove an alias that isn't defined.
+ */
+#define SHELL_ERR_CMD_ALIAS_NOT_FOUND "alias: No such alias"
+
+/*
+ * @brief Invalid alias error message.
+ * @note Used to indicate that the user tried to define an alias without a name (e.g. alias =ls).
+ */
+#define SHELL_ERR_CMD_ALIAS_INVALID "alias: Invalid alias definition"
+
+/*
+ * @brief Usage message for the unalias command.
+ * @note Used to indicate that the user ran the unalias command without arguments.
+ */
+#define SHELL_ERR_CMD_UNALIAS_USAGE "unalias: Usage: unalias -a | unalias NAME..."
+
+/*
+ * @brief Return outside of a function error message.
+ * @note Used to indicate that the user ran the return command outside of a function.
+ */
+#define SHELL_ERR_CMD_RETURN_OUTSIDE "return: Can only be used in a function"
+
+/*
+ * @brief Invalid variable name error message.
+ * @note Used to indicate that the user tried to export (or unset) a variable with an invalid name, or $?.
+ */
+#define SHELL_ERR_CMD_VAR_INVALID "Not a valid identifier"
+
+/*
+ * @brief Usage message for the unset command.
+ * @note Used to indicate that the user ran the unset command without arguments.
+ */
+#define SHELL_ERR_CMD_UNSET_USAGE "unset: Usage: unset [-f | -v] NAME..."
+
+/*
+ * @brief Usage message for the timeout command.
+ * @note Used to indicate that the timeout command has no command, or a duration that isn't valid.
+ */
+#define SHELL_ERR_CMD_TIMEOUT_USAGE "timeout: Usage: timeout [-k DURATION] DURATION COMMAND [ARGS...] (DURATION is a number, with an optional s, m, h or d suffix)"
+
+/*
+ * @brief Usage message for the fg and bg commands.
+ * @note Used to indicate that the fg or bg command has too many arguments, or names a job that doesn't exist.
+ */
+#define SHELL_ERR_CMD_JOB_USAGE "fg/bg: Usage: fg [%N], bg [%N] (N is a job number, as listed by jobs, the last job by default)"
+
+/*
+ * @brief Job table error message.
+ * @note Used to indicate that a stopped job couldn't be kept, as there are already SHELL_MAX_JOBS jobs.
+ */
+#define SHELL_ERR_JOB_TABLE_FULL "Shell internal error: too many jobs, the stopped job was resumed in the background"
+
+/*
+ * @brief Test syntax error messages.
+ * @note Used to indicate that a test command is missing its closing bracket, has an unknown or incomplete
+ * 		 expression, or compares something that isn't an integer with an integer operator.
+ */
+#define SHELL_ERR_CMD_TEST_BRACKET "test: missing closing bracket"
+#define SHELL_ERR_CMD_TEST_SYNTAX "test: syntax error"
+#define SHELL_ERR_CMD_TEST_INTEGER "test: integer expression expected"
+
+/*
+ * @brief Printf error messages.
+ * @note Used to indicate that printf was run without a format, or was given an argument that isn't a number
+ * 		 for a numeric conversion (it's printed as 0).
+ */
+#define SHELL_ERR_CMD_PRINTF_USAGE "printf: Usage: printf FORMAT [ARGUMENT...]"
+#define SHELL_ERR_CMD_PRINTF_NUMBER "printf: invalid number"
+
+/*
+ * @brief Function definition delimited by end-of-file error message.
+ * @note Used to indicate that the input ended before the closing "}" of a function definition.
+ */
+#define SHELL_ERR_FUNCTION_EOF "Shell internal error: function definition delimited by end-of-file"
+
+/*
+ * @brief Nested function definition error message.
+ * @note Used to indicate that a function body contains another function definition.
+ */
+#define SHELL_ERR_FUNCTION_NESTED "Shell internal error: function definitions can't be nested"
+
+/*
+ * @brief Function call depth error message.
+ * @note Used to indicate that a function call would exceed SHELL_MAX_FUNCTION_DEPTH (e.g. endless recursion).
+ */
+#define SHELL_ERR_FUNCTION_DEPTH "Shell internal error: maximum function call depth exceeded"
+
+/*
+ * @brief If nesting depth error message.
+ * @note Used to indicate that an if block would exceed SHELL_MAX_IF_DEPTH nested blocks.
+ */
+#define SHELL_ERR_IF_DEPTH "Shell internal error: maximum if nesting depth exceeded"
+
+/*
+ * @brief Arithmetic syntax error message.
+ * @note Used to indicate that an arithmetic expansion ("$((...))") isn't a valid expression.
+ */
+#define SHELL_ERR_ARITH_SYNTAX "Arithmetic expansion: syntax error"
+
+/*
+ * @brief Arithmetic division by zero error message.
+ * @note Used to indicate that an arithmetic expansion divided by zero (with "/" or "%").
+ */
+#define SHELL_ERR_ARITH_DIV_ZERO "Arithmetic expansion: division by zero"
+
+/*
+ * @brief Arithmetic value error message.
+ * @note Used to indicate that a variable referenced by an arithmetic expansion isn't an integer.
+ */
+#define SHELL_ERR_ARITH_VALUE "Arithmetic expansion: value is not an integer"
+
 
 /****************/
 /* Enumerations */
@@ -263,10 +486,16 @@ typedef enum _State {
 
 /*
  * @brief Maximum command length.
- * @note Commands longer than this will be truncated.
- * @note The default value is 1024 characters.
+ * @note Commands longer than this are rejected.
+ * @note The default value is 16384 characters, enough for a 1000-stage pipeline.
  */
-#define SHELL_MAX_COMMAND_LENGTH 1024
+#define SHELL_MAX_COMMAND_LENGTH 16384
+
+/*
+ * @brief The size of the line editor's input buffer.
+ * @note Input is read in chunks of up to this size, so a large paste or a piped script takes only a few reads.
+ */
+#define SHELL_INPUT_BUFFER_SIZE 65536
 
 /*
  * @brief Maximum path length.
@@ -275,9 +504,60 @@ typedef enum _State {
  */
 #define SHELL_MAX_PATH_LENGTH 512
 
+/*
+ * @brief Maximum depth of nested function calls.
+ * @note Each call lives on the C stack of the shell, so endless recursion stops here instead of crashing it.
+ */
+#define SHELL_MAX_FUNCTION_DEPTH 256
+
+/*
+ * @brief Maximum depth of nested if blocks.
+ * @note Each open block takes an entry of the shell context's if stack.
+ */
+#define SHELL_MAX_IF_DEPTH 64
+
+/*
+ * @brief Maximum number of jobs that are stopped or were resumed in the background (with bg).
+ */
+#define SHELL_MAX_JOBS 64
+
+/*
+ * @brief The lowest file descriptor used by the shell for files it opens on behalf of a redirection.
+ * @note Redirections only target the descriptors 0-9, so the shell's own descriptors never collide with them.
+ */
+#define SHELL_REDIRECT_FD_BASE 10
+
+/*
+ * @brief The exit status of a pipeline stage whose command couldn't be executed.
+ * @note Same as the status other shells use for a command that wasn't found.
+ */
+#define SHELL_EXIT_EXEC_FAILURE 127
+
+/*
+ * @brief The exit status of a command that was stopped by the timeout command.
+ * @note Same as the status of the timeout utility of coreutils.
+ */
+#define SHELL_EXIT_TIMEOUT 124
+
+/*
+ * @brief The default time a command gets to exit after SIGTERM, before the timeout command sends it SIGKILL.
+ */
+#define SHELL_TIMEOUT_KILL_AFTER_MS 2000
+
 /*
  * @brief The default prompt for the shell.
  */
 #define SHELL_DEFAULT_PROMPT "hello:"
 
+/*
+ * @brief The secondary prompt, printed while reading a here-document body.
+ */
+#define SHELL_HEREDOC_PROMPT "> "
+
+/*
+ * @brief The environment variable that enables the tracer when the shell starts.
+ * @note Its value is the path of the trace file (e.g. MYSHELL_TRACE=trace.json ./myshell).
+ */
+#define SHELL_TRACE_ENV "MYSHELL_TRACE"
+
 #endif /* _SHELL_DEF_H */
\ No newline at end of file
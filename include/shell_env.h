@@ -0,0 +1,109 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Environment Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_ENV_H
+#define _SHELL_ENV_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include "shell_context.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*******************/
+/* Structs Section */
+/*******************/
+
+/*
+ * @brief The environment passed to the commands the shell executes.
+ * @param base The variables the shell inherited ("NAME=VALUE"), except the ones that were exported or unset since.
+ * @param num_base The number of inherited variables.
+ * @param envp The cached environment: the inherited variables, followed by the exported shell variables.
+ * @param num_owned The number of entries at the end of envp that were built from the exported shell variables.
+ * @param dirty True if an exported variable changed since envp was built.
+ */
+typedef struct ShellEnv {
+	char **base;
+	size_t num_base;
+	char **envp;
+	size_t num_owned;
+	bool dirty;
+} ShellEnv, *PShellEnv;
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Copy the environment the shell was started with.
+ * @param ctx The shell context.
+ * @return Success on success, Failure on allocation failure.
+ */
+Result env_init(PShellContext ctx);
+
+/*
+ * @brief Get the environment of the commands the shell executes.
+ * @param ctx The shell context.
+ * @return The NULL terminated environment, owned by the shell and valid until the next call.
+ * @note The array is cached, and only rebuilt after an exported variable was set or unset, so a launch doesn't
+ * 		 pay for the number of variables. $PATH is also applied to the shell itself, so commands are searched
+ * 		 for (and indexed) in the directories the command will see.
+ */
+char **env_get(PShellContext ctx);
+
+/*
+ * @brief Mark a shell variable as exported.
+ * @param ctx The shell context.
+ * @param name The name of the variable.
+ * @return Success if the variable was exported, Failure if the name isn't valid.
+ * @note An inherited variable that isn't a shell variable yet becomes one, so the shell can change it.
+ */
+Result env_export(PShellContext ctx, const char *name);
+
+/*
+ * @brief Remove an inherited variable from the environment.
+ * @param ctx The shell context.
+ * @param name The name of the variable.
+ * @note Exported shell variables are removed along with the shell variable itself.
+ */
+void env_unset(PShellContext ctx, const char *name);
+
+/*
+ * @brief Check if a string is a valid variable name (a letter or "_", followed by letters, digits or "_").
+ * @param name The string.
+ * @return True if the string is a valid name, False otherwise.
+ */
+bool env_valid_name(const char *name);
+
+/*
+ * @brief Print the environment, sorted by name, in a form that can be used to export it again.
+ * @param ctx The shell context.
+ * @param out The stream to print to.
+ */
+void env_print(PShellContext ctx, FILE *out);
+
+/*
+ * @brief Free the memory of the environment.
+ * @param ctx The shell context.
+ */
+void env_free(PShellContext ctx);
+
+#endif
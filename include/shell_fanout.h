@@ -0,0 +1,41 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Fan-out Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_FANOUT_H
+#define _SHELL_FANOUT_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Copy everything read from a pipe to several pipes, without copying it through user space.
+ * @param in_fd The read end of the producer's pipe.
+ * @param out_fds The write ends of the consumers' pipes.
+ * @param num_outs The number of consumers.
+ * @note Runs in a child process of the shell and never returns. A consumer that exits early is dropped,
+ * 		 the others keep receiving the stream. The relay moves at the pace of the slowest consumer.
+ */
+void run_fanout_relay(int in_fd, const int *out_fds, int num_outs);
+
+#endif
@@ -0,0 +1,139 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Functions Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_FUNCTION_H
+#define _SHELL_FUNCTION_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include "shell_context.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+/*******************/
+/* Structs Section */
+/*******************/
+
+/*
+ * @brief A shell function.
+ * @param name The name of the function, the key of the function table (so it's the first member).
+ * @param lines The lines of the body, as they were defined.
+ * @param tokens The lines of the body, already tokenized (each one is NULL terminated).
+ * @param heredocs The bodies of the here-documents of each line, read when the function was defined (NULL if none).
+ * @param num_lines The number of lines of the body.
+ * @param refs The number of calls of the function that are running, plus one while it's defined.
+ */
+typedef struct ShellFunction {
+	char *name;
+	char **lines;
+	char ***tokens;
+	char ***heredocs;
+	int num_lines;
+	int refs;
+} ShellFunction, *PShellFunction;
+
+/*
+ * @brief A call frame, one for each running function call.
+ * @param function The called function.
+ * @param args The arguments of the call, the first one is the name of the function.
+ * @param argc The number of arguments, including the name.
+ * @param depth The number of frames on the stack, including this one.
+ * @param returning True once the return command was executed, the rest of the body is skipped.
+ * @param prev The frame of the caller, or NULL if it's called from the top level.
+ */
+typedef struct ShellFrame {
+	PShellFunction function;
+	char **args;
+	int argc;
+	int depth;
+	bool returning;
+	struct ShellFrame *prev;
+} ShellFrame, *PShellFrame;
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Check if a command line starts a function definition ("name() {").
+ * @param command The command line.
+ * @return True if the command line is a function definition, False otherwise.
+ */
+bool function_is_definition(const char *command);
+
+/*
+ * @brief Define a function from its definition, or replace its body.
+ * @param ctx The shell context.
+ * @param command The first line of the definition ("name() {", or a whole "name() { body }").
+ * @return Success if the function was defined, Failure otherwise.
+ * @note Unless the whole body is on the first line, the body is read from the input until a line with a
+ * 		 single "}". Each line of the body is tokenized once, here.
+ */
+Result function_define(PShellContext ctx, const char *command);
+
+/*
+ * @brief Find a function.
+ * @param ctx The shell context.
+ * @param name The name of the function.
+ * @return The function, or NULL if there is no such function. Costs a single check when no functions are defined.
+ */
+PShellFunction function_lookup(PShellContext ctx, const char *name);
+
+/*
+ * @brief Remove a function.
+ * @param ctx The shell context.
+ * @param name The name of the function.
+ * @return Success if the function was removed, Failure if there is no such function.
+ * @note A function that is running is freed when its last call returns.
+ */
+Result function_unset(PShellContext ctx, const char *name);
+
+/*
+ * @brief Drop a reference to a function, and free it if it was the last one.
+ * @param function The function.
+ */
+void function_release(PShellFunction function);
+
+/*
+ * @brief Copy the tokens of a line of a function's body, so they can be expanded.
+ * @param function The function.
+ * @param line The index of the line.
+ * @return A newly allocated, NULL terminated array of arguments, or NULL on allocation failure.
+ */
+char **function_copy_line(PShellFunction function, int line);
+
+/*
+ * @brief Expand a positional parameter of the running function call ($0..$N, $# or $@).
+ * @param ctx The shell context.
+ * @param argv A pointer to the array of arguments. It's reallocated if "$@" changes the number of words.
+ * @param index The index of the argument to expand.
+ * @return The number of words the argument was replaced with, or -1 if it's not a positional parameter.
+ * @note "$@" is replaced with one word for each argument of the call (none if there are none). A parameter
+ * 		 past the last argument expands to nothing.
+ */
+int function_expand_positional(PShellContext ctx, char ***argv, int index);
+
+/*
+ * @brief Remove all the functions and free their memory.
+ * @param ctx The shell context.
+ */
+void function_free(PShellContext ctx);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Globbing Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_GLOB_H
+#define _SHELL_GLOB_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/***********************/
+/* Definitions Section */
+/***********************/
+
+/*
+ * @brief The character the tokenizer puts before a quoted pattern character, so it's matched literally.
+ * @note It's removed from every argument by glob_expand(), whether the argument is a pattern or not.
+ */
+#define GLOB_ESCAPE '\\'
+
+/*
+ * @brief Check if a character is a pattern character ("*", "?" or "[").
+ */
+#define GLOB_IS_SPECIAL(c) ((c) == '*' || (c) == '?' || (c) == '[')
+
+/*
+ * @brief The maximum number of operations of a compiled pattern (a pattern is a single path component).
+ */
+#define GLOB_MAX_OPS 256
+
+/*
+ * @brief The maximum number of character classes ("[...]") of a compiled pattern.
+ */
+#define GLOB_MAX_CLASSES 32
+
+/*
+ * @brief The maximum number of threads of a recursive ("**") walk.
+ */
+#define GLOB_MAX_THREADS 64
+
+/*
+ * @brief The maximum number of directory names that a recursive walk skips ("set glob ignore").
+ */
+#define GLOB_MAX_IGNORED 32
+
+/*******************/
+/* Structs Section */
+/*******************/
+
+/*
+ * @brief The type of an operation of a compiled pattern.
+ */
+typedef enum _GlobOpType {
+	GLOB_OP_CHAR = 0,
+	GLOB_OP_ANY,
+	GLOB_OP_STAR,
+	GLOB_OP_CLASS
+} GlobOpType;
+
+/*
+ * @brief An operation of a compiled pattern.
+ * @param type The type of the operation.
+ * @param ch The character of a GLOB_OP_CHAR operation.
+ * @param class The index of the character class of a GLOB_OP_CLASS operation.
+ */
+typedef struct GlobOp {
+	uint8_t type;
+	uint8_t ch;
+	uint16_t class;
+} GlobOp, *PGlobOp;
+
+/*
+ * @brief A compiled pattern, matched against a single file name.
+ * @param ops The operations, one for each character, "?", "*" or "[...]" of the pattern.
+ * @param num_ops The number of operations.
+ * @param classes The character classes, as bitmaps of the 256 byte values.
+ * @param num_classes The number of character classes.
+ * @param min_len The minimum length of a matching name (the number of operations that aren't "*").
+ * @param prefix_len The number of literal characters the pattern starts with.
+ * @param suffix_len The number of literal characters after the last "*", if they are all literal (0 otherwise).
+ * @param has_star True if the pattern has a "*", otherwise a matching name is exactly min_len long.
+ * @param hidden True if the pattern matches names that start with a "." (it starts with a literal ".").
+ * @param prefix The literal characters the pattern starts with, for a quick rejection with memcmp(3).
+ * @param suffix The literal characters after the last "*", for a quick rejection with memcmp(3).
+ */
+typedef struct GlobPattern {
+	GlobOp ops[GLOB_MAX_OPS];
+	int num_ops;
+	uint64_t classes[GLOB_MAX_CLASSES][4];
+	int num_classes;
+	size_t min_len;
+	size_t prefix_len;
+	size_t suffix_len;
+	bool has_star;
+	bool hidden;
+	char prefix[GLOB_MAX_OPS];
+	char suffix[GLOB_MAX_OPS];
+} GlobPattern, *PGlobPattern;
+
+/*
+ * @brief The options of the recursive ("**") walks, set with "set glob OPTION VALUE".
+ * @param threads The number of directory walkers, 0 for one for each online CPU.
+ * @param hidden True if the walks enter hidden directories (they are skipped by default).
+ * @param ignored The names of the directories the walks skip (e.g. ".git", "node_modules").
+ * @param num_ignored The number of ignored directory names.
+ */
+typedef struct GlobOptions {
+	int threads;
+	bool hidden;
+	char *ignored[GLOB_MAX_IGNORED];
+	int num_ignored;
+} GlobOptions, *PGlobOptions;
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Compile a single path component pattern.
+ * @param pattern The compiled pattern.
+ * @param str The pattern, with escaped (quoted) characters.
+ * @param len The length of the pattern.
+ * @return Success on success, Failure if the pattern is too long (or has too many classes).
+ * @note A "[" without a closing "]" is a literal "[".
+ */
+Result glob_compile(PGlobPattern pattern, const char *str, size_t len);
+
+/*
+ * @brief Match a file name against a compiled pattern.
+ * @param pattern The compiled pattern.
+ * @param name The file name.
+ * @param len The length of the file name.
+ * @return True if the name matches, False otherwise.
+ */
+bool glob_match(const GlobPattern *pattern, const char *name, size_t len);
+
+/*
+ * @brief Expand the patterns of a command's arguments into the sorted paths they match.
+ * @param argv A pointer to the array of arguments. It's reallocated if a pattern matches several paths.
+ * @note A pattern that matches nothing is left as is. Quoted pattern characters (escaped by the tokenizer) are
+ * 		 matched literally, and the escapes are removed from every argument. The word of a redirection, the value
+ * 		 of an assignment and process substitutions are never expanded. The words of a "[[ ... ]]" test are left
+ * 		 as they are, escapes included, as the test matches them as patterns itself.
+ * @note Directories are read with getdents64(2) in large batches, and each entry is matched against a pattern
+ * 		 that was compiled once, so a directory with millions of entries is expanded in a single pass.
+ * @note A "**" component matches any number of directories (including none). The tree is walked by a pool of
+ * 		 threads that steal directories from each other, each directory opened with openat(2) relative to its
+ * 		 parent. Symbolic links, and hidden and ignored directories, aren't entered.
+ */
+void glob_expand(char ***argv);
+
+/*
+ * @brief Remove the escapes of the quoted pattern characters of a string, in place.
+ * @param str The string.
+ * @return The string.
+ * @note Used for the words glob_expand() leaves escaped, the ones of a "[[ ... ]]" test.
+ */
+char *glob_unescape(char *str);
+
+/*
+ * @brief Set an option of the recursive walks.
+ * @param name The name of the option: "threads" (a number, 0 for the number of CPUs), "hidden" ("on" or "off"),
+ * 		 or "ignore" (a ":" separated list of directory names, or "off").
+ * @param value The value of the option.
+ * @return Success if the option was set, Failure if the name or the value isn't valid.
+ */
+Result glob_set_option(const char *name, const char *value);
+
+/*
+ * @brief Free the memory of the options.
+ */
+void glob_free_options();
+
+#endif
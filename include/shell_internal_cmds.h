@@ -26,38 +26,29 @@
 #include "Command.h"
 #include "Variables.h"
 #include "LinkedList.h"
+#include "shell_context.h"
 #include <stdbool.h>
 
-/********************/
-/* External Section */
-/********************/
-extern char *homedir;
-extern char *cwd;
-extern char *workingdir;
-extern char *curr_prompt;
-
-extern PLinkedList commandHistory;
-extern PLinkedList variableList;
-
-
 /*********************/
 /* Functions Section */
 /*********************/
 
 /*
  * @brief Execute change directory command.
+ * @param ctx The shell context.
  * @param path The path to change to.
  * @param argc The number of arguments.
  * @return Success if the command succeeded, Failure otherwise.
  * @note number of arguments must be 2.
  */
-Result cmdCD(char *path, int argc);
+Result cmdCD(PShellContext ctx, char *path, int argc);
 
 /*
  * @brief Execute print working directory command.
+ * @param ctx The shell context.
  * @return Success always.
  */
-Result cmdPWD();
+Result cmdPWD(PShellContext ctx);
 
 /*
  * @brief Execute clear command.
@@ -67,38 +58,162 @@ Result cmdClear();
 
 /*
  * @brief Execute change prompt command.
+ * @param ctx The shell context.
  * @param new_prompt The new prompt.
  * @return Success if the command succeeded, Failure otherwise.
  */
-Result cmdChangePrompt(char *new_prompt);
+Result cmdChangePrompt(PShellContext ctx, char *new_prompt);
 
 /*
  * @brief Execute last command.
+ * @param ctx The shell context.
  * @return Success if the command succeeded, Failure otherwise.
  */
-Result cmdrepeatLastCommand();
+Result cmdrepeatLastCommand(PShellContext ctx);
 
 
 /*
  * @brief Execute set variable command.
+ * @param ctx The shell context.
  * @param name The name of the variable.
  * @param value The value of the variable.
  * @return Success if the command succeeded, Failure otherwise.
  */
-Result setVariable(char *name, char *value);
+Result setVariable(PShellContext ctx, char *name, char *value);
+
+/*
+ * @brief Remove a variable.
+ * @param ctx The shell context.
+ * @param name The name of the variable.
+ * @return Success if the variable was removed, Failure if there is no such variable.
+ */
+Result unsetVariable(PShellContext ctx, char *name);
 
 /*
  * @brief Execute read variable command.
+ * @param ctx The shell context.
  * @param variableName The name of the variable.
  * @return Success if the command succeeded, Failure otherwise.
  */
-Result cmdRead(char *variableName);
+Result cmdRead(PShellContext ctx, char *variableName);
 
 /*
  * @brief Execute history command.
- * @param argc The number of arguments.
+ * @param ctx The shell context.
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @return Success if the command succeeded, Failure otherwise.
+ * @note -t shows when each command started, its duration and its process IDs,
+ * 		 --slowest N shows the same for the N slowest commands, the slowest first, with their number in the history.
+ */
+Result cmdHistory(PShellContext ctx, char **args);
+
+/*
+ * @brief Execute statistics command.
+ * @param args The arguments of the command (after its name), NULL terminated.
  * @return Success if the command succeeded, Failure otherwise.
+ * @note -j (--json) prints a single JSON object, -r (--reset) resets the counters without printing them.
+ */
+Result cmdStats(char **args);
+
+/*
+ * @brief Execute set command.
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @return Success if the command succeeded, Failure otherwise.
+ * @note "set trace FILE" starts tracing into FILE, "set trace off" stops it.
+ * 		 "set glob OPTION VALUE" sets an option of the recursive ("**") glob walks.
+ */
+Result cmdSet(char **args);
+
+/*
+ * @brief Execute alias command.
+ * @param ctx The shell context.
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @return Success if the command succeeded, Failure otherwise.
+ * @note Each argument is either NAME=VALUE, which defines an alias, or NAME, which prints it.
+ * 		 Without arguments, all the aliases are printed.
+ */
+Result cmdAlias(PShellContext ctx, char **args);
+
+/*
+ * @brief Execute unalias command.
+ * @param ctx The shell context.
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @return Success if the command succeeded, Failure otherwise.
+ * @note -a removes all the aliases.
+ */
+Result cmdUnalias(PShellContext ctx, char **args);
+
+/*
+ * @brief Execute return command.
+ * @param ctx The shell context.
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @return The status the function returns with (the status of the last command if none is given),
+ * 		   or 1 if the command isn't run inside a function.
+ * @note The rest of the function's body is skipped.
+ */
+int cmdReturn(PShellContext ctx, char **args);
+
+/*
+ * @brief Execute export command.
+ * @param ctx The shell context.
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @return Success if the command succeeded, Failure otherwise.
+ * @note Each argument is either NAME=VALUE, which sets the variable and exports it, or NAME, which exports it.
+ * 		 Without arguments, the whole environment is printed.
+ */
+Result cmdExport(PShellContext ctx, char **args);
+
+/*
+ * @brief Execute unset command.
+ * @param ctx The shell context.
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @return Success if the command succeeded, Failure otherwise.
+ * @note Removes variables (and their environment entries), or functions with -f.
+ */
+Result cmdUnset(PShellContext ctx, char **args);
+
+/*
+ * @brief Execute test command ("test", "[" or "[[").
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @param name The name the command was called with, "[" and "[[" need their closing bracket as the last argument.
+ * @return 0 if the expression is true, 1 if it's false, 2 if it isn't valid.
+ */
+int cmdTest(char **args, const char *name);
+
+/*
+ * @brief Execute echo command.
+ * @param args The arguments of the command (after its name), NULL terminated.
+ * @return Success always.
+ * @note The arguments are printed separated by spaces and followed by a newline. The options are "-n" (no newline),
+ * 		 "-e" (interpret backslash escapes, "\c" stops the output) and "-E" (don't interpret them, the default).
+ */
+Result cmdEcho(char **args);
+
+/*
+ * @brief Execute printf command.
+ * @param args The arguments of the command (after its name), the first one is the format, NULL terminated.
+ * @return Success if the command succeeded, Failure if there is no format or a numeric argument isn't valid.
+ * @note The format supports backslash escapes and the %s, %b, %c, %d, %i, %u, %o, %x, %X, %f, %e, %g and %%
+ * 		 conversions, with flags, width and precision. It's reused until all the arguments are consumed, and
+ * 		 missing arguments are printed as an empty string or 0.
+ */
+Result cmdPrintf(char **args);
+
+/*
+ * @brief Check if a command is a utility command (echo, printf, true, false or :).
+ * @param name The name of the command.
+ * @return True if the command is a utility command, False otherwise.
+ * @note Utility commands don't touch the shell's state, so they can also run as a pipeline stage, or with
+ * 		 their standard descriptors redirected, without an exec.
+ */
+bool is_utility(const char *name);
+
+/*
+ * @brief Execute a utility command.
+ * @param argv The arguments of the command, the first one is its name, NULL terminated.
+ * @return The exit status of the command.
+ * @note The output is written to the buffered standard output, the caller flushes it.
  */
-Result cmdHistory(int argc);
+int cmdUtility(char **argv);
 
 #endif /* _SHELL_CD_H */
\ No newline at end of file
@@ -0,0 +1,154 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Job Control Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_JOB_H
+#define _SHELL_JOB_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Enable job control, if the standard input of the shell is a terminal.
+ * @return Success if job control is enabled (or isn't needed), Failure if the shell couldn't take the terminal.
+ * @note The shell waits until it's in the foreground, moves into its own process group and takes the terminal.
+ * 		 It ignores SIGTTIN and SIGTTOU from then on, so it can hand the terminal to its jobs and take it back.
+ */
+Result job_control_init();
+
+/*
+ * @brief Check if job control is enabled.
+ * @return True if pipelines run as jobs in their own process groups, False otherwise.
+ */
+bool job_control_enabled();
+
+/*
+ * @brief Prepare a forked child of the shell that runs a command of a job (a pipeline stage or a fan-out relay).
+ * @param pgid The process group of the job, 0 if the child is the first process of the job (it leads the group).
+ * @param foreground True if the job runs in the foreground, so it gets the terminal.
+ * @param isolate True to put the job into its own process group even without job control, so it can be signaled
+ * 		 as a whole (a job under a timeout).
+ * @note Both the child and the shell put the child into the group, so it's there whichever of them runs first.
+ */
+void job_child_init(pid_t pgid, bool foreground, bool isolate);
+
+/*
+ * @brief Reset the signals of a forked child of the shell to their defaults.
+ * @note The child is never a job control shell itself, even when it runs the shell's code (e.g. a subshell), so it
+ * 		 also forgets the shell's jobs.
+ */
+void job_reset_signals();
+
+/*
+ * @brief Add a forked process to a job, in the shell.
+ * @param pid The process ID of the process.
+ * @param pgid The process group of the job, 0 if the process is the first one of the job.
+ * @param foreground True if the job runs in the foreground.
+ * @param isolate True to put the job into its own process group even without job control.
+ * @return The process group of the job, or 0 if the job stays in the shell's process group.
+ * @note The first process of a foreground job gives it the terminal (with job control).
+ */
+pid_t job_add_process(pid_t pid, pid_t pgid, bool foreground, bool isolate);
+
+/*
+ * @brief Wait for a process of a job to finish or to stop.
+ * @param pid The process ID of the process.
+ * @param status The status of the process, as returned by waitpid(2), or NULL.
+ * @return The process ID, or -1 on failure.
+ * @note A stopped process (Ctrl-Z) is only reported when job control is enabled. Interrupted waits are restarted.
+ */
+pid_t job_wait(pid_t pid, int *status);
+
+/*
+ * @brief Wait until the processes of a job exit, signaling the job once its deadline passes.
+ * @param pids The process IDs of the processes (the pipeline stages).
+ * @param count The number of processes.
+ * @param pgid The process group of the job, or 0 to signal each process by itself.
+ * @param timeout_ns The time the job gets to run, in nanoseconds.
+ * @param kill_after_ns The time the job gets to exit after SIGTERM, before SIGKILL, in nanoseconds.
+ * @return True if the job was signaled (it timed out), False if it exited in time.
+ * @note Each process is watched through a pidfd (pidfd_open(2)), and a single ppoll(2) sleeps until one of them
+ * 		 exits or the next deadline passes, so the wait never busy-waits or polls on an interval.
+ * @note The processes aren't reaped, they are all exited (and can be reaped at once) when it returns.
+ */
+bool job_wait_deadline(pid_t *pids, int count, pid_t pgid, uint64_t timeout_ns, uint64_t kill_after_ns);
+
+/*
+ * @brief Parse a duration of the timeout command.
+ * @param str The duration, a non-negative number with an optional suffix: s (seconds, the default), m (minutes),
+ * 		 h (hours) or d (days), e.g. "0.5", "10s", "2m".
+ * @param ns The duration, in nanoseconds.
+ * @return Success if the duration is valid, Failure otherwise.
+ */
+Result job_parse_duration(const char *str, uint64_t *ns);
+
+/*
+ * @brief Take the terminal back from the foreground job, and restore the shell's terminal modes.
+ */
+void job_foreground_done();
+
+/*
+ * @brief Keep a foreground job that was stopped (Ctrl-Z) in the job table, so it can be resumed.
+ * @param pgid The process group of the job.
+ * @param pids The processes of the job that weren't reaped yet, the last one is the last pipeline stage.
+ * @param count The number of processes.
+ * @param command The command line of the job.
+ * @return The number of the job, or -1 if the table is full (the job is resumed in the background then).
+ * @note Prints the job's number, as "[N] Stopped".
+ */
+int job_stop(pid_t pgid, const pid_t *pids, int count, const char *command);
+
+/*
+ * @brief Resume a job, in the foreground (fg) or in the background (bg).
+ * @param spec The job, "%N" or "N", or NULL for the last one.
+ * @param foreground True to give the job the terminal and wait for it, False to let it run in the background.
+ * @param status The status of the job, if it ran in the foreground (128 plus the signal if it was stopped again).
+ * @return Success if the job was resumed, Failure if there is no such job.
+ * @note A job that ended is removed from the table, one that was stopped again stays in it.
+ */
+Result job_resume(const char *spec, bool foreground, int *status);
+
+/*
+ * @brief Print the jobs, and remove the ones that ended since the last check.
+ * @param out The output stream.
+ */
+void job_list(FILE *out);
+
+/*
+ * @brief Release the job table when the shell exits. Stopped jobs get SIGHUP (and SIGCONT), as in other shells.
+ */
+void job_free();
+
+/*
+ * @brief Forward a signal sent to the shell to the process group of the foreground job.
+ * @param signum The signal.
+ * @return True if there is a foreground job and it got the signal, False otherwise.
+ * @note Async-signal-safe, called from the shell's signal handler.
+ */
+bool job_forward_signal(int signum);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Line Editor Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_LINEEDIT_H
+#define _SHELL_LINEEDIT_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include "LinkedList.h"
+#include <stddef.h>
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Read a line from the standard input.
+ * @param prompt The prompt to print before the line, or NULL for no prompt.
+ * @param len A pointer to store the length of the line (without the newline).
+ * @param history The command history to recall with the arrow keys, or NULL for no history.
+ * @return The line (without the newline), or NULL on end-of-file.
+ * @note The line is owned by the line editor and is valid until the next call.
+ * @note On a terminal the line is edited in raw mode: cursor movement, history recall and bracketed paste.
+ * 		 Otherwise (e.g. a piped script) the input is read in large chunks and split into lines.
+ * @attention All the shell's own reads from the standard input must go through this function,
+ * 			  since it may read ahead of the current line.
+ */
+char *read_line(const char *prompt, size_t *len, PLinkedList history);
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell PATH Index Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_PATHINDEX_H
+#define _SHELL_PATHINDEX_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include <stddef.h>
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Read all the entries of a directory, in large batches.
+ * @param fd An open file descriptor of the directory.
+ * @param callback A function called for each entry (except "." and ".."), with its name and type (DT_*).
+ * @param ctx An argument passed to the callback.
+ * @return Success on success, Failure otherwise.
+ */
+Result scan_directory(int fd, void (*callback)(const char *name, unsigned char type, void *ctx), void *ctx);
+
+/*
+ * @brief Find the full path of a command in the directories of $PATH.
+ * @param name The name of the command.
+ * @return The full path of the command (owned by the index, valid until the next call to the index),
+ * 		   or NULL if the command isn't in the index (or its name contains a '/').
+ * @note The index is built on first use, and rebuilt when $PATH changed on disk. In the shell, checking for a change is
+ * 		 a single non-blocking read of the inotify events, a forked child checks the modification times instead.
+ */
+const char *path_index_lookup(const char *name);
+
+/*
+ * @brief Find all the commands in the directories of $PATH that start with a prefix.
+ * @param prefix The prefix of the commands.
+ * @param prefix_len The length of the prefix.
+ * @param count A pointer to store the number of matching commands.
+ * @return The names of the matching commands, sorted (owned by the index, valid until the next call to the index).
+ * @note Brings the index up to date first, a directory is only rescanned if it changed.
+ */
+const char **path_index_complete(const char *prefix, size_t prefix_len, size_t *count);
+
+/*
+ * @brief Free the memory of the index.
+ */
+void path_index_free();
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Redirections Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_REDIRECT_H
+#define _SHELL_REDIRECT_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include "LinkedList.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/****************/
+/* Enumerations */
+/****************/
+
+/*
+ * @brief Redirect type enum.
+ * @note Used to indicate how a redirection is applied by the child.
+ */
+typedef enum _RedirectType
+{
+	/*
+	 * @brief The source is a file (or a here-document) opened by the shell.
+	*/
+	REDIRECT_FILE = 0,
+
+	/*
+	 * @brief The source is another file descriptor of the child (N>&M).
+	*/
+	REDIRECT_DUP,
+
+	/*
+	 * @brief The file descriptor is closed (N>&-).
+	*/
+	REDIRECT_CLOSE
+} RedirectType;
+
+/*******************/
+/* Structs Section */
+/*******************/
+
+/*
+ * @brief A single resolved redirection.
+ * @param type The type of the redirection.
+ * @param fd The file descriptor of the child that is redirected.
+ * @param source The file descriptor the child's descriptor becomes a copy of.
+ */
+typedef struct Redirect {
+    RedirectType type;
+    int fd;
+    int source;
+} Redirect, *PRedirect;
+
+/*
+ * @brief The resolved redirections of a single pipeline stage.
+ * @param redirects The redirections, at most one per child file descriptor.
+ * @param count The number of redirections.
+ * @param fds The file descriptors opened by the shell for the stage.
+ * @param num_fds The number of file descriptors opened by the shell.
+ * @note The shell's file descriptors are close-on-exec and are never lower than SHELL_REDIRECT_FD_BASE.
+ */
+typedef struct RedirectList {
+    PRedirect redirects;
+    int count;
+    int *fds;
+    int num_fds;
+} RedirectList, *PRedirectList;
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Check if an argument is a redirection operator (e.g. "<", "2>", "2>&1", "&>", "<<EOF").
+ * @param arg The argument to check.
+ * @return True if the argument is a redirection operator, False otherwise.
+ */
+bool is_redirect(const char *arg);
+
+/*
+ * @brief Check if an argument is a redirection operator whose word is the next argument (e.g. ">", but not "2>&1").
+ * @param arg The argument to check.
+ * @return True if the next argument is the word of the redirection, False otherwise.
+ */
+bool redirect_word_follows(const char *arg);
+
+/*
+ * @brief Read the body of a here-document from the standard input.
+ * @param delimiter The line that terminates the body.
+ * @param strip_tabs True to strip leading tabs from every line (the "<<-" form), False otherwise.
+ * @param len The length of the returned body.
+ * @return A newly allocated body, or NULL on allocation failure.
+ * @note The returned pointer must be freed by the caller.
+ */
+char *read_heredoc_body(const char *delimiter, bool strip_tabs, size_t *len);
+
+/*
+ * @brief Read the bodies of the here-documents of a command that runs later (e.g. a line of a function's body).
+ * @param argv The arguments of the command, NULL terminated.
+ * @param bodies The bodies, in the order of their operators (NULL terminated), or NULL if there are none.
+ * @return Success if the bodies were read, Failure otherwise.
+ * @note The bodies are read from the input that follows the command, as when it runs. Their expansion is left to
+ * 		 the command, see heredoc_preset(). The returned array must be freed by the caller (see freeUpMem()).
+ */
+Result read_heredoc_bodies(char **argv, char ***bodies);
+
+/*
+ * @brief Give the next here-documents the bodies that were read ahead of time, instead of reading them from the input.
+ * @param bodies The bodies, from read_heredoc_bodies(), or NULL to read the bodies from the input again.
+ * @note The bodies are borrowed, each here-document takes a copy of the next one.
+ */
+void heredoc_preset(char *const *bodies);
+
+/*
+ * @brief Create a readable file descriptor that holds a here-document body.
+ * @param body The body of the here-document.
+ * @param len The length of the body.
+ * @return The file descriptor, positioned at the start of the body, or -1 on failure.
+ * @note The body lives in an anonymous memory file (memfd_create(2)), so nothing is written to the filesystem.
+ * @note If memfd_create(2) is not available, a pipe is used instead, as long as the body fits into the pipe buffer.
+ * @note The file descriptor is close-on-exec, only its dup2(2) copy survives the exec.
+ */
+int create_heredoc_fd(const char *body, size_t len);
+
+/*
+ * @brief Move a file descriptor of the shell above the redirectable range (0-9).
+ * @param fd The file descriptor, which is closed if it was moved.
+ * @return The new close-on-exec file descriptor (at least SHELL_REDIRECT_FD_BASE), or -1 on failure.
+ * @note A descriptor the shell hands to a command by its number (e.g. "/dev/fd/N") can't be overwritten by an
+ * 		 explicit redirection of the same command (e.g. "3> file") this way.
+ */
+int move_fd_high(int fd);
+
+/*
+ * @brief Resolve all the redirections of a command, once, in the shell itself.
+ * @param argv The array of arguments. The redirection operators and their words are removed from it.
+ * @param stage_redirects An array of num_stages redirection lists to fill, one per pipeline stage.
+ * @param num_stages The number of pipeline stages of the command.
+ * @param variableList The list of variables, used to expand here-documents.
+ * @return Success if all redirections were resolved, Failure otherwise.
+ * @note Files are opened and here-documents are read here, so errors are reported before anything is forked.
+ * @note Redirections of the same file descriptor override each other, and a duplication (N>&M) is resolved
+ * 		 against the redirections before it, so each stage ends up with at most one redirection per descriptor.
+ * @note On failure, all the lists are released.
+ */
+Result resolve_redirects(char **argv, PRedirectList stage_redirects, int num_stages, PLinkedList variableList);
+
+/*
+ * @brief Apply the redirections of a pipeline stage.
+ * @param redirects The redirection list of the stage.
+ * @return Success if all redirections were applied, Failure otherwise.
+ * @note Must be called by the stage child, after its pipe ends were set up.
+ * @note Uses a single dup2(2) or close(2) per redirected descriptor, plus one fcntl(2) per descriptor that is
+ * 		 both duplicated and overridden (e.g. 3>&1 1>&2 2>&3).
+ */
+Result apply_redirects(PRedirectList redirects);
+
+/*
+ * @brief Check if the redirections of a command can be applied to the shell itself, for a builtin.
+ * @param redirects The redirection list of the command.
+ * @return True if only the standard descriptors are redirected, and only to each other or to the shell's files.
+ */
+bool redirects_in_shell_supported(PRedirectList redirects);
+
+/*
+ * @brief Apply the redirections of a builtin that runs in the shell itself.
+ * @param redirects The redirection list of the builtin.
+ * @param saved An array of 3 descriptors, filled with copies of the standard descriptors (-1 for a closed one).
+ * @return Success if all redirections were applied, Failure otherwise (the descriptors are already restored).
+ * @note The buffered output of the shell is flushed first, so it's written where it belongs.
+ */
+Result apply_redirects_in_shell(PRedirectList redirects, int *saved);
+
+/*
+ * @brief Flush the output of a builtin that ran with apply_redirects_in_shell(), and restore the standard descriptors.
+ * @param redirects The redirection list of the builtin.
+ * @param saved The copies of the standard descriptors, closed here.
+ */
+void restore_redirects_in_shell(PRedirectList redirects, int *saved);
+
+/*
+ * @brief Close the shell's file descriptors and release the redirection lists of a command.
+ * @param stage_redirects The array of redirection lists.
+ * @param num_stages The number of pipeline stages of the command.
+ */
+void close_redirects(PRedirectList stage_redirects, int num_stages);
+
+#endif /* _SHELL_REDIRECT_H */
@@ -0,0 +1,139 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Statistics Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_STATS_H
+#define _SHELL_STATS_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+/***********************/
+/* Definitions Section */
+/***********************/
+
+/*
+ * @brief The number of buckets of each command latency histogram.
+ * @note Bucket i counts the runs that took less than 2^(i+1) microseconds (and at least 2^i, except bucket 0).
+ * 		 The last bucket also counts everything slower.
+ */
+#define STATS_LATENCY_BUCKETS 32
+
+/*
+ * @brief The counters of the shell process.
+ * @note Plain per-process counters, a forked child bumps its own copy.
+ */
+typedef struct ShellStats {
+	// Processes forked by the shell (pipeline stages, fan-out relays and substitutions).
+	uint64_t forks;
+
+	// Pipeline stages started that exec a command (a utility builtin stage runs in its forked child without one).
+	uint64_t execs;
+
+	// Pipeline stages whose command couldn't be executed (exit status SHELL_EXIT_EXEC_FAILURE).
+	uint64_t exec_failures;
+
+	// Pipes created by the shell.
+	uint64_t pipes;
+
+	// Bytes of command lines passed through the tokenizer.
+	uint64_t bytes_tokenized;
+
+	// Variable lookups, and how many of them found the variable.
+	uint64_t var_lookups;
+	uint64_t var_hits;
+
+	// Command lines of if branches that aren't taken, skipped without being tokenized.
+	uint64_t skipped_lines;
+
+	// Heap allocations made by the tokenizer, the expansions, the history and the variables.
+	uint64_t allocations;
+
+	// Time spent tokenizing and expanding commands, waiting for foreground commands, and running builtins.
+	uint64_t parse_ns;
+	uint64_t wait_ns;
+	uint64_t builtin_ns;
+} ShellStats, *PShellStats;
+
+/*
+ * @brief The counters of the shell process.
+ */
+extern ShellStats shell_stats;
+
+/*
+ * @brief Increment a counter of the shell process.
+ * @param counter The name of the counter (a field of ShellStats).
+ */
+#define STATS_INC(counter) (++shell_stats.counter)
+
+/*
+ * @brief Add to a counter of the shell process.
+ * @param counter The name of the counter (a field of ShellStats).
+ * @param n The amount to add.
+ */
+#define STATS_ADD(counter, n) (shell_stats.counter += (uint64_t)(n))
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Get the current time, for the timing counters.
+ * @return The time in nanoseconds, from a monotonic clock.
+ * @note clock_gettime(2) with a monotonic clock is served by the vDSO, it doesn't enter the kernel.
+ */
+static inline uint64_t stats_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * @brief Record a run of a command in its latency histogram.
+ * @param name The name of the command.
+ * @param elapsed_ns The time the command took, in nanoseconds.
+ */
+void stats_record_latency(const char *name, uint64_t elapsed_ns);
+
+/*
+ * @brief Reset all the counters and the latency histograms.
+ */
+void stats_reset();
+
+/*
+ * @brief Print the counters and the latency histograms.
+ * @param out The stream to print to.
+ * @param json Print a single JSON object instead of tables.
+ * @note Commands are sorted by their total time, the slowest first.
+ */
+void stats_print(FILE *out, bool json);
+
+/*
+ * @brief Free the memory of the latency histograms.
+ */
+void stats_free();
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Substitutions Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_SUBST_H
+#define _SHELL_SUBST_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include "shell_context.h"
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*******************/
+/* Structs Section */
+/*******************/
+
+/*
+ * @brief The process substitutions of a command.
+ * @param pids The process IDs of the substitution children.
+ * @param fds The shell's end of each substitution pipe, passed to the command as "/dev/fd/N".
+ * @param stages The pipeline stage that uses each file descriptor.
+ * @param count The number of process substitutions.
+ * @note The file descriptors are close-on-exec, only the stage that uses them inherits them.
+ */
+typedef struct ProcSubst {
+    pid_t *pids;
+    int *fds;
+    int *stages;
+    int count;
+} ProcSubst, *PProcSubst;
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Check if an argument is a process substitution ("<(cmd)" or ">(cmd)").
+ * @param arg The argument to check.
+ * @return True if the argument is a process substitution, False otherwise.
+ */
+bool is_process_substitution(const char *arg);
+
+/*
+ * @brief Start all the process substitutions of a command.
+ * @param ctx The shell context.
+ * @param argv The array of arguments. Each substitution is replaced with its "/dev/fd/N" path.
+ * @param subst The process substitutions struct to fill.
+ * @param pgid The process group of the job, 0 if there is none yet (updated when the first substitution leads it).
+ * @param foreground True if the job runs in the foreground.
+ * @param isolate True to put the job into its own process group even without job control (a job under a timeout).
+ * @return Success if all substitutions were started, Failure otherwise.
+ * @note Each substitution runs concurrently in a subshell, connected to the command with a pipe.
+ * @note The substitutions are processes of the command's job, so they get its signals (e.g. Ctrl-C, Ctrl-Z, fg).
+ * @note On failure, the substitutions that were already started are closed and reaped.
+ */
+Result start_process_substitutions(PShellContext ctx, char **argv, PProcSubst subst, pid_t *pgid, bool foreground, bool isolate);
+
+/*
+ * @brief Let a pipeline stage inherit its process substitution file descriptors.
+ * @param subst The process substitutions struct.
+ * @param stage The pipeline stage.
+ * @note Must be called by the stage child, right before the exec.
+ */
+void inherit_process_substitutions(PProcSubst subst, int stage);
+
+/*
+ * @brief Close the shell's end of all the process substitutions.
+ * @param subst The process substitutions struct.
+ * @note Must be called after all pipeline stages were forked, so the substitutions see EOF/EPIPE.
+ */
+void close_process_substitutions(PProcSubst subst);
+
+/*
+ * @brief Reap all the process substitution children and release the struct.
+ * @param subst The process substitutions struct.
+ * @param block True to wait for the children, False to only collect the ones that already exited.
+ */
+void reap_process_substitutions(PProcSubst subst, bool block);
+
+/*
+ * @brief Find the closing parenthesis of a substitution.
+ * @param open A pointer to the opening parenthesis.
+ * @return A pointer to the matching closing parenthesis, or NULL if it's not closed.
+ * @note Parentheses inside double quotes are ignored.
+ */
+const char *find_substitution_end(const char *open);
+
+/*
+ * @brief Run a command and capture its standard output.
+ * @param ctx The shell context.
+ * @param command The command line to run.
+ * @param len The length of the captured output.
+ * @return A newly allocated buffer with the output (trailing newlines trimmed), or NULL on failure.
+ * @note Builtins without side effects (such as pwd) are captured in-process, without a fork.
+ * @note Other commands run in a subshell, and their output is read from a pipe into a buffer that grows geometrically.
+ * @note The exit status of the command is stored in the "$?" variable (and in the subst_status of the context).
+ * @note The returned pointer must be freed by the caller.
+ */
+char *capture_command_output(PShellContext ctx, const char *command, size_t *len);
+
+/*
+ * @brief Expand every command substitution ("$(cmd)") inside a string.
+ * @param ctx The shell context.
+ * @param str The string to expand.
+ * @return A newly allocated expanded string, or NULL on failure.
+ * @note The returned pointer must be freed by the caller.
+ */
+char *expand_command_substitutions(PShellContext ctx, const char *str);
+
+#endif /* _SHELL_SUBST_H */
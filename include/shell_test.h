@@ -0,0 +1,57 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Test Command Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_TEST_H
+#define _SHELL_TEST_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include <stdbool.h>
+
+/***********************/
+/* Definitions Section */
+/***********************/
+
+/*
+ * @brief The exit statuses of the test command: the expression is true, false, or isn't valid.
+ */
+#define TEST_TRUE 0
+#define TEST_FALSE 1
+#define TEST_ERROR 2
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Evaluate a test expression.
+ * @param args The arguments of the expression (without the command name and the closing bracket).
+ * @param argc The number of arguments.
+ * @param extended True for a "[[ ... ]]" expression, false for "test" and "[ ... ]".
+ * @return TEST_TRUE, TEST_FALSE, or TEST_ERROR if the expression isn't valid.
+ * @note Supports the file tests (-e -f -d -r -w -x -s -L -h -p -S -b -c -g -u -k -t), the string tests
+ * 		 (-z, -n, =, ==, !=, <, >), the integer comparisons (-eq -ne -lt -le -gt -ge), the file comparisons
+ * 		 (-nt -ot -ef), "!" and parentheses. "test" and "[" combine expressions with -a and -o, "[[" with && and ||,
+ * 		 and matches the right side of == and != as a pattern (its quoted characters literally).
+ * @note In a "[[" expression, the arguments are unescaped in place (see GLOB_ESCAPE).
+ */
+int test_evaluate(char **args, int argc, bool extended);
+
+#endif
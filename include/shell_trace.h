@@ -0,0 +1,89 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Tracer Header File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SHELL_TRACE_H
+#define _SHELL_TRACE_H
+
+/********************/
+/* Includes Section */
+/********************/
+#include "shell_def.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/***********************/
+/* Definitions Section */
+/***********************/
+
+/*
+ * @brief The size of the tracer's output buffer.
+ * @note Events are written to the trace file only when the buffer fills up, so tracing costs about one write(2)
+ * 		 per few hundred events.
+ */
+#define TRACE_BUFFER_SIZE 65536
+
+/*
+ * @brief The maximum number of characters of an event's detail (usually a command line) written to the trace.
+ */
+#define TRACE_MAX_DETAIL 256
+
+/*
+ * @brief Whether the tracer is enabled, so call sites can skip building their events.
+ */
+extern bool trace_enabled;
+
+/*********************/
+/* Functions Section */
+/*********************/
+
+/*
+ * @brief Start tracing into a file, in the trace-event JSON format (Perfetto, chrome://tracing).
+ * @param path The path of the trace file. It's truncated.
+ * @return Success if the file was opened, Failure otherwise.
+ * @note A trace that is already open is closed first.
+ */
+Result trace_open(const char *path);
+
+/*
+ * @brief Flush the buffered events, terminate the trace and close its file.
+ * @note Does nothing if the tracer is disabled.
+ */
+void trace_close();
+
+/*
+ * @brief Drop the tracer's state without writing anything.
+ * @note Called by forked children that keep running shell code (subshells), as their copy of the buffer
+ * 		 holds events that belong to the parent.
+ */
+void trace_discard();
+
+/*
+ * @brief Add a complete span to the trace.
+ * @param name The name of the span (e.g. "parse", "wait").
+ * @param start_ns The start of the span, from stats_now().
+ * @param end_ns The end of the span, from stats_now().
+ * @param pid The process the span belongs to, or 0 for the shell itself.
+ * @param stage The pipeline stage of the span, or -1 if it has none.
+ * @param detail A description of the span (e.g. the command line), or NULL. Truncated to TRACE_MAX_DETAIL.
+ * @note Does nothing if the tracer is disabled. A span of another process also names that process's track
+ * 		 after the detail.
+ */
+void trace_span(const char *name, uint64_t start_ns, uint64_t end_ns, pid_t pid, int stage, const char *detail);
+
+#endif
@@ -25,12 +25,38 @@
 #include "shell_def.h"
 #include "LinkedList.h"
 #include "Variables.h"
+#include "shell_context.h"
+#include <stdbool.h>
+#include <stddef.h>
 
+/*******************/
+/* Structs Section */
+/*******************/
+
+/*
+ * @brief A hash table of named entries, with open addressing (linear probing).
+ * @param slots The slots, each one an entry or NULL.
+ * @param capacity The number of slots, a power of two (0 until the first entry is added).
+ * @param count The number of entries, at most half the number of slots.
+ * @note An entry is any struct whose first member is its name (a char *), so the table keys it without knowing its type.
+ */
+typedef struct NameTable {
+	void **slots;
+	size_t capacity;
+	size_t count;
+} NameTable, *PNameTable;
 
 /*********************/
 /* Functions Section */
 /*********************/
 
+/*
+ * @brief Count the tokens of a command, with the same rules as tokenize_command().
+ * @param command The command to count.
+ * @return The number of tokens.
+ */
+int count_tokens(const char *command);
+
 /*
  * @brief Tokenize a command into tokens.
  * @param command The command to tokenize.
@@ -43,9 +69,48 @@ char **tokenize_command(const char *command, int num_tokens);
 /*
  * @brief Parse command variables and replace them with their values.
  * @param command The command to parse.
+ * @param ctx The shell context, which holds the variables.
+ * @return Success if every substitution was expanded, Failure otherwise (e.g. a division by zero in "$((expr))").
+ * @note Command substitutions ("$(cmd)") are replaced with the output of the command.
+ * 		 An unquoted substitution that makes up a whole argument is split into words, so the array may be reallocated.
+ * @note On failure, the error was already printed, and the command must not run.
+ */
+Result parse_variables(char ***command, PShellContext ctx);
+
+/*
+ * @brief Find the value of a variable.
  * @param variableList The list of variables.
+ * @param name The name of the variable (without the "$" sign).
+ * @return The value of the variable, or NULL if the variable is not defined.
+ * @note The returned pointer is owned by the variable list and must not be freed.
+ */
+char *get_variable(PLinkedList variableList, const char *name);
+
+/*
+ * @brief Expand every variable reference inside a string.
+ * @param str The string to expand.
+ * @param variableList The list of variables.
+ * @return A newly allocated expanded string, or NULL on allocation failure.
+ * @note Undefined variables are left untouched, like in parse_variables().
+ * @note The returned pointer must be freed by the caller.
+ */
+char *expand_variables_str(const char *str, PLinkedList variableList);
+
+/*
+ * @brief Check if an argument separates two pipeline stages ("|", or the fan-out operator "|>").
+ * @param arg The argument to check.
+ * @return True if the argument is a pipeline separator, False otherwise.
+ */
+bool is_pipe_separator(const char *arg);
+
+/*
+ * @brief Track whether an argument is part of a "[[ ... ]]" test, whose "<" and ">" compare strings and aren't redirections.
+ * @param arg The argument to check.
+ * @param in_test True if the previous argument was part of a test, False otherwise.
+ * @return True if the argument is part of a test (its opening "[[" included), False otherwise.
+ * @note Called for each argument in order, starting with False.
  */
-void parse_variables(char ***command, PLinkedList variableList);
+bool in_test_expression(const char *arg, bool in_test);
 
 /*
  * @brief Check if a command is a control command (if, then, else, fi).
@@ -55,12 +120,54 @@ void parse_variables(char ***command, PLinkedList variableList);
 int is_control_command(const char *cmd);
 
 /*
- * @brief Checks if we can execute a command.
- * @param curr_state The current state of the shell.
- * @param curr_result The current result of the shell.
- * @return 1 if we can execute the command, 0 otherwise.
+ * @brief Hash a string (FNV-1a).
+ * @param str The string.
+ * @param len The length of the string.
+ * @return The hash of the string.
+ */
+size_t hash_string(const char *str, size_t len);
+
+/*
+ * @brief Find an entry of a name table.
+ * @param table The name table.
+ * @param name The name of the entry.
+ * @return The entry, or NULL if there is no entry with this name.
+ */
+void *name_table_lookup(const NameTable *table, const char *name);
+
+/*
+ * @brief Add an entry to a name table, which must not have an entry with the same name.
+ * @param table The name table.
+ * @param entry The entry.
+ * @return Success on success, Failure on allocation failure.
+ * @note The table doubles its slots whenever it would be more than half full.
+ */
+Result name_table_insert(PNameTable table, void *entry);
+
+/*
+ * @brief Remove an entry from a name table.
+ * @param table The name table.
+ * @param name The name of the entry.
+ * @return The removed entry (it's not freed), or NULL if there is no entry with this name.
+ */
+void *name_table_remove(PNameTable table, const char *name);
+
+/*
+ * @brief Free the slots of a name table, and empty it.
+ * @param table The name table.
+ * @note The entries are owned by the caller, and must be freed before.
+ */
+void name_table_free(PNameTable table);
+
+/*
+ * @brief Replace an argument with copies of a list of words.
+ * @param argv A pointer to the array of arguments. It's reallocated if there is more than one word.
+ * @param index The index of the argument to replace.
+ * @param words The words.
+ * @param count The number of words (may be 0, the argument is removed).
+ * @return true on success, false on allocation failure (the arguments are left unchanged).
  */
-int ok_to_execute(State curr_state, Result curr_result);
+bool splice_words(char ***argv, int index, char *const *words, int count);
 
 /*
  * @brief Clean up the memory allocated for the tokens/arguments.
@@ -50,6 +50,13 @@ PCommand create_command(char *command, bool isInternal, bool background) {
     cmd->isInternal = isInternal;
     cmd->background = background;
     cmd->status = 0;
+    cmd->start_ns = 0;
+    cmd->end_ns = 0;
+    cmd->pids = NULL;
+    cmd->num_pids = 0;
+    cmd->timeout_ns = 0;
+    cmd->kill_after_ns = 0;
+    cmd->timed_out = false;
 
     return cmd;
 }
@@ -62,5 +69,6 @@ void destroy_command(PCommand cmd) {
     }
 
     free(cmd->command);
+    free(cmd->pids);
     free(cmd);
 }
\ No newline at end of file
@@ -64,6 +64,7 @@ PVariable create_variable(char *name, char *value) {
     }
 
     strcpy(variable->value, value);
+    variable->exported = false;
 
     return variable;
 }
@@ -0,0 +1,103 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Program
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+// Main function section
+int main(int argc, char **args)
+{
+	if (argc > 1)
+	{
+		fprintf(stderr, "%s: Too many arguments.\n", *args);
+		return EXIT_FAILURE;
+	}
+
+	// Command line, owned by the line editor.
+	char *command = NULL;
+	size_t command_len = 0;
+
+	// The prompt, followed by a space.
+	char prompt[SHELL_MAX_PATH_LENGTH + 2] = {0};
+
+	// Handle SIGINT. We use sigaction(2) instead of signal(2) because it's more portable and reliable.
+	struct sigaction sa;
+	sa.sa_handler = shell_sig_handler;
+	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
+
+	if (sigaction(SIGINT, &sa, NULL) == -1)
+	{
+		perror("Internal error: System call faliure: sigaction(2)");
+		return EXIT_FAILURE;
+	}
+
+	// On a terminal, each pipeline runs as a job in its own process group, which gets the terminal's signals.
+	// The shell itself only forwards the ones sent to it, so SIGQUIT and SIGTSTP go through the same handler.
+	// If the shell can't take the terminal, it runs without job control.
+	job_control_init();
+
+	if (job_control_enabled() && (sigaction(SIGQUIT, &sa, NULL) == -1 || sigaction(SIGTSTP, &sa, NULL) == -1))
+	{
+		perror("Internal error: System call faliure: sigaction(2)");
+		return EXIT_FAILURE;
+	}
+
+	// The shell engine, everything it needs lives in its context.
+	PShellContext ctx = shell_init();
+
+	if (ctx == NULL)
+		return EXIT_FAILURE;
+
+	while (!ctx->exit_requested)
+	{
+		// Get current working directory
+		getcwd(ctx->cwd, SHELL_MAX_PATH_LENGTH);
+
+		// Print prompt and read command from user
+		snprintf(prompt, sizeof(prompt), "%s ", ctx->curr_prompt);
+
+		uint64_t read_start = stats_now();
+		command = read_line(prompt, &command_len, ctx->commandHistory);
+		trace_span("read-line", read_start, stats_now(), 0, -1, NULL);
+
+		// End of input, same as the quit command.
+		if (command == NULL)
+			break;
+
+		if (command_len > SHELL_MAX_COMMAND_LENGTH)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_COMMAND_TOO_LONG);
+			continue;
+		}
+
+		// Parse and execute the command.
+		shell_run_command(ctx, command);
+	}
+
+	// Memory cleanup
+	shell_cleanup(ctx);
+	path_index_free();
+	stats_free();
+	job_free();
+
+	return EXIT_SUCCESS;
+}
@@ -1,6 +1,6 @@
 /*
  *  Advanced Programming Course Assignment 1
- *  Shell Program
+ *  Shell Engine
  *  Copyright (C) 2024  Roy Simanovich and Almog Shor
  *
  *  This program is free software: you can redistribute it and/or modify
@@ -29,130 +29,91 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
-// Global variables section //
-
-// Home directory
-char *homedir = NULL;
-
-// Current working directory
-char *cwd = NULL;
-
-// Previous working directory
-char *workingdir = NULL;
-
-// Current prompt (default is SHELL_DEFAULT_PROMPT).
-char *curr_prompt = NULL;
-
-// Command history
-PLinkedList commandHistory;
-
-// Variable list
-PLinkedList variableList;
-
-// Shell state
-State shell_state = STATE_NETURAL;
-
-// Main function section
-int main(int argc, char **args)
+PShellContext shell_init()
 {
-	if (argc > 1)
+	PShellContext ctx = (PShellContext)calloc(1, sizeof(ShellContext));
+
+	if (ctx == NULL)
 	{
-		fprintf(stderr, "%s: Too many arguments.\n", *args);
-		return EXIT_FAILURE;
+		perror("Internal error: System call faliure: calloc(3)");
+		return NULL;
 	}
 
-	// Command buffer
-	char command[SHELL_MAX_COMMAND_LENGTH + 1] = {0};
-
-	// Arguments array
-	char **argv = NULL;
-
 	// Get home directory
-	homedir = getenv("HOME");
+	ctx->homedir = getenv("HOME");
 
-	if (homedir == NULL)
+	if (ctx->homedir == NULL)
 	{
 		fprintf(stderr, "Internal error: System call faliure: getenv(3)");
-		return EXIT_FAILURE;
-	}
-
-	// Handle SIGINT. We use sigaction(2) instead of signal(2) because it's more portable and reliable.
-	struct sigaction sa;
-	sa.sa_handler = shell_sig_handler;
-	sa.sa_flags = 0;
-	sigemptyset(&sa.sa_mask);
-
-	if (sigaction(SIGINT, &sa, NULL) == -1)
-	{
-		perror("Internal error: System call faliure: sigaction(2)");
-		return EXIT_FAILURE;
+		free(ctx);
+		return NULL;
 	}
 
 	// Allocate memory for the current working directory, the working directory and the current prompt.
 	// Size is SHELL_MAX_PATH_LENGTH + 1 to allow for the null terminator.
-	cwd = (char *)calloc((SHELL_MAX_PATH_LENGTH + 1), sizeof(char));
-	workingdir = (char *)calloc((SHELL_MAX_PATH_LENGTH + 1), sizeof(char));
-	curr_prompt = (char *)calloc((SHELL_MAX_PATH_LENGTH + 1), sizeof(char));
-
-	if (cwd == NULL || workingdir == NULL || curr_prompt == NULL)
+	ctx->cwd = (char *)calloc((SHELL_MAX_PATH_LENGTH + 1), sizeof(char));
+	ctx->workingdir = (char *)calloc((SHELL_MAX_PATH_LENGTH + 1), sizeof(char));
+	ctx->curr_prompt = (char *)calloc((SHELL_MAX_PATH_LENGTH + 1), sizeof(char));
+	ctx->commandHistory = createLinkedList();
+	ctx->variableList = createLinkedList();
+
+	if (ctx->cwd == NULL || ctx->workingdir == NULL || ctx->curr_prompt == NULL ||
+		ctx->commandHistory == NULL || ctx->variableList == NULL)
 	{
 		perror("Internal error: System call faliure: calloc(3)");
-		return EXIT_FAILURE;
-	}
-
-	commandHistory = createLinkedList();
-	variableList = createLinkedList();
-
-	if (commandHistory == NULL || variableList == NULL)
-	{
-		shell_cleanup();
-		exit(EXIT_FAILURE);
+		shell_cleanup(ctx);
+		return NULL;
 	}
 
-	// Add the last status variable to the variable list.
-	if (setVariable(SHELL_CMD_LAST_STATUS, "0") == Failure)
+	// Add the last status variable to the variable list, and copy the inherited environment.
+	if (setVariable(ctx, SHELL_CMD_LAST_STATUS, "0") == Failure || env_init(ctx) == Failure)
 	{
-		shell_cleanup();
-		exit(EXIT_FAILURE);
+		shell_cleanup(ctx);
+		return NULL;
 	}
 
 	// Set the prompt to the default one.
-	strcpy(curr_prompt, SHELL_DEFAULT_PROMPT);
+	strcpy(ctx->curr_prompt, SHELL_DEFAULT_PROMPT);
+	getcwd(ctx->cwd, SHELL_MAX_PATH_LENGTH);
 
-	while (1)
-	{
-		// Get current working directory
-		getcwd(cwd, SHELL_MAX_PATH_LENGTH);
+	// Tracing can be enabled from the environment, so a script can be traced from its first command.
+	char *trace_path = getenv(SHELL_TRACE_ENV);
 
-		// Print prompt
-		fprintf(stdout, "%s ", curr_prompt);
-		fflush(stdout);
+	if (trace_path != NULL && *trace_path != '\0')
+		trace_open(trace_path);
 
-		// Read command from user
-		fgets(command, SHELL_MAX_COMMAND_LENGTH, stdin);
+	return ctx;
+}
 
-		// Pass command to shell internal parser
-		if (parse_command(command, &argv) == Internal)
-			continue;
+void shell_run_command(PShellContext ctx, char *command)
+{
+	char **argv = NULL;
+	uint64_t start = stats_now();
 
-		// Execute command
-		execute_command(argv);
+	// The parser may change the command line, so the trace gets a copy of it.
+	char detail[TRACE_MAX_DETAIL + 1] = {0};
+
+	if (trace_enabled)
+		strncpy(detail, command, TRACE_MAX_DETAIL);
+
+	// Internal commands are executed by the parser itself.
+	if (parse_command(ctx, command, &argv) == External)
+	{
+		execute_command(ctx, argv);
 
 		// Free the memory allocated for the arguments array.
 		freeUpMem(&argv);
-
-		// Reset stdin buffer
-		bzero(command, SHELL_MAX_PATH_LENGTH + 1);
 	}
 
-	// Memory cleanup
-	shell_cleanup();
-
-	return EXIT_SUCCESS;
+	trace_span("command", start, stats_now(), 0, -1, detail);
 }
 
 void shell_sig_handler(int signum)
 {
+	// A signal sent to the shell itself, while a job runs in the foreground, is meant for the job.
+	if (job_forward_signal(signum))
+		return;
+
 	if (signum == SIGINT)
 	{
 		fprintf(stdout, "\33[2K\rYou typed Control-C!\n");
@@ -160,360 +121,772 @@ void shell_sig_handler(int signum)
 	}
 }
 
-void update_laststatus(int status)
+void update_laststatus(PShellContext ctx, int status)
 {
 	// Set the last status variable.
 	char status_str[10] = {0};
 	sprintf(status_str, "%d", status);
-	setVariable(SHELL_CMD_LAST_STATUS, status_str);
+	setVariable(ctx, SHELL_CMD_LAST_STATUS, status_str);
 }
 
-void shell_cleanup()
+void shell_cleanup(PShellContext ctx)
 {
+	// Write the rest of the trace, if the shell is tracing.
+	trace_close();
+
+	// Free the aliases and the functions.
+	alias_free(ctx);
+	function_free(ctx);
+
+	// Free the environment, the compiled arithmetic expressions and the glob options.
+	env_free(ctx);
+	arith_free(ctx);
+	glob_free_options();
+
 	// Free the memory allocated for the current working directory.
-	free(cwd);
+	free(ctx->cwd);
 
 	// Free the memory allocated for the working directory (privous directory, before changing to the current one).
-	free(workingdir);
+	free(ctx->workingdir);
 
 	// Free the memory allocated for the current prompt.
-	free(curr_prompt);
+	free(ctx->curr_prompt);
 
 	// Free the memory allocated for the command history.
-	PNode curr = commandHistory->head;
+	if (ctx->commandHistory != NULL)
+	{
+		PNode curr = ctx->commandHistory->head;
 
-	while (curr != NULL)
+		while (curr != NULL)
+		{
+			PNode tmp = curr;
+			curr = curr->next;
+
+			destroy_command((PCommand)(tmp->data));
+			free(tmp);
+		}
+
+		ctx->commandHistory->head = NULL;
+
+		destroyLinkedList(ctx->commandHistory);
+	}
+
+	// Free the memory allocated for the variable list.
+	if (ctx->variableList != NULL)
 	{
-		PNode tmp = curr;
-		curr = curr->next;
+		PNode curr = ctx->variableList->head;
 
-		PCommand command = (PCommand)(tmp->data);
-		free(command->command);
-		free(command);
-		free(tmp);
+		while (curr != NULL)
+		{
+			PNode tmp = curr;
+			curr = curr->next;
+
+			PVariable variable = (PVariable)(tmp->data);
+			free(variable->name);
+			free(variable->value);
+			free(variable);
+			free(tmp);
+		}
+
+		ctx->variableList->head = NULL;
+
+		destroyLinkedList(ctx->variableList);
 	}
 
-	commandHistory->head = NULL;
+	free(ctx);
+}
 
-	destroyLinkedList(commandHistory);
+/*
+ * @brief Check if a command is a simple one: no pipes, redirections, process substitutions or background.
+ * @param command The command line.
+ * @param pargv The array of arguments.
+ * @return True if the command is a simple one, False otherwise.
+ */
+static bool is_simple_command(const char *command, char **pargv)
+{
+	bool in_test = false;
 
-	// Free the memory allocated for the variable list.
-	curr = variableList->head;
+	if (*(command + strlen(command) - 1) == '&')
+		return false;
 
-	while (curr != NULL)
+	for (; *pargv != NULL; ++pargv)
 	{
-		PNode tmp = curr;
-		curr = curr->next;
-
-		PVariable variable = (PVariable)(tmp->data);
-		free(variable->name);
-		free(variable->value);
-		free(variable);
-		free(tmp);
-	}
+		in_test = in_test_expression(*pargv, in_test);
 
-	variableList->head = NULL;
+		if (is_pipe_separator(*pargv) || (!in_test && is_redirect(*pargv)) || is_process_substitution(*pargv))
+			return false;
+	}
 
-	destroyLinkedList(variableList);
+	return true;
 }
 
-CommandType parse_command(char *command, char ***argv)
+/*
+ * @brief Run a builtin command.
+ * @param ctx The shell context.
+ * @param cmd The command's history entry.
+ * @param command The command line.
+ * @param pargv The array of arguments.
+ * @param words The number of arguments.
+ * @return Internal if the command is a builtin (and it was run), External otherwise.
+ * @note The arguments are freed by the caller.
+ */
+static CommandType run_builtin(PShellContext ctx, PCommand cmd, char *command, char **pargv, int words)
 {
-	int words = 1;
-	bool inQuotes = false;
-	Result curr_res = Success;
+	// Exit command. The owner of the context ends the session.
+	if (strcmp(*pargv, SHELL_CMD_EXIT) == 0)
+	{
+		cmd->isInternal = true;
+		ctx->exit_requested = true;
+		return Internal;
+	}
 
-	// Remove the newline character from the command, to check if it's empty.
-	command = strtok(command, "\n");
+	// Change directory command.
+	else if (strcmp(*pargv, SHELL_CMD_CD) == 0)
+	{
+		Result res = cmdCD(ctx, *(pargv + 1), words);
+		cmd->isInternal = true;
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-	// Safe-fail if the command is empty or only contains space or & (illegal), to avoid segmentation fault.
-	if (command == NULL ||
-		strlen(command) == 0 ||
-		strcmp(command, "&") == 0 ||
-		command[0] == ' ')
+	// Clean screen command.
+	else if (strcmp(*pargv, SHELL_CMD_CLEAR) == 0)
+	{
+		cmdClear();
+		cmd->isInternal = true;
+		cmd->status = 0;
+		update_laststatus(ctx, 0);
 		return Internal;
+	}
 
-	if (strcmp(command, SHELL_CMD_REPEATED) == 0)
+	// Print working directory command.
+	else if (strcmp(*pargv, SHELL_CMD_PWD) == 0)
 	{
-		cmdrepeatLastCommand();
+		cmdPWD(ctx);
+		cmd->isInternal = true;
+		cmd->status = 0;
+		update_laststatus(ctx, 0);
 		return Internal;
 	}
 
-	// Count the number of words (with support for quoted arguments).
-	for (size_t k = 0; k < strlen(command); ++k)
+	// Change prompt command.
+	else if (strcmp(*pargv, SHELL_CMD_CHANGE_PROMPT) == 0)
 	{
-		if (*(command + k) == '"')
-			inQuotes = !inQuotes;
+		cmd->isInternal = true;
 
-		if (!inQuotes && *(command + k) == ' ' && *(command + k + 1) != ' ')
-			++words;
+		// Check if the number of arguments is correct.
+		if (words != 3)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_CHANGE_PROMPT_SYNTAX);
+			cmd->status = 1;
+			update_laststatus(ctx, 1);
+			return Internal;
+		}
+
+		// Check if the syntax is correct.
+		if (strcmp(*(pargv + 1), "=") != 0)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_CHANGE_PROMPT_SYNTAX);
+			cmd->status = 1;
+			update_laststatus(ctx, 1);
+			return Internal;
+		}
+
+		Result res = cmdChangePrompt(ctx, *(pargv + 2));
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
 	}
 
-	// Tokenize the command into an array of arguments.
-	*argv = tokenize_command(command, words);
-	char **pargv = *argv;
+	// History command.
+	else if (strcmp(*pargv, SHELL_CMD_HISTORY) == 0)
+	{
+		cmd->isInternal = true;
+		Result res = cmdHistory(ctx, pargv + 1);
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-	// If the tokenization failed, state an error and exit.
-	if (pargv == NULL)
+	// Read command.
+	else if (strcmp(*pargv, SHELL_CMD_READ) == 0)
 	{
-		shell_cleanup();
-		exit(EXIT_FAILURE);
+		cmd->isInternal = true;
+		Result res = cmdRead(ctx, *(pargv + 1));
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
 	}
 
-	// Parse the variables.
-	parse_variables(&pargv, variableList);
+	// !! command. cmdrepeatLastCommand
+	else if (strcmp(*pargv, "!!") == 0)
+	{
+		cmd->isInternal = true;
+		Result res = cmdrepeatLastCommand(ctx);
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-	if (is_control_command(*pargv))
+	// Statistics command.
+	else if (strcmp(*pargv, SHELL_CMD_STATS) == 0)
 	{
-		// If control command, check if it's valid.
-		if (strcmp(*pargv, "if") == 0)
-		{
-			if (shell_state != STATE_NETURAL)
-			{
-				fprintf(stderr, "Shell internal error: syntax error: if unexpected\n");
-				freeUpMem(argv);
-				return Internal;
-			}
+		cmd->isInternal = true;
+		Result res = cmdStats(pargv + 1);
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-			shell_state = STATE_WANT_THEN;
+	// Alias command.
+	else if (strcmp(*pargv, SHELL_CMD_ALIAS) == 0)
+	{
+		cmd->isInternal = true;
+		Result res = cmdAlias(ctx, pargv + 1);
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-			// Free the first argument, which is the if command.
-			free(*pargv);
+	// Unalias command.
+	else if (strcmp(*pargv, SHELL_CMD_UNALIAS) == 0)
+	{
+		cmd->isInternal = true;
+		Result res = cmdUnalias(ctx, pargv + 1);
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-			// Shift the arguments array to the left by one.
-			char **tmp = pargv;
-			while (*tmp != NULL)
-			{
-				*tmp = *(tmp + 1);
-				++tmp;
-			}
+	// Return command.
+	else if (strcmp(*pargv, SHELL_CMD_RETURN) == 0)
+	{
+		cmd->isInternal = true;
+		cmd->status = cmdReturn(ctx, pargv + 1);
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-			// Free the last argument, which is now NULL.
-			free(*(pargv + words - 1));
-			*(pargv + words - 1) = NULL;
-		}
+	// Test command, evaluated in-process so conditions don't fork.
+	else if (strcmp(*pargv, SHELL_CMD_TEST) == 0 || strcmp(*pargv, SHELL_CMD_BRACKET) == 0 || strcmp(*pargv, SHELL_CMD_DBRACKET) == 0)
+	{
+		cmd->isInternal = true;
+		cmd->status = cmdTest(pargv + 1, *pargv);
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-		// Then command must be after if command.
-		else if (strcmp(*pargv, "then") == 0)
+	// Utility commands, with buffered output. Piped, redirected or in the background, run_pipeline() runs them.
+	else if (is_utility(*pargv) && is_simple_command(command, pargv))
+	{
+		cmd->isInternal = true;
+		cmd->status = cmdUtility(pargv);
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
+
+	// Export command.
+	else if (strcmp(*pargv, SHELL_CMD_EXPORT) == 0)
+	{
+		cmd->isInternal = true;
+		Result res = cmdExport(ctx, pargv + 1);
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
+
+	// Unset command.
+	else if (strcmp(*pargv, SHELL_CMD_UNSET) == 0)
+	{
+		cmd->isInternal = true;
+		Result res = cmdUnset(ctx, pargv + 1);
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
+
+	// Set command.
+	else if (strcmp(*pargv, SHELL_CMD_SET) == 0)
+	{
+		cmd->isInternal = true;
+		Result res = cmdSet(pargv + 1);
+		cmd->status = (res == Success) ? 0 : 1;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
+
+	// Job control commands, a stopped job is resumed in the foreground (fg) or in the background (bg).
+	else if (strcmp(*pargv, SHELL_CMD_FG) == 0 || strcmp(*pargv, SHELL_CMD_BG) == 0)
+	{
+		cmd->isInternal = true;
+
+		if (words > 2 || job_resume(*(pargv + 1), strcmp(*pargv, SHELL_CMD_FG) == 0, &cmd->status) != Success)
 		{
-			if (words > 1 || shell_state != STATE_WANT_THEN)
-			{
-				fprintf(stderr, "Shell internal error: syntax error: then unexpected\n");
-				freeUpMem(argv);
-				return Internal;
-			}
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_JOB_USAGE);
+			cmd->status = 1;
+		}
 
-			shell_state = STATE_THEN_BLOCK;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
 
-			freeUpMem(argv);
+	// Jobs command.
+	else if (strcmp(*pargv, SHELL_CMD_JOBS) == 0)
+	{
+		cmd->isInternal = true;
+		job_list(stdout);
+		cmd->status = 0;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
+	}
+
+	// Set Variable command.
+	else if (*command == '$')
+	{
+		cmd->isInternal = true;
+
+		if (words != 3)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_SET_SYNTAX);
+			cmd->status = 1;
+			update_laststatus(ctx, 1);
 			return Internal;
 		}
 
-		// Else command must be after the then command block.
-		else if (strcmp(*pargv, "else") == 0)
+		else if (strcmp(*(pargv + 1), "=") != 0)
 		{
-			if (words > 1 || shell_state != STATE_THEN_BLOCK)
-			{
-				fprintf(stderr, "Shell internal error: syntax error: else unexpected\n");
-				return Internal;
-			}
-
-			shell_state = STATE_ELSE_BLOCK;
-			freeUpMem(argv);
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_SET_SYNTAX);
+			cmd->status = 1;
+			update_laststatus(ctx, 1);
 			return Internal;
 		}
 
-		// Finish control command. Reset shell state.
-		else if (strcmp(*pargv, "fi") == 0)
+		// Safe fail, as $? variable is reserved.
+		else if (strcmp(*(pargv + 0), "$?") == 0)
 		{
-			if (words > 1 || (shell_state != STATE_THEN_BLOCK && shell_state != STATE_ELSE_BLOCK))
-			{
-				fprintf(stderr, "Shell internal error: syntax error: fi unexpected\n");
-				return Internal;
-			}
-
-			shell_state = STATE_NETURAL;
-			freeUpMem(argv);
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_SET_SYNTAX);
 			return Internal;
 		}
+
+		// An assignment of a command substitution's output has the status of the substitution, as in other shells.
+		Result res = setVariable(ctx, *(pargv + 0) + 1, *(pargv + 2));
+		cmd->status = (res != Success) ? 1 : (ctx->subst_status >= 0) ? ctx->subst_status : 0;
+		update_laststatus(ctx, cmd->status);
+		return Internal;
 	}
 
-	// We want to check if its ok to execute the command if we are in then or else block.
-	if (commandHistory->tail != NULL && shell_state != STATE_WANT_THEN && shell_state != STATE_NETURAL)
-	{
-		PCommand lastCommand = (PCommand)(commandHistory->tail->data);
+	// This is an external command.
+	return External;
+}
+
+static CommandType process_tokens(PShellContext ctx, char *command, char ***argv, uint64_t parse_start);
+
+/*
+ * @brief Check if the commands at the current point of the if blocks run.
+ * @param ctx The shell context.
+ * @return True if they run, False if they are in a branch that isn't taken.
+ */
+static bool if_block_runs(PShellContext ctx)
+{
+	if (ctx->if_depth == ctx->if_base)
+		return true;
 
-		curr_res = (lastCommand->status ? Failure : Success);
+	PIfBlock block = ctx->if_stack + ctx->if_depth - 1;
 
-		if (!ok_to_execute(shell_state, curr_res))
+	if (!block->enclosing_runs)
+		return false;
+
+	// The condition runs, then the then block if it succeeded, or the else block if it failed.
+	return (block->state == STATE_WANT_THEN) || ((block->state == STATE_THEN_BLOCK) == block->taken);
+}
+
+/*
+ * @brief Skip a command line of a branch that isn't taken, without tokenizing or expanding it.
+ * @param ctx The shell context.
+ * @param command The command line.
+ * @return True if the line was skipped, False if it runs.
+ * @note Only the first word is looked at, to keep track of the if, then, else and fi of the nested blocks.
+ */
+static bool skip_if_block_line(PShellContext ctx, const char *command)
+{
+	if (if_block_runs(ctx))
+		return false;
+
+	PIfBlock block = ctx->if_stack + ctx->if_depth - 1;
+
+	command += strspn(command, " \t");
+
+	size_t len = strcspn(command, " \t\n");
+	bool alone = (*(command + len + strspn(command + len, " \t\n")) == '\0');
+
+	STATS_INC(skipped_lines);
+
+	if (len == 2 && strncmp(command, "if", 2) == 0)
+	{
+		if (ctx->if_depth == SHELL_MAX_IF_DEPTH)
 		{
-			freeUpMem(argv);
-			return Internal;
+			fprintf(stderr, "%s\n", SHELL_ERR_IF_DEPTH);
+			return true;
 		}
+
+		*(ctx->if_stack + ctx->if_depth++) = (IfBlock){STATE_WANT_THEN, false, false};
 	}
 
-	// If we expect "then" and we got a command, it's a syntax error.
-	else if (shell_state == STATE_WANT_THEN && strncmp(command, "if", 2) != 0)
+	else if (len == 4 && strncmp(command, "then", 4) == 0)
 	{
-		fprintf(stderr, "Shell internal error: syntax error: then expected\n");
-		freeUpMem(argv);
-		return Internal;
+		if (!alone || block->state != STATE_WANT_THEN)
+			fprintf(stderr, "Shell internal error: syntax error: then unexpected\n");
+
+		else
+			block->state = STATE_THEN_BLOCK;
 	}
 
-	// Add the command to the command history.
-	PCommand cmd = create_command(command, false, false);
+	else if (len == 4 && strncmp(command, "else", 4) == 0)
+	{
+		if (!alone || block->state != STATE_THEN_BLOCK)
+			fprintf(stderr, "Shell internal error: syntax error: else unexpected\n");
 
-	if (addNode(commandHistory, cmd) != 0)
+		else
+			block->state = STATE_ELSE_BLOCK;
+	}
+
+	else if (len == 2 && strncmp(command, "fi", 2) == 0)
 	{
-		destroy_command(cmd);
+		if (!alone || block->state == STATE_WANT_THEN)
+			fprintf(stderr, "Shell internal error: syntax error: fi unexpected\n");
 
-		freeUpMem(argv);
+		else
+			--ctx->if_depth;
+	}
 
-		shell_cleanup();
-		exit(EXIT_FAILURE);
+	return true;
+}
+
+/*
+ * @brief Run a function call, in the shell process itself.
+ * @param ctx The shell context.
+ * @param cmd The call's history entry, shared by the commands of the body.
+ * @param function The called function.
+ * @param pargv The arguments of the call, the first one is the name of the function.
+ * @param words The number of arguments.
+ * @note The body was tokenized when the function was defined, so a call only pushes a frame and copies the tokens
+ * 		 of each line before they are expanded. The body starts outside of any if block of the caller.
+ */
+static void run_function(PShellContext ctx, PCommand cmd, PShellFunction function, char **pargv, int words)
+{
+	cmd->isInternal = true;
+
+	if (ctx->frame != NULL && ctx->frame->depth >= SHELL_MAX_FUNCTION_DEPTH)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_FUNCTION_DEPTH);
+		cmd->status = 1;
+		update_laststatus(ctx, 1);
+		return;
 	}
 
-	// Exit command.
-	if (strcmp(*pargv, SHELL_CMD_EXIT) == 0)
+	ShellFrame frame = {function, pargv, words, (ctx->frame != NULL) ? ctx->frame->depth + 1 : 1, false, ctx->frame};
+	int caller_depth = ctx->if_depth, caller_base = ctx->if_base;
+
+	// The function can be redefined (or removed) by its own body, the frame keeps it alive.
+	++function->refs;
+	ctx->frame = &frame;
+	ctx->if_base = ctx->if_depth;
+	cmd->status = 0;
+	update_laststatus(ctx, 0);
+
+	for (int i = 0; i < function->num_lines && !frame.returning && !ctx->exit_requested; ++i)
 	{
-		// Clean up arguments array.
-		freeUpMem(argv);
-		shell_cleanup();
-		exit(EXIT_SUCCESS);
+		char **argv = NULL;
+
+		if (skip_if_block_line(ctx, *(function->lines + i)))
+			continue;
+
+		else if (function_is_definition(*(function->lines + i)))
+		{
+			cmd->status = (function_define(ctx, *(function->lines + i)) == Success) ? 0 : 1;
+			update_laststatus(ctx, cmd->status);
+			continue;
+		}
+
+		else if ((argv = function_copy_line(function, i)) == NULL)
+		{
+			cmd->status = 1;
+			update_laststatus(ctx, 1);
+			break;
+		}
+
+		// The here-documents of the line were read with the body, when the function was defined.
+		heredoc_preset(*(function->heredocs + i));
+
+		if (process_tokens(ctx, *(function->lines + i), &argv, stats_now()) == External)
+		{
+			execute_command(ctx, argv);
+			freeUpMem(&argv);
+		}
+
+		heredoc_preset(NULL);
 	}
 
-	// Change directory command.
-	else if (strcmp(*pargv, SHELL_CMD_CD) == 0)
+	ctx->frame = frame.prev;
+	ctx->if_depth = caller_depth;
+	ctx->if_base = caller_base;
+	cmd->background = false;
+	function_release(function);
+}
+
+/*
+ * @brief Strip the "timeout [-k DURATION] DURATION" prefix of a command, into its history entry.
+ * @param cmd The command's history entry.
+ * @param pargv The array of arguments, the first of which is the timeout command.
+ * @param words The number of arguments, updated to the number that is left.
+ * @return Success if the prefix is valid and a command follows it, Failure otherwise.
+ */
+static Result strip_timeout(PCommand cmd, char **pargv, int *words)
+{
+	int prefix = 2;
+
+	cmd->kill_after_ns = SHELL_TIMEOUT_KILL_AFTER_MS * 1000000ULL;
+
+	if (*words > 1 && strcmp(*(pargv + 1), "-k") == 0)
 	{
-		Result res = cmdCD(*(pargv + 1), words);
-		cmd->isInternal = true;
-		cmd->status = (res == Success) ? 0 : 1;
-		update_laststatus(cmd->status);
-		freeUpMem(argv);
-		return Internal;
+		if (*words < 3 || job_parse_duration(*(pargv + 2), &cmd->kill_after_ns) != Success)
+			return Failure;
+
+		prefix = 4;
 	}
 
-	// Clean screen command.
-	else if (strcmp(*pargv, SHELL_CMD_CLEAR) == 0)
+	if (*words <= prefix || job_parse_duration(*(pargv + prefix - 1), &cmd->timeout_ns) != Success)
 	{
-		cmdClear();
-		cmd->isInternal = true;
-		cmd->status = 0;
-		update_laststatus(0);
+		cmd->timeout_ns = 0;
+		return Failure;
+	}
+
+	// A zero timeout would never be noticed, so it's the shortest one instead.
+	if (cmd->timeout_ns == 0)
+		cmd->timeout_ns = 1;
+
+	for (int i = 0; i < prefix; ++i)
+		free(*(pargv + i));
+
+	memmove(pargv, pargv + prefix, (*words - prefix + 1) * sizeof(char *));
+	*words -= prefix;
+
+	return Success;
+}
+
+/*
+ * @brief Expand and run a tokenized command line.
+ * @param ctx The shell context.
+ * @param command The command line.
+ * @param argv The array of arguments, freed unless the command is an external one.
+ * @param parse_start The time the parsing of the command started at.
+ * @return Internal if the command was run, External if it should be executed by execute_command().
+ * @note Inside a function, the command doesn't get its own history entry, it updates the entry of the call.
+ */
+static CommandType process_tokens(PShellContext ctx, char *command, char ***argv, uint64_t parse_start)
+{
+	int words = 1;
+	char **pargv = *argv;
+	uint64_t expand_start = stats_now();
+
+	// Aliases are expanded before anything else, so their values are expanded too.
+	alias_expand(ctx, argv);
+	ctx->subst_status = -1;
+
+	// Parse the variables and the command substitutions, which may change the number of words.
+	// A substitution that failed (e.g. "$((1/0))") already printed its error, and the command doesn't run.
+	if (parse_variables(argv, ctx) == Failure)
+	{
+		if (ctx->frame != NULL)
+			((PCommand)(ctx->commandHistory->tail->data))->status = 1;
+
+		update_laststatus(ctx, 1);
 		freeUpMem(argv);
 		return Internal;
 	}
 
-	// Print working directory command.
-	else if (strcmp(*pargv, SHELL_CMD_PWD) == 0)
+	// Patterns are expanded last, so "$dir/*.log" matches in the directory the variable names.
+	glob_expand(argv);
+	pargv = *argv;
+
+	for (words = 0; *(pargv + words) != NULL; ++words)
+		;
+
+	uint64_t expand_end = stats_now();
+
+	STATS_ADD(parse_ns, expand_end - parse_start);
+	trace_span("expand", expand_start, expand_end, 0, -1, NULL);
+
+	// The whole command expanded to nothing.
+	if (words == 0)
 	{
-		cmdPWD();
-		cmd->isInternal = true;
-		cmd->status = 0;
-		update_laststatus(0);
 		freeUpMem(argv);
 		return Internal;
 	}
 
-	// Change prompt command.
-	else if (strcmp(*pargv, SHELL_CMD_CHANGE_PROMPT) == 0)
+	if (is_control_command(*pargv))
 	{
-		cmd->isInternal = true;
+		PIfBlock block = (ctx->if_depth > ctx->if_base) ? ctx->if_stack + ctx->if_depth - 1 : NULL;
 
-		// Check if the number of arguments is correct.
-		if (words != 3)
+		// If control command, check if it's valid. An if opens a nested block, unless it's the condition of another if.
+		if (strcmp(*pargv, "if") == 0)
 		{
-			fprintf(stderr, "%s\n", SHELL_ERR_CMD_CHANGE_PROMPT_SYNTAX);
-			cmd->status = 1;
-			update_laststatus(1);
+			if (block != NULL && block->state == STATE_WANT_THEN)
+			{
+				fprintf(stderr, "Shell internal error: syntax error: if unexpected\n");
+				freeUpMem(argv);
+				return Internal;
+			}
+
+			else if (ctx->if_depth == SHELL_MAX_IF_DEPTH)
+			{
+				fprintf(stderr, "%s\n", SHELL_ERR_IF_DEPTH);
+				freeUpMem(argv);
+				return Internal;
+			}
+
+			*(ctx->if_stack + ctx->if_depth++) = (IfBlock){STATE_WANT_THEN, false, true};
+
+			// Free the first argument, which is the if command.
+			free(*pargv);
+
+			// Shift the arguments array to the left by one.
+			char **tmp = pargv;
+			while (*tmp != NULL)
+			{
+				*tmp = *(tmp + 1);
+				++tmp;
+			}
+
+			// Free the last argument, which is now NULL.
+			free(*(pargv + words - 1));
+			*(pargv + words - 1) = NULL;
+		}
+
+		// Then command must be after if command. The status of the condition decides which branch runs.
+		else if (strcmp(*pargv, "then") == 0)
+		{
+			if (words > 1 || block == NULL || block->state != STATE_WANT_THEN)
+			{
+				fprintf(stderr, "Shell internal error: syntax error: then unexpected\n");
+				freeUpMem(argv);
+				return Internal;
+			}
+
+			block->state = STATE_THEN_BLOCK;
+			block->taken = (ctx->commandHistory->tail == NULL || ((PCommand)(ctx->commandHistory->tail->data))->status == 0);
+
 			freeUpMem(argv);
 			return Internal;
 		}
 
-		// Check if the syntax is correct.
-		if (strcmp(*(pargv + 1), "=") != 0)
+		// Else command must be after the then command block.
+		else if (strcmp(*pargv, "else") == 0)
 		{
-			fprintf(stderr, "%s\n", SHELL_ERR_CMD_CHANGE_PROMPT_SYNTAX);
-			cmd->status = 1;
-			update_laststatus(1);
+			if (words > 1 || block == NULL || block->state != STATE_THEN_BLOCK)
+			{
+				fprintf(stderr, "Shell internal error: syntax error: else unexpected\n");
+				freeUpMem(argv);
+				return Internal;
+			}
+
+			block->state = STATE_ELSE_BLOCK;
+			freeUpMem(argv);
+			return Internal;
+		}
+
+		// Finish control command. Close the innermost block.
+		else if (strcmp(*pargv, "fi") == 0)
+		{
+			if (words > 1 || block == NULL || (block->state != STATE_THEN_BLOCK && block->state != STATE_ELSE_BLOCK))
+			{
+				fprintf(stderr, "Shell internal error: syntax error: fi unexpected\n");
+				freeUpMem(argv);
+				return Internal;
+			}
+
+			--ctx->if_depth;
 			freeUpMem(argv);
 			return Internal;
 		}
-
-		Result res = cmdChangePrompt(*(pargv + 2));
-		cmd->status = (res == Success) ? 0 : 1;
-		update_laststatus(cmd->status);
-		freeUpMem(argv);
-		return Internal;
 	}
 
-	// History command.
-	else if (strcmp(*pargv, SHELL_CMD_HISTORY) == 0)
+	// If we expect "then" and we got a command, it's a syntax error.
+	if (ctx->if_depth > ctx->if_base && (ctx->if_stack + ctx->if_depth - 1)->state == STATE_WANT_THEN && strncmp(command, "if", 2) != 0)
 	{
-		cmd->isInternal = true;
-		Result res = cmdHistory(words);
-		cmd->status = (res == Success) ? 0 : 1;
-		update_laststatus(cmd->status);
+		fprintf(stderr, "Shell internal error: syntax error: then expected\n");
 		freeUpMem(argv);
 		return Internal;
 	}
 
-	// Read command.
-	else if (strcmp(*pargv, SHELL_CMD_READ) == 0)
-	{
-		cmd->isInternal = true;
-		Result res = cmdRead(*(pargv + 1));
-		cmd->status = (res == Success) ? 0 : 1;
-		update_laststatus(cmd->status);
-		freeUpMem(argv);
-		return Internal;
-	}
+	PCommand cmd = NULL;
 
-	// !! command. cmdrepeatLastCommand
-	else if (strcmp(*pargv, "!!") == 0)
+	// The commands of a function's body share the history entry of the call, so its status is theirs.
+	if (ctx->frame != NULL)
 	{
-		cmd->isInternal = true;
-		Result res = cmdrepeatLastCommand();
-		cmd->status = (res == Success) ? 0 : 1;
-		update_laststatus(cmd->status);
-		freeUpMem(argv);
-		return Internal;
+		cmd = (PCommand)(ctx->commandHistory->tail->data);
+		cmd->background = false;
+		cmd->timeout_ns = 0;
+		cmd->timed_out = false;
 	}
 
-	// Set Variable command.
-	else if (*command == '$')
+	// Add the command to the command history (the command, its line and its list node).
+	else
 	{
-		cmd->isInternal = true;
+		cmd = create_command(command, false, false);
+		STATS_ADD(allocations, 3);
 
-		if (words != 3)
+		if (cmd != NULL)
+			cmd->start_ns = parse_start;
+
+		if (addNode(ctx->commandHistory, cmd) != 0)
 		{
-			fprintf(stderr, "%s\n", SHELL_ERR_CMD_SET_SYNTAX);
-			cmd->status = 1;
-			update_laststatus(1);
+			destroy_command(cmd);
+
 			freeUpMem(argv);
-			return Internal;
+
+			shell_cleanup(ctx);
+			exit(EXIT_FAILURE);
 		}
+	}
 
-		else if (strcmp(*(pargv + 1), "=") != 0)
+	// A command under a timeout always runs as a job, so it can be signaled as a whole. As with timeout(1), only
+	// external commands and the utility builtins (e.g. echo) can run under it.
+	if (strcmp(*pargv, SHELL_CMD_TIMEOUT) == 0)
+	{
+		if (strip_timeout(cmd, pargv, &words) != Success)
 		{
-			fprintf(stderr, "%s\n", SHELL_ERR_CMD_SET_SYNTAX);
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_TIMEOUT_USAGE);
+			cmd->end_ns = stats_now();
+			cmd->isInternal = true;
 			cmd->status = 1;
-			update_laststatus(1);
+			update_laststatus(ctx, 1);
 			freeUpMem(argv);
 			return Internal;
 		}
 
-		// Safe fail, as $? variable is reserved.
-		else if (strcmp(*(pargv + 0), "$?") == 0)
-		{
-			fprintf(stderr, "%s\n", SHELL_ERR_CMD_SET_SYNTAX);
-			freeUpMem(argv);
-			return Internal;
-		}
+		if (*(command + strlen(command) - 1) == '&')
+			cmd->background = true;
 
-		Result res = setVariable(*(pargv + 0) + 1, *(pargv + 2));
-		cmd->status = (res == Success) ? 0 : 1;
-		update_laststatus(cmd->status);
+		return External;
+	}
+
+	// Builtins and functions are timed as a whole, and recorded in the latency histograms under their name.
+	uint64_t builtin_start = stats_now();
+	PShellFunction function = function_lookup(ctx, *pargv);
+
+	if (function != NULL)
+		run_function(ctx, cmd, function, pargv, words);
+
+	if (function != NULL || run_builtin(ctx, cmd, command, pargv, words) == Internal)
+	{
+		uint64_t elapsed = stats_now() - builtin_start;
+
+		cmd->end_ns = builtin_start + elapsed;
+		STATS_ADD(builtin_ns, elapsed);
+		stats_record_latency(*pargv, elapsed);
+		trace_span((function != NULL) ? "function" : "builtin", builtin_start, builtin_start + elapsed, 0, -1, *pargv);
 		freeUpMem(argv);
 		return Internal;
 	}
@@ -526,755 +899,637 @@ CommandType parse_command(char *command, char ***argv)
 	return External;
 }
 
-void execute_command(char **argv)
+CommandType parse_command(PShellContext ctx, char *command, char ***argv)
 {
-	pid_t pid;
-	int status = 0, i = 0, num_pipes = 0;
-	int count_args = 0;
-	bool redirect = false;
-	char ***pipes = NULL;
-
-	// Count the number of pipes and check if there are any redirections.
-	while (*(argv + i) != NULL)
-	{
-		if (strcmp(*(argv + i), "|") == 0)
-			++num_pipes;
-
-		else if (strcmp(*(argv + i), ">") == 0 ||
-				 strcmp(*(argv + i), ">>") == 0 ||
-				 strcmp(*(argv + i), "<") == 0 ||
-				 strcmp(*(argv + i), "2>") == 0)
-			redirect = true;
-
-		++i;
-		++count_args;
-	}
+	int words = 1;
 
-	// Case 1: No pipes
-	if (num_pipes == 0)
-	{
-		// Fork the process.
-		pid = fork();
+	// Remove the newline character from the command, to check if it's empty.
+	command = strtok(command, "\n");
 
-		if (pid == -1)
-		{
-			perror("Internal error: System call faliure: fork(2)");
-			freeUpMem(&argv);
-			shell_cleanup();
-			exit(EXIT_FAILURE);
-		}
+	// Safe-fail if the command is empty or only contains space or & (illegal), to avoid segmentation fault.
+	if (command == NULL ||
+		strlen(command) == 0 ||
+		strcmp(command, "&") == 0 ||
+		command[0] == ' ')
+		return Internal;
 
-		// Child process.
-		else if (pid == 0)
-		{
-			// Reset SIGINT to default.
-			signal(SIGINT, SIG_DFL);
+	// A line of a branch that isn't taken costs a look at its first word.
+	if (skip_if_block_line(ctx, command))
+		return Internal;
 
-			// Handle redirects
-			if (redirect)
-			{
-				bool in_mode = false, out_mode = false, err_mode = false;
-				int input_fd = STDIN_FILENO, output_fd = STDOUT_FILENO, append_fd = STDOUT_FILENO, error_fd = STDERR_FILENO;
-
-				for (int i = 0; i < count_args && !(in_mode && out_mode && err_mode); ++i)
-				{
-					if (strcmp(*(argv + i), "<") == 0)
-					{
-						if (in_mode)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_IN_TWICE);
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						else if (*(argv + i + 1) == NULL)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						// Open the file.
-						input_fd = open(*(argv + i + 1), O_RDONLY);
-
-						if (input_fd == -1)
-						{
-							perror("Internal error: System call faliure: open(2)");
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						// Redirect stdin to the file.
-						dup2(input_fd, STDIN_FILENO);
-
-						// Close the file.
-						close(input_fd);
-
-						in_mode = true;
-
-						// Remove the redirection arguments from the arguments array.
-						free(*(argv + i));
-						*(argv + i) = NULL;
-					}
-
-					else if (strcmp(*(argv + i), ">") == 0)
-					{
-						if (out_mode)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_OUT_TWICE);
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						else if (*(argv + i + 1) == NULL)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						// Open the file.
-						output_fd = open(*(argv + i + 1), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-
-						if (output_fd == -1)
-						{
-							perror("Internal error: System call faliure: open(2)");
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						// Redirect stdout to the file.
-						dup2(output_fd, STDOUT_FILENO);
-
-						// Close the file.
-						close(output_fd);
-
-						out_mode = true;
-
-						// Remove the redirection arguments from the arguments array.
-						free(*(argv + i));
-						*(argv + i) = NULL;
-					}
-
-					else if (strcmp(*(argv + i), ">>") == 0)
-					{
-						if (out_mode)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_OUT_TWICE);
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						else if (*(argv + i + 1) == NULL)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						// Open the file.
-						append_fd = open(*(argv + i + 1), O_WRONLY | O_CREAT | O_APPEND, 0644);
-
-						if (append_fd == -1)
-						{
-							perror("Internal error: System call faliure: open(2)");
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						// Redirect stdout to the file.
-
-						dup2(append_fd, STDOUT_FILENO);
-
-						// Close the file.
-						close(append_fd);
-
-						out_mode = true;
-
-						// Remove the redirection arguments from the arguments array.
-						free(*(argv + i));
-						*(argv + i) = NULL;
-					}
-
-					else if (strcmp(*(argv + i), "2>") == 0)
-					{
-						if (err_mode)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_OUT_TWICE);
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						else if (*(argv + i + 1) == NULL)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						// Open the file.
-						error_fd = open(*(argv + i + 1), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-
-						if (error_fd == -1)
-						{
-							perror("Internal error: System call faliure: open(2)");
-							freeUpMem(&argv);
-							exit(EXIT_FAILURE);
-						}
-
-						// Redirect stderr to the file.
-						dup2(error_fd, STDERR_FILENO);
-
-						// Close the file.
-						close(error_fd);
-
-						err_mode = true;
-
-						// Remove the redirection arguments from the arguments array.
-						free(*(argv + i));
-						*(argv + i) = NULL;
-					}
-				}
-			}
+	if (strcmp(command, SHELL_CMD_REPEATED) == 0)
+	{
+		cmdrepeatLastCommand(ctx);
+		return Internal;
+	}
 
-			// Execute the command.
-			if (execvp(*argv, argv) == -1)
-			{
-				perror("execvp(3)");
-				freeUpMem(&argv);
-				shell_cleanup();
-				exit(EXIT_FAILURE);
-			}
-		}
+	// A function definition reads (and tokenizes) its whole body, nothing runs until the function is called.
+	if (function_is_definition(command))
+	{
+		update_laststatus(ctx, (function_define(ctx, command) == Success) ? 0 : 1);
+		return Internal;
+	}
 
-		// Parent process.
-		else
-		{
-			PCommand cmd = (PCommand)(commandHistory->tail->data);
+	uint64_t parse_start = stats_now();
 
-			if (cmd->background)
-			{
-				waitpid(pid, &status, WNOHANG);
-				fprintf(stdout, "[%d]\n", pid);
+	// Count the number of words (with support for quoted arguments and substitutions).
+	words = count_tokens(command);
 
-				// Update the command history.
-				cmd->status = status >> 8;
+	// Tokenize the command into an array of arguments.
+	*argv = tokenize_command(command, words);
+	char **pargv = *argv;
+	uint64_t expand_start = stats_now();
 
-				// Set the last status variable.
-				update_laststatus(cmd->status);
+	trace_span("parse", parse_start, expand_start, 0, -1, NULL);
 
-				return;
-			}
+	// If the tokenization failed, state an error and exit.
+	if (pargv == NULL)
+	{
+		shell_cleanup(ctx);
+		exit(EXIT_FAILURE);
+	}
 
-			// Wait for the child process to finish.
-			wait(&status);
+	return process_tokens(ctx, command, argv, parse_start);
+}
 
-			int high_8, bit_7;
-			high_8 = status >> 8;
-			bit_7 = status & 0x80;
 
-			// Update the command history.
-			cmd->status = (high_8 == 0 && bit_7 == 0) ? 0 : high_8;
+void run_subshell(PShellContext ctx, const char *command)
+{
+	char buffer[SHELL_MAX_COMMAND_LENGTH + 1] = {0};
+	char **argv = NULL;
 
-			// Set the last status variable.
-			update_laststatus(cmd->status);
-		}
+	// The buffered trace events belong to the parent.
+	trace_discard();
 
-		return;
-	}
+	// The subshell starts outside of any if block of its parent.
+	ctx->if_depth = ctx->if_base = 0;
 
-	// Case 2: Pipes with or without redirection.
-	pipes = (char ***)calloc(num_pipes + 1, sizeof(char **));
+	strncpy(buffer, command, SHELL_MAX_COMMAND_LENGTH);
 
-	if (pipes == NULL)
+	if (parse_command(ctx, buffer, &argv) == External)
 	{
-		perror("Internal error: System call faliure: calloc(3)");
+		execute_command(ctx, argv);
 		freeUpMem(&argv);
-		shell_cleanup();
-		exit(EXIT_FAILURE);
 	}
 
-	// Allocate memory for each pipe.
-	for (int k = 0; k < (num_pipes + 1); ++k)
-	{
-		*(pipes + k) = (char **)calloc(count_args, sizeof(char *));
-
-		if (*(pipes + k) == NULL)
-		{
-			perror("Internal error: System call faliure: calloc(3)");
-
-			for (int k = 0; k < num_pipes + 1; ++k)
-			{
-				if (*(pipes + k) != NULL)
-					free(*(pipes + k));
-			}
-
-			free(pipes);
+	fflush(stdout);
 
-			freeUpMem(&argv);
+	char *last_status = get_variable(ctx->variableList, SHELL_CMD_LAST_STATUS);
+	int status = (last_status != NULL) ? atoi(last_status) : EXIT_FAILURE;
 
-			shell_cleanup();
-			exit(EXIT_FAILURE);
-		}
-	}
+	shell_cleanup(ctx);
+	exit(status);
+}
 
-	// Parse the command into pipes.
-	int arg_pos = 0, pipe_pos = 0;
+/*
+ * @brief Start a chain of pipeline stages.
+ * @param argv The array of arguments of the whole command.
+ * @param stage_start The index in argv where each stage starts.
+ * @param first The first stage of the chain.
+ * @param count The number of stages in the chain.
+ * @param in_fd The standard input of the first stage, or -1 to keep the shell's one.
+ * @param out_fd The standard output of the last stage, or -1 to keep the shell's one.
+ * @param redirects The redirection lists of all stages.
+ * @param subst The process substitutions of the command.
+ * @param stage_pids The array to store the process IDs of the started stages.
+ * @param stage_forked The array to store the time each started stage was forked at.
+ * @param envp The environment of the commands.
+ * @param pgid The process group of the job, 0 until its first process is started (set by the first stage then).
+ * @param foreground True if the job runs in the foreground, so its process group gets the terminal.
+ * @param isolate True if the job gets its own process group even without job control (it runs under a timeout).
+ * @return The number of stages that were started (less than count on failure).
+ * @note Each pipe is created right before the stage that writes into it, so the shell never holds more than
+ * 		 three pipe ends of the chain, and each child only the two it uses.
+ */
+static int start_stages(char **argv, int *stage_start, int first, int count, int in_fd, int out_fd,
+						PRedirectList redirects, PProcSubst subst, pid_t *stage_pids, uint64_t *stage_forked, char **envp,
+						pid_t *pgid, bool foreground, bool isolate)
+{
+	// The read end of the previous stage's pipe, and the current stage's pipe.
+	int prev_read = in_fd, curr_pipe[2] = {-1, -1}, started = 0;
 
-	for (int i = 0; i < count_args; ++i)
+	for (int k = first; k < first + count; ++k)
 	{
-		if (strcmp(*(argv + i), "|") == 0)
-		{
-			++pipe_pos;
-			arg_pos = 0;
-			continue;
-		}
-
-		*(*(pipes + pipe_pos) + arg_pos) = *(argv + i);
-		arg_pos++;
-	}
+		bool last = (k == first + count - 1);
 
-	// Create pipes.
-	int pipe_fds[num_pipes * 2];
+		// Resolve the command through the PATH index, which costs a single non-blocking read while $PATH is unchanged.
+		const char *cmd_path = path_index_lookup(*(argv + *(stage_start + k)));
 
-	for (int k = 0; k < num_pipes; ++k)
-	{
-		if (pipe(pipe_fds + (k * 2)) == -1)
+		// The pipe ends are close-on-exec, only their dup2(2) copies survive the exec.
+		if (!last && pipe2(curr_pipe, O_CLOEXEC) == -1)
 		{
-			perror("Internal error: System call faliure: pipe(2)");
-
-			freeUpMem(&argv);
-
-			for (int k = 0; k < num_pipes + 1; ++k)
-				free(*(pipes + k));
-
-			free(pipes);
-
-			shell_cleanup();
-			exit(EXIT_FAILURE);
+			perror("Internal error: System call faliure: pipe2(2)");
+			break;
 		}
-	}
 
-	// Pipe position offset.
-	int pipe_pos_h = 0;
+		STATS_ADD(pipes, !last);
+		STATS_INC(forks);
 
-	// Start the chain reaction of the pipes.
-	for (int k = 0; k < num_pipes + 1; ++k)
-	{
 		// Fork the process.
-		pid = fork();
+		uint64_t fork_start = stats_now();
+		pid_t pid = fork();
 
 		if (pid == -1)
 		{
 			perror("Internal error: System call faliure: fork(2)");
 
-			freeUpMem(&argv);
-
-			for (int k = 0; k < num_pipes + 1; ++k)
-				free(*(pipes + k));
-
-			free(pipes);
+			if (!last)
+			{
+				close(*curr_pipe);
+				close(*(curr_pipe + 1));
+			}
 
-			exit(EXIT_FAILURE);
+			break;
 		}
 
 		else if (pid == 0)
 		{
-			char **curr_pipe = *(pipes + k);
+			char **stage_argv = argv + *(stage_start + k);
 
-			// Redirect in pipes handles.
-			bool in_mode = false, out_mode = false, err_mode = false;
-			int input_fd = STDIN_FILENO, output_fd = STDOUT_FILENO, append_fd = STDOUT_FILENO, error_fd = STDERR_FILENO;
+			// Join the job's process group, and reset the signals to their defaults.
+			job_child_init(*pgid, foreground, isolate);
 
-			// Reset SIGINT to default.
-			signal(SIGINT, SIG_DFL);
-
-			// If not last pipe, redirect stdout to the next pipe.
-			if (k < num_pipes)
-				dup2(pipe_fds[pipe_pos_h + 1], STDOUT_FILENO);
+			// Make sure no other descriptor of the shell leaks into the command, with a single system call.
+			close_range(STDERR_FILENO + 1, ~0U, CLOSE_RANGE_CLOEXEC);
 
 			// If not first pipe, redirect stdin to the previous pipe.
-			if (pipe_pos_h != 0)
-				dup2(pipe_fds[pipe_pos_h - 2], STDIN_FILENO);
-
-			// Close all unnecessary pipe handles.
-			for (int j = 0; j < num_pipes * 2; ++j)
-				close(pipe_fds[j]);
+			if (prev_read != -1)
+				dup2(prev_read, STDIN_FILENO);
 
-			// Handle redirects
-			if (redirect)
+			// If not last pipe, redirect stdout to the next pipe. Its read end belongs to the next stage.
+			if (!last)
 			{
-				int count_args_in_pipe = 0;
-
-				// Count the number of arguments in the current command.
-				for (size_t k = 0; *(curr_pipe + count_args_in_pipe) != NULL; ++k)
-					++count_args_in_pipe;
-
-				// Allow only input redirection for the first command.
-				if (k == 0)
-				{
-					for (int i = 0; i < count_args_in_pipe; ++i)
-					{
-						if (strcmp(*(curr_pipe + i), "<") == 0)
-						{
-							if (in_mode)
-							{
-								fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_IN_TWICE);
-
-								freeUpMem(&argv);
-
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
-
-								free(pipes);
-
-								exit(EXIT_FAILURE);
-							}
-
-							else if (*(curr_pipe + i + 1) == NULL)
-							{
-								fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
+				dup2(*(curr_pipe + 1), STDOUT_FILENO);
+				close(*curr_pipe);
+			}
 
-								freeUpMem(&argv);
+			else if (out_fd != -1)
+				dup2(out_fd, STDOUT_FILENO);
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+			// Redirections are applied on top of the pipe ends, so they can override them.
+			if (apply_redirects(redirects + k) == Failure)
+				exit(EXIT_FAILURE);
 
-								free(pipes);
+			inherit_process_substitutions(subst, k);
 
-								exit(EXIT_FAILURE);
-							}
+			// Terminate the stage's arguments at the next "|".
+			if (*(argv + *(stage_start + k + 1) - 1) != NULL)
+				*(argv + *(stage_start + k + 1) - 1) = NULL;
 
-							// Open the file.
-							input_fd = open(*(curr_pipe + i + 1), O_RDONLY);
+			// A utility command runs in the child itself, there is nothing to exec.
+			if (is_utility(*stage_argv))
+			{
+				int utility_status = cmdUtility(stage_argv);
 
-							if (input_fd == -1)
-							{
-								perror("Internal error: System call faliure: open(2)");
+				fflush(stdout);
+				_exit(utility_status);
+			}
 
-								freeUpMem(&argv);
+			// Execute the command, the PATH search is the fallback if the index is out of date.
+			if (cmd_path != NULL)
+				execve(cmd_path, stage_argv, envp);
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+			execvpe(*stage_argv, stage_argv, envp);
 
-								free(pipes);
+			perror("execvpe(3)");
+			exit(SHELL_EXIT_EXEC_FAILURE);
+		}
 
-								exit(EXIT_FAILURE);
-							}
+		*pgid = job_add_process(pid, *pgid, foreground, isolate);
 
-							// Redirect stdin to the file.
-							dup2(input_fd, STDIN_FILENO);
+		// A utility stage runs in the forked child, it's counted as a fork only.
+		if (!is_utility(*(argv + *(stage_start + k))))
+			STATS_INC(execs);
+		*(stage_forked + started) = stats_now();
+		*(stage_pids + started++) = pid;
+		trace_span("fork", fork_start, *(stage_forked + started - 1), 0, k, *(argv + *(stage_start + k)));
 
-							// Close the file.
-							close(input_fd);
+		// The shell only keeps the read end of the current pipe, for the next stage.
+		if (prev_read != -1 && prev_read != in_fd)
+			close(prev_read);
 
-							in_mode = true;
+		if (!last)
+		{
+			close(*(curr_pipe + 1));
+			prev_read = *curr_pipe;
+		}
+	}
 
-							// Remove the redirection arguments from the arguments array.
-							free(*(curr_pipe + i));
-							*(*(pipes + k) + i) = NULL;
-						}
+	// Close the last pipe handle (only left open if we failed in the middle).
+	if (started < count && prev_read != -1 && prev_read != in_fd)
+		close(prev_read);
 
-						else if (strcmp(*(curr_pipe + i), ">") == 0 ||
-								 strcmp(*(curr_pipe + i), ">>") == 0 ||
-								 strcmp(*(curr_pipe + i), "2>") == 0)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_OUT_IN_FIRST_PIPE);
+	return started;
+}
 
-							freeUpMem(&argv);
+/*
+ * @brief Run a command line as a pipeline, and update its history entry.
+ * @param ctx The shell context.
+ * @param cmd The command's history entry.
+ * @param argv The array of arguments of the whole command.
+ * @return True if the job was left running in the background, False once it ended (or failed to start).
+ */
+static bool run_pipeline(PShellContext ctx, PCommand cmd, char **argv)
+{
+	pid_t relay_pid = -1, pgid = 0;
+	int status = 0, num_pipes = 0, num_fanouts = 0;
+	bool redirect = false, procsubst = false, in_test = false, isolate = (cmd->timeout_ns > 0);
+	ProcSubst subst = {0};
+	uint64_t exec_start = stats_now();
+
+	// Count the number of pipes and check if there are any redirections or process substitutions.
+	// The "<" and ">" of a "[[ ... ]]" test are comparisons.
+	for (int i = 0; *(argv + i) != NULL; ++i)
+	{
+		if ((in_test = in_test_expression(*(argv + i), in_test)))
+			continue;
 
-							for (int k = 0; k < num_pipes + 1; ++k)
-								free(*(pipes + k));
+		else if (is_pipe_separator(*(argv + i)))
+		{
+			++num_pipes;
+			num_fanouts += (strcmp(*(argv + i), "|>") == 0);
+		}
 
-							free(pipes);
+		else if (is_redirect(*(argv + i)))
+			redirect = true;
 
-							exit(EXIT_FAILURE);
-						}
-					}
-				}
+		else if (is_process_substitution(*(argv + i)))
+			procsubst = true;
+	}
 
-				// Allow only output redirection for the last command.
-				else if (k == num_pipes)
-				{
-					for (int i = 0; i < count_args_in_pipe; ++i)
-					{
-						if (strcmp(*(curr_pipe + i), "<") == 0)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_IN_IN_LAST_PIPE);
+	const int num_stages = num_pipes + 1;
 
-							freeUpMem(&argv);
+	// Redirections are resolved once by the parent: files are opened and here-documents are read before anything is forked.
+	RedirectList redirects[num_stages];
+	memset(redirects, 0, sizeof(redirects));
 
-							for (int k = 0; k < num_pipes + 1; ++k)
-								free(*(pipes + k));
+	if (redirect && resolve_redirects(argv, redirects, num_stages, ctx->variableList) == Failure)
+	{
+		cmd->status = 1;
+		update_laststatus(ctx, cmd->status);
+		return false;
+	}
 
-							free(pipes);
+	// Find where each stage starts (the separators are replaced with NULL by each child for its own stage),
+	// and where each fan-out segment (the producer, then each consumer) starts.
+	int stage_start[num_stages + 1], segment_start[num_fanouts + 2];
+	*stage_start = 0;
+	*segment_start = 0;
 
-							exit(EXIT_FAILURE);
-						}
+	for (int i = 0, k = 1, j = 1; *(argv + i) != NULL; ++i)
+	{
+		if (is_pipe_separator(*(argv + i)))
+		{
+			if (strcmp(*(argv + i), "|>") == 0)
+				*(segment_start + j++) = k;
 
-						else if (strcmp(*(curr_pipe + i), ">") == 0)
-						{
-							if (out_mode)
-							{
-								fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_OUT_TWICE);
+			*(stage_start + k++) = i + 1;
+		}
 
-								freeUpMem(&argv);
+		*(stage_start + num_stages) = i + 2;
+	}
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+	*(segment_start + num_fanouts + 1) = num_stages;
 
-								free(pipes);
+	for (int k = 0; k < num_stages; ++k)
+	{
+		char *first = *(argv + *(stage_start + k));
 
-								exit(EXIT_FAILURE);
-							}
+		// A command made only of redirections (e.g. "> file") just creates its files.
+		if (first == NULL && num_stages == 1)
+		{
+			close_redirects(redirects, num_stages);
+			cmd->status = 0;
+			update_laststatus(ctx, cmd->status);
+			return false;
+		}
 
-							else if (*(curr_pipe + i + 1) == NULL)
-							{
-								fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
+		else if (first == NULL || is_pipe_separator(first))
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_PIPE_EMPTY_STAGE);
+			close_redirects(redirects, num_stages);
+			cmd->status = 1;
+			update_laststatus(ctx, cmd->status);
+			return false;
+		}
+	}
 
-								freeUpMem(&argv);
+	// A redirected utility command runs in the shell itself, on top of the redirected standard descriptors.
+	if (num_stages == 1 && !procsubst && !cmd->background && !isolate && is_utility(*argv) && redirects_in_shell_supported(redirects))
+	{
+		int saved[3];
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+		cmd->isInternal = true;
+		cmd->status = 1;
 
-								free(pipes);
+		if (apply_redirects_in_shell(redirects, saved) == Success)
+		{
+			cmd->status = cmdUtility(argv);
+			restore_redirects_in_shell(redirects, saved);
+		}
 
-								exit(EXIT_FAILURE);
-							}
+		close_redirects(redirects, num_stages);
+		update_laststatus(ctx, cmd->status);
 
-							// Open the file.
-							output_fd = open(*(curr_pipe + i + 1), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		uint64_t elapsed = stats_now() - exec_start;
 
-							if (output_fd == -1)
-							{
-								perror("Internal error: System call faliure: open(2)");
+		STATS_ADD(builtin_ns, elapsed);
+		stats_record_latency(*argv, elapsed);
+		trace_span("builtin", exec_start, exec_start + elapsed, 0, -1, *argv);
+		return false;
+	}
 
-								freeUpMem(&argv);
+	// Start the process substitutions, they run concurrently with the command itself.
+	if (procsubst && start_process_substitutions(ctx, argv, &subst, &pgid, !cmd->background, isolate) == Failure)
+	{
+		close_redirects(redirects, num_stages);
+		cmd->status = 1;
+		update_laststatus(ctx, cmd->status);
+		return false;
+	}
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+	// Anything buffered by the shell must not be written twice by the children.
+	fflush(stdout);
+	fflush(stderr);
 
-								free(pipes);
+	// The producer writes into the relay pipe, and the relay feeds one pipe per consumer.
+	int relay_in[2] = {-1, -1}, relay_out[num_fanouts * 2 + 1];
 
-								exit(EXIT_FAILURE);
-							}
+	if (num_fanouts > 0)
+	{
+		bool failed = (pipe2(relay_in, O_CLOEXEC) == -1);
 
-							// Redirect stdout to the file.
-							dup2(output_fd, STDOUT_FILENO);
+		for (int k = 0; k < num_fanouts; ++k)
+		{
+			*(relay_out + k * 2) = *(relay_out + k * 2 + 1) = -1;
 
-							// Close the file.
-							close(output_fd);
+			if (!failed && pipe2(relay_out + k * 2, O_CLOEXEC) == -1)
+				failed = true;
+		}
 
-							out_mode = true;
+		if (!failed)
+		{
+			STATS_ADD(pipes, num_fanouts + 1);
+			STATS_INC(forks);
+		}
 
-							// Remove the redirection arguments from the arguments array.
-							free(*(curr_pipe + i));
-							*(curr_pipe + i) = NULL;
-						}
+		uint64_t fork_start = stats_now();
 
-						else if (strcmp(*(curr_pipe + i), ">>") == 0)
-						{
-							if (out_mode)
-							{
-								fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_OUT_TWICE);
+		if (!failed && (relay_pid = fork()) == 0)
+		{
+			int out_fds[num_fanouts];
 
-								freeUpMem(&argv);
+			// The relay leads the job's process group, unless a process substitution already does.
+			job_child_init(pgid, !cmd->background, isolate);
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+			// The relay only keeps the producer's read end and the consumers' write ends.
+			close(*(relay_in + 1));
+			close_redirects(redirects, num_stages);
+			close_process_substitutions(&subst);
 
-								free(pipes);
+			for (int k = 0; k < num_fanouts; ++k)
+			{
+				close(*(relay_out + k * 2));
+				*(out_fds + k) = *(relay_out + k * 2 + 1);
+			}
 
-								exit(EXIT_FAILURE);
-							}
+			run_fanout_relay(*relay_in, out_fds, num_fanouts);
+		}
 
-							else if (*(curr_pipe + i + 1) == NULL)
-							{
-								fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
+		if (failed || relay_pid == -1)
+		{
+			perror("Internal error: System call faliure: pipe2(2)/fork(2)");
 
-								freeUpMem(&argv);
+			for (int k = 0; k < num_fanouts * 2; ++k)
+			{
+				if (*(relay_out + k) != -1)
+					close(*(relay_out + k));
+			}
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+			if (*relay_in != -1)
+			{
+				close(*relay_in);
+				close(*(relay_in + 1));
+			}
 
-								free(pipes);
+			close_redirects(redirects, num_stages);
+			close_process_substitutions(&subst);
+			reap_process_substitutions(&subst, true);
+			cmd->status = 1;
+			update_laststatus(ctx, cmd->status);
+			return false;
+		}
 
-								exit(EXIT_FAILURE);
-							}
+		trace_span("fork", fork_start, stats_now(), 0, -1, "|> relay");
+		pgid = job_add_process(relay_pid, pgid, !cmd->background, isolate);
 
-							// Open the file.
-							append_fd = open(*(curr_pipe + i + 1), O_WRONLY | O_CREAT | O_APPEND, 0644);
+		// The relay owns its ends now.
+		close(*relay_in);
 
-							if (append_fd == -1)
-							{
-								perror("Internal error: System call faliure: open(2)");
+		for (int k = 0; k < num_fanouts; ++k)
+			close(*(relay_out + k * 2 + 1));
+	}
 
-								freeUpMem(&argv);
+	// The environment is cached, it's only rebuilt after an exported variable changed.
+	char **envp = env_get(ctx);
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+	// The process IDs of the pipeline stages.
+	pid_t stage_pids[num_stages];
+	uint64_t stage_forked[num_stages];
+	int started = 0;
 
-								free(pipes);
+	// Start the producer, then each consumer, as a chain of stages.
+	for (int j = 0; j < num_fanouts + 1; ++j)
+	{
+		int first = *(segment_start + j), count = *(segment_start + j + 1) - first;
+		int in_fd = (j > 0) ? *(relay_out + (j - 1) * 2) : -1;
+		int out_fd = (j == 0 && num_fanouts > 0) ? *(relay_in + 1) : -1;
+		int chain_started = start_stages(argv, stage_start, first, count, in_fd, out_fd, redirects, &subst, stage_pids + started, stage_forked + started, envp, &pgid, !cmd->background, isolate);
 
-								exit(EXIT_FAILURE);
-							}
+		started += chain_started;
 
-							// Redirect stdout to the file.
-							dup2(append_fd, STDOUT_FILENO);
+		if (in_fd != -1)
+			close(in_fd);
 
-							// Close the file.
-							close(append_fd);
+		if (out_fd != -1)
+			close(out_fd);
 
-							out_mode = true;
+		if (chain_started < count)
+		{
+			// Close the ends of the consumers that will never start.
+			for (int k = j; k < num_fanouts; ++k)
+				close(*(relay_out + k * 2));
 
-							// Remove the redirection arguments from the arguments array.
-							free(*(curr_pipe + i));
-							*(curr_pipe + i) = NULL;
-						}
+			break;
+		}
+	}
 
-						else if (strcmp(*(curr_pipe + i), "2>") == 0)
-						{
-							if (err_mode)
-							{
-								fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_OUT_TWICE);
+	// Close all the redirection and process substitution handles, the children have their own copies.
+	close_redirects(redirects, num_stages);
+	close_process_substitutions(&subst);
 
-								freeUpMem(&argv);
+	// Failed in the middle, the stages that already started see EOF/EPIPE and finish.
+	if (started < num_stages)
+	{
+		for (int i = 0; i < started; ++i)
+			waitpid(*(stage_pids + i), NULL, 0);
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+		if (relay_pid != -1)
+			waitpid(relay_pid, NULL, 0);
 
-								free(pipes);
+		job_foreground_done();
+		reap_process_substitutions(&subst, true);
+		cmd->status = 1;
+		update_laststatus(ctx, cmd->status);
+		return false;
+	}
 
-								exit(EXIT_FAILURE);
-							}
+	pid_t pid = *(stage_pids + num_stages - 1);
 
-							else if (*(curr_pipe + i + 1) == NULL)
-							{
-								fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
+	// Keep the process IDs in the history entry (it's reused when a benchmark runs the same entry again).
+	free(cmd->pids);
+	cmd->num_pids = 0;
 
-								freeUpMem(&argv);
+	if ((cmd->pids = (pid_t *)malloc(num_stages * sizeof(pid_t))) != NULL)
+	{
+		memcpy(cmd->pids, stage_pids, num_stages * sizeof(pid_t));
+		cmd->num_pids = num_stages;
+		STATS_INC(allocations);
+	}
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+	// If the command is a background command, print the process ID and return, don't wait for the child process to finish.
+	if (cmd->background)
+	{
+		// The deadline of a background job is kept by a watcher process, the shell doesn't wait for the job.
+		// The watcher is forked twice, so the shell reaps its first child right away and the watcher itself is reaped by init.
+		if (isolate)
+		{
+			pid_t watcher_pid = fork();
 
-								free(pipes);
+			STATS_INC(forks);
 
-								exit(EXIT_FAILURE);
-							}
+			if (watcher_pid == -1)
+				perror("Internal error: System call faliure: fork(2)");
 
-							// Open the file.
-							error_fd = open(*(curr_pipe + i + 1), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			else if (watcher_pid == 0)
+			{
+				job_reset_signals();
 
-							if (error_fd == -1)
-							{
-								perror("Internal error: System call faliure: open(2)");
+				if ((watcher_pid = fork()) == -1)
+					perror("Internal error: System call faliure: fork(2)");
 
-								freeUpMem(&argv);
+				if (watcher_pid != 0)
+					_exit(EXIT_SUCCESS);
 
-								for (int k = 0; k < num_pipes + 1; ++k)
-									free(*(pipes + k));
+				// The watcher holds none of the shell's descriptors, so it never keeps a pipe open (e.g. of "$(...)").
+				int null_fd = open("/dev/null", O_RDWR);
 
-								free(pipes);
+				for (int fd = STDIN_FILENO; null_fd != -1 && fd <= STDERR_FILENO; ++fd)
+					dup2(null_fd, fd);
 
-								exit(EXIT_FAILURE);
-							}
+				close_range(STDERR_FILENO + 1, ~0U, 0);
 
-							// Redirect stderr to the file.
-							dup2(error_fd, STDERR_FILENO);
+				job_wait_deadline(stage_pids, num_stages, pgid, cmd->timeout_ns, cmd->kill_after_ns);
+				_exit(EXIT_SUCCESS);
+			}
 
-							// Close the file.
-							close(error_fd);
+			else
+				waitpid(watcher_pid, NULL, 0);
+		}
 
-							err_mode = true;
+		reap_process_substitutions(&subst, false);
+		waitpid(pid, &status, WNOHANG);
+		fprintf(stdout, "[%d]\n", pid);
 
-							// Remove the redirection arguments from the arguments array.
-							free(*(curr_pipe + i));
-							*(curr_pipe + i) = NULL;
-						}
-					}
-				}
+		// Update the command history.
+		cmd->status = status >> 8;
 
-				// Don't allow any redirections for the middle commands.
-				else
-				{
-					for (int i = 0; i < count_args_in_pipe; ++i)
-					{
-						if (strcmp(*(curr_pipe + i), "<") == 0 ||
-							strcmp(*(curr_pipe + i), ">") == 0 ||
-							strcmp(*(curr_pipe + i), ">>") == 0 ||
-							strcmp(*(curr_pipe + i), "2>") == 0)
-						{
-							fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_BETWEEN_PIPES);
+		// Set the last status variable.
+		update_laststatus(ctx, cmd->status);
 
-							freeUpMem(&argv);
+		return true;
+	}
 
-							for (int k = 0; k < num_pipes + 1; ++k)
-								free(*(pipes + k));
+	uint64_t wait_start = stats_now();
 
-							free(pipes);
+	// A job under a timeout is waited for through its pidfds until it exits or is terminated, then reaped as usual.
+	bool timed_out = isolate && job_wait_deadline(stage_pids, num_stages, pgid, cmd->timeout_ns, cmd->kill_after_ns);
 
-							exit(EXIT_FAILURE);
-						}
-					}
-				}
-			}
+	// Wait for all the pipeline stages to finish, the status is the one of the last stage.
+	// Each stage is recorded in the latency histograms with the time from the start of the pipeline until it was reaped.
+	for (int i = 0; i < num_stages; ++i)
+	{
+		job_wait(*(stage_pids + i), &status);
 
-			// Execute the command.
-			if (execvp(*curr_pipe, curr_pipe) == -1)
-			{
-				perror("execvp(3)");
+		// The whole job was stopped (Ctrl-Z), the shell takes the terminal back and keeps the job, so fg or bg can resume it.
+		// Its processes that weren't reaped yet are the process substitutions, the fan-out relay, this stage and the
+		// ones after it.
+		if (WIFSTOPPED(status))
+		{
+			pid_t pending[subst.count + num_stages + 1];
+			int num_pending = 0;
 
-				freeUpMem(&argv);
+			for (int k = 0; k < subst.count; ++k)
+				*(pending + num_pending++) = *(subst.pids + k);
 
-				for (int k = 0; k < num_pipes + 1; ++k)
-					free(*(pipes + k));
+			if (relay_pid != -1)
+				*(pending + num_pending++) = relay_pid;
 
-				free(pipes);
+			for (int k = i; k < num_stages; ++k)
+				*(pending + num_pending++) = *(stage_pids + k);
 
-				exit(EXIT_FAILURE);
-			}
+			job_foreground_done();
+			reap_process_substitutions(&subst, false);
+			job_stop(pgid, pending, num_pending, cmd->command);
+			cmd->status = 128 + WSTOPSIG(status);
+			update_laststatus(ctx, cmd->status);
+			return false;
 		}
 
-		pipe_pos_h += 2;
-	}
+		uint64_t reaped = stats_now();
 
-	// Close all pipe handles.
-	for (int i = 0; i < num_pipes * 2; ++i)
-		close(pipe_fds[i]);
+		if (WIFEXITED(status) && WEXITSTATUS(status) == SHELL_EXIT_EXEC_FAILURE)
+			STATS_INC(exec_failures);
 
-	PCommand cmd = (PCommand)(commandHistory->tail->data);
+		stats_record_latency(*(argv + *(stage_start + i)), reaped - exec_start);
+		trace_span("exec", *(stage_forked + i), reaped, *(stage_pids + i), i, *(argv + *(stage_start + i)));
+	}
 
-	// If the command is a background command, print the process ID and return, don't wait for the child process to finish.
-	if (cmd->background)
-	{
-		waitpid(pid, &status, WNOHANG);
-		fprintf(stdout, "[%d]\n", pid);
+	// Reap the fan-out relay and the process substitutions along with the pipeline.
+	if (relay_pid != -1)
+		job_wait(relay_pid, NULL);
 
-		// Update the command history.
-		cmd->status = status >> 8;
+	job_foreground_done();
+	reap_process_substitutions(&subst, true);
 
-		// Set the last status variable.
-		update_laststatus(cmd->status);
+	uint64_t wait_end = stats_now();
 
-		return;
-	}
+	STATS_ADD(wait_ns, wait_end - wait_start);
+	trace_span("wait", wait_start, wait_end, 0, -1, NULL);
 
-	// Wait for all child processes to finish.
-	for (int i = 0; i < num_pipes + 1; ++i)
-		wait(&status);
+	// Update the command history. A job killed by a signal has the status 128 plus the signal's number.
+	cmd->status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+	cmd->timed_out = timed_out;
 
-	int high_8, bit_7;
-	high_8 = status >> 8;
-	bit_7 = status & 0x80;
+	// A job that was terminated by its timeout has a status of its own, whatever signal ended it.
+	if (timed_out)
+		cmd->status = SHELL_EXIT_TIMEOUT;
 
-	// Update the command history.
-	cmd->status = (high_8 == 0 && bit_7 == 0) ? 0 : high_8;
+	// The terminal echoed "^C" without a newline.
+	else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGINT && job_control_enabled())
+		fputc('\n', stdout);
 
 	// Set the last status variable.
-	update_laststatus(cmd->status);
+	update_laststatus(ctx, cmd->status);
 
-	for (int k = 0; k < num_pipes + 1; ++k)
-		free(*(pipes + k));
+	return false;
+}
+
+void execute_command(PShellContext ctx, char **argv)
+{
+	PCommand cmd = (PCommand)(ctx->commandHistory->tail->data);
 
-	free(pipes);
-}
\ No newline at end of file
+	// A background command is still running, so its end is unknown.
+	if (!run_pipeline(ctx, cmd, argv))
+		cmd->end_ns = stats_now();
+}
@@ -0,0 +1,219 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Aliases Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_alias.h"
+#include "../include/shell_utils.h"
+#include "../include/shell_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief Free an alias.
+ * @param alias The alias.
+ */
+static void destroy_alias(PAlias alias)
+{
+	free(alias->name);
+	free(alias->value);
+	freeUpMem(&alias->tokens);
+	free(alias);
+}
+
+PAlias alias_lookup(PShellContext ctx, const char *name)
+{
+	return (PAlias)name_table_lookup(ctx->aliases, name);
+}
+
+Result alias_set(PShellContext ctx, const char *name, const char *value)
+{
+	char **tokens = NULL;
+	int num_tokens = count_tokens(value);
+
+	// The value is tokenized once, expanding the alias only copies its tokens.
+	if (num_tokens > 0 && (tokens = tokenize_command(value, num_tokens)) == NULL)
+		return Failure;
+
+	// The tokenizer drops a trailing "&", so count what is actually there.
+	for (num_tokens = 0; tokens != NULL && *(tokens + num_tokens) != NULL; ++num_tokens)
+		;
+
+	char *value_copy = strdup(value);
+
+	if (value_copy == NULL)
+	{
+		perror("Internal error: System call faliure: strdup(3)");
+		freeUpMem(&tokens);
+		return Failure;
+	}
+
+	PAlias alias = alias_lookup(ctx, name);
+
+	if (alias != NULL)
+	{
+		free(alias->value);
+		freeUpMem(&alias->tokens);
+		alias->value = value_copy;
+		alias->tokens = tokens;
+		alias->num_tokens = num_tokens;
+		return Success;
+	}
+
+	if (ctx->aliases == NULL && (ctx->aliases = (PNameTable)calloc(1, sizeof(NameTable))) == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)");
+		free(value_copy);
+		freeUpMem(&tokens);
+		return Failure;
+	}
+
+	if ((alias = (PAlias)calloc(1, sizeof(Alias))) == NULL || (alias->name = strdup(name)) == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)/strdup(3)");
+		free(alias);
+		free(value_copy);
+		freeUpMem(&tokens);
+		return Failure;
+	}
+
+	alias->value = value_copy;
+	alias->tokens = tokens;
+	alias->num_tokens = num_tokens;
+
+	if (name_table_insert(ctx->aliases, alias) == Failure)
+	{
+		destroy_alias(alias);
+		return Failure;
+	}
+
+	return Success;
+}
+
+Result alias_unset(PShellContext ctx, const char *name)
+{
+	PAlias alias = (PAlias)name_table_remove(ctx->aliases, name);
+
+	if (alias == NULL)
+		return Failure;
+
+	destroy_alias(alias);
+
+	return Success;
+}
+
+/*
+ * @brief Compare two aliases by name.
+ */
+static int compare_name(const void *a, const void *b)
+{
+	return strcmp((*(const PAlias *)a)->name, (*(const PAlias *)b)->name);
+}
+
+Result alias_print(PShellContext ctx, FILE *out, const char *name)
+{
+	if (name != NULL)
+	{
+		PAlias alias = alias_lookup(ctx, name);
+
+		if (alias == NULL)
+			return Failure;
+
+		fprintf(out, "alias %s=\"%s\"\n", alias->name, alias->value);
+		return Success;
+	}
+
+	if (ctx->aliases == NULL || ctx->aliases->count == 0)
+		return Success;
+
+	PAlias sorted[ctx->aliases->count];
+	size_t n = 0;
+
+	for (size_t i = 0; i < ctx->aliases->capacity; ++i)
+	{
+		if (*(ctx->aliases->slots + i) != NULL)
+			*(sorted + n++) = (PAlias)*(ctx->aliases->slots + i);
+	}
+
+	qsort(sorted, n, sizeof(PAlias), compare_name);
+
+	for (size_t i = 0; i < n; ++i)
+		fprintf(out, "alias %s=\"%s\"\n", (*(sorted + i))->name, (*(sorted + i))->value);
+
+	return Success;
+}
+
+/*
+ * @brief Expand the aliases of a single command word, until it's not an alias (or an alias that is being expanded).
+ * @param ctx The shell context.
+ * @param argv A pointer to the array of arguments.
+ * @param index The index of the command word.
+ */
+static void expand_word(PShellContext ctx, char ***argv, int index)
+{
+	PAlias used = NULL, alias = NULL;
+
+	while (*(*argv + index) != NULL && (alias = alias_lookup(ctx, *(*argv + index))) != NULL && !alias->in_use)
+	{
+		if (!splice_words(argv, index, alias->tokens, alias->num_tokens))
+			break;
+
+		alias->in_use = true;
+		alias->next_used = used;
+		used = alias;
+	}
+
+	for (; used != NULL; used = used->next_used)
+		used->in_use = false;
+}
+
+void alias_expand(PShellContext ctx, char ***argv)
+{
+	// Nothing to do (and no lookup to pay for) until the first alias is defined.
+	if (ctx->aliases == NULL || ctx->aliases->count == 0)
+		return;
+
+	bool command_word = true;
+
+	for (int i = 0; *(*argv + i) != NULL; ++i)
+	{
+		if (command_word)
+			expand_word(ctx, argv, i);
+
+		// An alias may expand to nothing.
+		if (*(*argv + i) == NULL)
+			break;
+
+		command_word = is_pipe_separator(*(*argv + i)) || strcmp(*(*argv + i), "if") == 0;
+	}
+}
+
+void alias_free(PShellContext ctx)
+{
+	if (ctx->aliases == NULL)
+		return;
+
+	for (size_t i = 0; i < ctx->aliases->capacity; ++i)
+	{
+		if (*(ctx->aliases->slots + i) != NULL)
+			destroy_alias((PAlias)*(ctx->aliases->slots + i));
+	}
+
+	name_table_free(ctx->aliases);
+	free(ctx->aliases);
+	ctx->aliases = NULL;
+}
@@ -0,0 +1,802 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Arithmetic Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_arith.h"
+#include "../include/shell_function.h"
+#include "../include/shell_internal_cmds.h"
+#include "../include/shell_utils.h"
+#include "../include/shell_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+/*
+ * @brief A binary operator.
+ * @param token The text of the operator.
+ * @param prec The precedence of the operator, higher binds tighter.
+ * @param type The instruction of the operator.
+ */
+typedef struct ArithBinary {
+	const char *token;
+	int prec;
+	ArithOpType type;
+} ArithBinary;
+
+// The binary operators, the longer tokens first, so "<<" isn't read as "<".
+static const ArithBinary binary_ops[] = {
+	{"||", 1, ARITH_OP_OR_JUMP},
+	{"&&", 2, ARITH_OP_AND_JUMP},
+	{"==", 6, ARITH_OP_EQ},
+	{"!=", 6, ARITH_OP_NE},
+	{"<=", 7, ARITH_OP_LE},
+	{">=", 7, ARITH_OP_GE},
+	{"<<", 8, ARITH_OP_SHL},
+	{">>", 8, ARITH_OP_SHR},
+	{"|", 3, ARITH_OP_BOR},
+	{"^", 4, ARITH_OP_BXOR},
+	{"&", 5, ARITH_OP_BAND},
+	{"<", 7, ARITH_OP_LT},
+	{">", 7, ARITH_OP_GT},
+	{"+", 9, ARITH_OP_ADD},
+	{"-", 9, ARITH_OP_SUB},
+	{"*", 10, ARITH_OP_MUL},
+	{"/", 10, ARITH_OP_DIV},
+	{"%", 10, ARITH_OP_MOD}
+};
+
+// The assignment operators and the operator each one applies, ARITH_OP_NUM for a plain assignment.
+static const ArithBinary assign_ops[] = {
+	{"<<=", 0, ARITH_OP_SHL},
+	{">>=", 0, ARITH_OP_SHR},
+	{"*=", 0, ARITH_OP_MUL},
+	{"/=", 0, ARITH_OP_DIV},
+	{"%=", 0, ARITH_OP_MOD},
+	{"+=", 0, ARITH_OP_ADD},
+	{"-=", 0, ARITH_OP_SUB},
+	{"&=", 0, ARITH_OP_BAND},
+	{"^=", 0, ARITH_OP_BXOR},
+	{"|=", 0, ARITH_OP_BOR},
+	{"=", 0, ARITH_OP_NUM}
+};
+
+/*
+ * @brief The state of the compilation of an expression.
+ * @param pos The next character to parse.
+ * @param program The compiled expression.
+ * @param ops_cap The size of the instructions array.
+ * @param depth The depth of the evaluation stack after the instructions emitted so far.
+ * @param nesting The nesting of the parser, bounded so a hostile expression can't overflow the C stack.
+ * @param failed True on a syntax error (or an allocation failure).
+ */
+typedef struct ArithCompiler {
+	const char *pos;
+	PArithProgram program;
+	int ops_cap;
+	int depth;
+	int nesting;
+	bool failed;
+} ArithCompiler, *PArithCompiler;
+
+static void compile_assignment(PArithCompiler c);
+
+/*
+ * @brief Skip the spaces before the next token.
+ */
+static void skip_spaces(PArithCompiler c)
+{
+	while (isspace((unsigned char)*c->pos))
+		++c->pos;
+}
+
+/*
+ * @brief Emit an instruction, and track the depth of the evaluation stack.
+ * @param c The compiler.
+ * @param type The type of the instruction.
+ * @param value The number, or the jump target, of the instruction.
+ * @return The index of the instruction (to patch a jump target), or -1 on failure.
+ */
+static int emit(PArithCompiler c, ArithOpType type, long long value)
+{
+	PArithProgram program = c->program;
+
+	if (c->failed)
+		return -1;
+
+	if (program->num_ops == c->ops_cap)
+	{
+		int cap = (c->ops_cap == 0) ? 16 : c->ops_cap * 2;
+		PArithOp tmp = (PArithOp)realloc(program->ops, cap * sizeof(ArithOp));
+
+		if (tmp == NULL)
+		{
+			c->failed = true;
+			return -1;
+		}
+
+		program->ops = tmp;
+		c->ops_cap = cap;
+	}
+
+	if (type == ARITH_OP_NUM || type == ARITH_OP_VAR)
+		++c->depth;
+
+	else if (type >= ARITH_OP_MUL && type <= ARITH_OP_BOR)
+		--c->depth;
+
+	else if (type == ARITH_OP_AND_JUMP || type == ARITH_OP_OR_JUMP || type == ARITH_OP_JUMP_ZERO)
+		--c->depth;
+
+	if (c->depth > ARITH_MAX_STACK)
+		c->failed = true;
+
+	PArithOp op = program->ops + program->num_ops;
+
+	op->type = (uint8_t)type;
+	op->op = ARITH_OP_NUM;
+	op->var = 0;
+	op->value = value;
+
+	return program->num_ops++;
+}
+
+/*
+ * @brief Find a variable of the expression, or add it.
+ * @param c The compiler.
+ * @param name The name of the variable.
+ * @param len The length of the name.
+ * @return The index of the variable, or -1 on failure.
+ */
+static int find_var(PArithCompiler c, const char *name, size_t len)
+{
+	PArithProgram program = c->program;
+
+	for (int i = 0; i < program->num_vars; ++i)
+	{
+		if (strncmp(*(program->vars + i), name, len) == 0 && *(*(program->vars + i) + len) == '\0')
+			return i;
+	}
+
+	char **tmp = (char **)realloc(program->vars, (program->num_vars + 1) * sizeof(char *));
+
+	if (program->num_vars == UINT16_MAX || tmp == NULL)
+	{
+		c->failed = true;
+		return -1;
+	}
+
+	program->vars = tmp;
+
+	if ((*(program->vars + program->num_vars) = strndup(name, len)) == NULL)
+	{
+		c->failed = true;
+		return -1;
+	}
+
+	return program->num_vars++;
+}
+
+/*
+ * @brief Read a variable name ("name", "$name", or "$?", "$#" and "$N" with a "$").
+ * @param c The compiler.
+ * @param len Where to store the length of the name.
+ * @return The name (not terminated), or NULL if there is no name at the current position.
+ */
+static const char *read_name(PArithCompiler c, size_t *len)
+{
+	const char *name = c->pos + (*c->pos == '$');
+
+	*len = 0;
+
+	if (*c->pos == '$' && (*name == '?' || *name == '#'))
+		*len = 1;
+
+	else if (*c->pos == '$' && isdigit((unsigned char)*name))
+	{
+		while (isdigit((unsigned char)*(name + *len)))
+			++*len;
+	}
+
+	else if (isalpha((unsigned char)*name) || *name == '_')
+	{
+		while (isalnum((unsigned char)*(name + *len)) || *(name + *len) == '_')
+			++*len;
+	}
+
+	return (*len > 0) ? name : NULL;
+}
+
+/*
+ * @brief Compile a number, a variable, or a parenthesized expression.
+ */
+static void compile_primary(PArithCompiler c)
+{
+	const char *name;
+	size_t len;
+
+	skip_spaces(c);
+
+	if (*c->pos == '(')
+	{
+		++c->pos;
+		compile_assignment(c);
+		skip_spaces(c);
+
+		if (*c->pos != ')')
+			c->failed = true;
+
+		else
+			++c->pos;
+	}
+
+	else if (isdigit((unsigned char)*c->pos))
+	{
+		char *end = NULL;
+
+		// Base 0 reads decimal, 0x hex and 0 octal numbers.
+		errno = 0;
+		long long value = strtoll(c->pos, &end, 0);
+
+		if (errno == ERANGE || isalnum((unsigned char)*end) || *end == '_')
+			c->failed = true;
+
+		c->pos = end;
+		emit(c, ARITH_OP_NUM, value);
+	}
+
+	else if ((name = read_name(c, &len)) != NULL)
+	{
+		int var = find_var(c, name, len);
+
+		c->pos = name + len;
+
+		if (emit(c, ARITH_OP_VAR, 0) != -1)
+			(c->program->ops + c->program->num_ops - 1)->var = (uint16_t)var;
+	}
+
+	else
+		c->failed = true;
+}
+
+/*
+ * @brief Compile a unary expression (+, -, ! and ~, right to left).
+ */
+static void compile_unary(PArithCompiler c)
+{
+	skip_spaces(c);
+
+	if (++c->nesting > ARITH_MAX_STACK * 4)
+		c->failed = true;
+
+	char ch = *c->pos;
+
+	if (c->failed)
+		return;
+
+	else if (ch == '+' || ch == '-' || ch == '!' || ch == '~')
+	{
+		++c->pos;
+		compile_unary(c);
+
+		if (ch != '+')
+			emit(c, (ch == '-') ? ARITH_OP_NEG : (ch == '!') ? ARITH_OP_NOT : ARITH_OP_BNOT, 0);
+	}
+
+	else
+		compile_primary(c);
+
+	--c->nesting;
+}
+
+/*
+ * @brief Find the binary operator at the current position.
+ * @return The operator, or NULL if there is none (an assignment operator isn't a binary operator).
+ */
+static const ArithBinary *peek_binary(PArithCompiler c)
+{
+	skip_spaces(c);
+
+	for (size_t k = 0; k < sizeof(assign_ops) / sizeof(*assign_ops); ++k)
+	{
+		const char *token = assign_ops[k].token;
+
+		// "==" is the only operator that starts like an assignment and isn't one.
+		if (strncmp(c->pos, token, strlen(token)) == 0 && strncmp(c->pos, "==", 2) != 0)
+			return NULL;
+	}
+
+	for (size_t k = 0; k < sizeof(binary_ops) / sizeof(*binary_ops); ++k)
+	{
+		if (strncmp(c->pos, binary_ops[k].token, strlen(binary_ops[k].token)) == 0)
+			return binary_ops + k;
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief Compile the binary operators of a precedence of at least min_prec (precedence climbing).
+ * @param c The compiler.
+ * @param min_prec The lowest precedence to compile.
+ */
+static void compile_binary(PArithCompiler c, int min_prec)
+{
+	const ArithBinary *bin;
+
+	compile_unary(c);
+
+	while (!c->failed && (bin = peek_binary(c)) != NULL && bin->prec >= min_prec)
+	{
+		c->pos += strlen(bin->token);
+
+		// The right operand of && and || is skipped when the left one decides the result.
+		if (bin->type == ARITH_OP_AND_JUMP || bin->type == ARITH_OP_OR_JUMP)
+		{
+			int jump = emit(c, bin->type, 0);
+
+			compile_binary(c, bin->prec + 1);
+			emit(c, ARITH_OP_BOOL, 0);
+
+			if (jump != -1)
+				(c->program->ops + jump)->value = c->program->num_ops;
+		}
+
+		else
+		{
+			compile_binary(c, bin->prec + 1);
+			emit(c, bin->type, 0);
+		}
+	}
+}
+
+/*
+ * @brief Compile a conditional expression ("cond ? a : b").
+ */
+static void compile_conditional(PArithCompiler c)
+{
+	compile_binary(c, 1);
+	skip_spaces(c);
+
+	if (c->failed || *c->pos != '?')
+		return;
+
+	++c->pos;
+
+	int jump_else = emit(c, ARITH_OP_JUMP_ZERO, 0);
+
+	compile_assignment(c);
+
+	int jump_end = emit(c, ARITH_OP_JUMP, 0);
+
+	// The else branch starts at the depth the then branch started at.
+	--c->depth;
+	skip_spaces(c);
+
+	if (c->failed || *c->pos != ':')
+	{
+		c->failed = true;
+		return;
+	}
+
+	++c->pos;
+	(c->program->ops + jump_else)->value = c->program->num_ops;
+	compile_conditional(c);
+
+	if (!c->failed)
+		(c->program->ops + jump_end)->value = c->program->num_ops;
+}
+
+/*
+ * @brief Compile an assignment ("name = expr", "name += expr"...), or a conditional expression.
+ */
+static void compile_assignment(PArithCompiler c)
+{
+	const char *start, *name;
+	size_t len;
+
+	skip_spaces(c);
+	start = c->pos;
+
+	if (++c->nesting > ARITH_MAX_STACK * 4)
+		c->failed = true;
+
+	// Only a plain name can be assigned to, not "$name".
+	if (!c->failed && *c->pos != '$' && (name = read_name(c, &len)) != NULL)
+	{
+		c->pos = name + len;
+		skip_spaces(c);
+
+		for (size_t k = 0; k < sizeof(assign_ops) / sizeof(*assign_ops); ++k)
+		{
+			const char *token = assign_ops[k].token;
+
+			if (strncmp(c->pos, token, strlen(token)) != 0 || strncmp(c->pos, "==", 2) == 0)
+				continue;
+
+			int var = find_var(c, name, len);
+
+			c->pos += strlen(token);
+			compile_assignment(c);
+
+			int op = emit(c, ARITH_OP_ASSIGN, 0);
+
+			if (op != -1)
+			{
+				(c->program->ops + op)->op = (uint8_t)assign_ops[k].type;
+				(c->program->ops + op)->var = (uint16_t)var;
+			}
+
+			--c->nesting;
+			return;
+		}
+	}
+
+	c->pos = start;
+
+	if (!c->failed)
+		compile_conditional(c);
+
+	--c->nesting;
+}
+
+/*
+ * @brief Free a compiled expression.
+ */
+static void free_program(PArithProgram program)
+{
+	for (int i = 0; i < program->num_vars; ++i)
+		free(*(program->vars + i));
+
+	free(program->vars);
+	free(program->ops);
+	free(program->source);
+	free(program);
+}
+
+/*
+ * @brief Compile an expression.
+ * @param expr The expression.
+ * @param len The length of the expression.
+ * @return The compiled expression, or NULL on a syntax error (or an allocation failure).
+ */
+static PArithProgram compile(const char *expr, size_t len)
+{
+	PArithProgram program = (PArithProgram)calloc(1, sizeof(ArithProgram));
+	ArithCompiler c = {NULL, program, 0, 0, 0, false};
+
+	if (program == NULL || (program->source = strndup(expr, len)) == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)");
+		free(program);
+		return NULL;
+	}
+
+	c.pos = program->source;
+	skip_spaces(&c);
+
+	// An empty expression is 0, like in other shells.
+	if (*c.pos == '\0')
+		emit(&c, ARITH_OP_NUM, 0);
+
+	else
+		compile_assignment(&c);
+
+	skip_spaces(&c);
+
+	if (c.failed || *c.pos != '\0')
+	{
+		free_program(program);
+		return NULL;
+	}
+
+	return program;
+}
+
+/*
+ * @brief Get the value of a variable of an expression.
+ * @param ctx The shell context.
+ * @param name The name of the variable.
+ * @param value Where to store the value.
+ * @return Success on success, Failure if the value isn't an integer.
+ * @note Inside a function, "$#" and "$N" are the parameters of the call. An unset or empty variable is 0.
+ */
+static Result read_var(PShellContext ctx, const char *name, long long *value)
+{
+	const char *str = NULL;
+	char *end = NULL;
+
+	if (*name == '#' || isdigit((unsigned char)*name))
+	{
+		PShellFrame frame = ctx->frame;
+		long index = (*name == '#') ? -1 : atol(name);
+
+		if (frame != NULL && *name == '#')
+		{
+			*value = frame->argc - 1;
+			return Success;
+		}
+
+		str = (frame != NULL && index < frame->argc) ? *(frame->args + index) : NULL;
+	}
+
+	else
+		str = get_variable(ctx->variableList, name);
+
+	if (str == NULL || *str == '\0')
+	{
+		*value = 0;
+		return Success;
+	}
+
+	errno = 0;
+	*value = strtoll(str, &end, 0);
+
+	if (errno == ERANGE || *end != '\0')
+	{
+		fprintf(stderr, "%s: %s\n", SHELL_ERR_ARITH_VALUE, name);
+		return Failure;
+	}
+
+	return Success;
+}
+
+/*
+ * @brief Apply a binary operator.
+ * @param type The operator.
+ * @param a The left operand.
+ * @param b The right operand.
+ * @param result Where to store the result.
+ * @return Success on success, Failure on a division by zero.
+ * @note Overflows wrap around, instead of being undefined.
+ */
+static Result apply(ArithOpType type, long long a, long long b, long long *result)
+{
+	unsigned long long ua = (unsigned long long)a, ub = (unsigned long long)b;
+
+	switch (type)
+	{
+		case ARITH_OP_DIV:
+		case ARITH_OP_MOD:
+			if (b == 0)
+			{
+				fprintf(stderr, "%s\n", SHELL_ERR_ARITH_DIV_ZERO);
+				return Failure;
+			}
+
+			// The only division that overflows, LLONG_MIN / -1.
+			if (b == -1)
+				*result = (type == ARITH_OP_DIV) ? (long long)(0 - ua) : 0;
+
+			else
+				*result = (type == ARITH_OP_DIV) ? a / b : a % b;
+
+			break;
+
+		case ARITH_OP_MUL: *result = (long long)(ua * ub); break;
+		case ARITH_OP_ADD: *result = (long long)(ua + ub); break;
+		case ARITH_OP_SUB: *result = (long long)(ua - ub); break;
+		case ARITH_OP_SHL: *result = (long long)(ua << (ub & 63)); break;
+		case ARITH_OP_SHR: *result = a >> (ub & 63); break;
+		case ARITH_OP_LT: *result = a < b; break;
+		case ARITH_OP_LE: *result = a <= b; break;
+		case ARITH_OP_GT: *result = a > b; break;
+		case ARITH_OP_GE: *result = a >= b; break;
+		case ARITH_OP_EQ: *result = a == b; break;
+		case ARITH_OP_NE: *result = a != b; break;
+		case ARITH_OP_BAND: *result = a & b; break;
+		case ARITH_OP_BXOR: *result = a ^ b; break;
+		case ARITH_OP_BOR: *result = a | b; break;
+		default: *result = b; break;
+	}
+
+	return Success;
+}
+
+/*
+ * @brief Run a compiled expression.
+ * @param ctx The shell context.
+ * @param program The compiled expression.
+ * @param result Where to store the value of the expression.
+ * @return Success on success, Failure otherwise.
+ */
+static Result run(PShellContext ctx, PArithProgram program, long long *result)
+{
+	long long stack[ARITH_MAX_STACK + 1];
+	int top = 0;
+
+	for (int pc = 0; pc < program->num_ops; ++pc)
+	{
+		PArithOp op = program->ops + pc;
+		char *name = (op->type == ARITH_OP_VAR || op->type == ARITH_OP_ASSIGN) ? *(program->vars + op->var) : NULL;
+		long long value;
+
+		switch (op->type)
+		{
+			case ARITH_OP_NUM:
+				*(stack + top++) = op->value;
+				break;
+
+			case ARITH_OP_VAR:
+				if (read_var(ctx, name, stack + top++) == Failure)
+					return Failure;
+
+				break;
+
+			case ARITH_OP_ASSIGN:
+			{
+				char buf[32];
+
+				value = *(stack + top - 1);
+
+				if (op->op != ARITH_OP_NUM && (read_var(ctx, name, stack + top - 1) == Failure ||
+											   apply((ArithOpType)op->op, *(stack + top - 1), value, &value) == Failure))
+					return Failure;
+
+				*(stack + top - 1) = value;
+				snprintf(buf, sizeof(buf), "%lld", value);
+
+				if (setVariable(ctx, name, buf) == Failure)
+					return Failure;
+
+				break;
+			}
+
+			case ARITH_OP_NEG:
+				*(stack + top - 1) = (long long)(0 - (unsigned long long)*(stack + top - 1));
+				break;
+
+			case ARITH_OP_NOT:
+				*(stack + top - 1) = !*(stack + top - 1);
+				break;
+
+			case ARITH_OP_BNOT:
+				*(stack + top - 1) = ~*(stack + top - 1);
+				break;
+
+			case ARITH_OP_BOOL:
+				*(stack + top - 1) = (*(stack + top - 1) != 0);
+				break;
+
+			case ARITH_OP_AND_JUMP:
+				if (*(stack + top - 1) == 0)
+					pc = (int)op->value - 1;
+
+				else
+					--top;
+
+				break;
+
+			case ARITH_OP_OR_JUMP:
+				if (*(stack + top - 1) != 0)
+				{
+					*(stack + top - 1) = 1;
+					pc = (int)op->value - 1;
+				}
+
+				else
+					--top;
+
+				break;
+
+			case ARITH_OP_JUMP_ZERO:
+				if (*(stack + --top) == 0)
+					pc = (int)op->value - 1;
+
+				break;
+
+			case ARITH_OP_JUMP:
+				pc = (int)op->value - 1;
+				break;
+
+			default:
+				--top;
+
+				if (apply((ArithOpType)op->type, *(stack + top - 1), *(stack + top), stack + top - 1) == Failure)
+					return Failure;
+
+				break;
+		}
+	}
+
+	*result = *(stack + top - 1);
+
+	return Success;
+}
+
+/*
+ * @brief Remove all the compiled expressions from the cache.
+ */
+static void flush_cache(PArithCache cache)
+{
+	for (size_t i = 0; i < cache->capacity; ++i)
+	{
+		PArithProgram program = *(cache->buckets + i);
+
+		while (program != NULL)
+		{
+			PArithProgram next = program->next;
+
+			free_program(program);
+			program = next;
+		}
+
+		*(cache->buckets + i) = NULL;
+	}
+
+	cache->count = 0;
+}
+
+Result arith_eval(PShellContext ctx, const char *expr, size_t len, long long *result)
+{
+	PArithCache cache = ctx->arith;
+
+	if (cache == NULL)
+	{
+		if ((cache = (PArithCache)calloc(1, sizeof(ArithCache))) == NULL ||
+			(cache->buckets = (PArithProgram *)calloc(ARITH_CACHE_MAX, sizeof(PArithProgram))) == NULL)
+		{
+			perror("Internal error: System call faliure: calloc(3)");
+			free(cache);
+			return Failure;
+		}
+
+		cache->capacity = ARITH_CACHE_MAX;
+		ctx->arith = cache;
+	}
+
+	size_t slot = hash_string(expr, len) & (cache->capacity - 1);
+	PArithProgram program = *(cache->buckets + slot);
+
+	while (program != NULL && (strncmp(program->source, expr, len) != 0 || *(program->source + len) != '\0'))
+		program = program->next;
+
+	if (program == NULL)
+	{
+		if ((program = compile(expr, len)) == NULL)
+		{
+			fprintf(stderr, "%s: %.*s\n", SHELL_ERR_ARITH_SYNTAX, (int)len, expr);
+			return Failure;
+		}
+
+		// A script that generates endless distinct expressions can't grow the cache without bounds.
+		if (cache->count == ARITH_CACHE_MAX)
+			flush_cache(cache);
+
+		STATS_INC(allocations);
+		program->next = *(cache->buckets + slot);
+		*(cache->buckets + slot) = program;
+		++cache->count;
+	}
+
+	return run(ctx, program, result);
+}
+
+void arith_free(PShellContext ctx)
+{
+	PArithCache cache = ctx->arith;
+
+	if (cache == NULL)
+		return;
+
+	flush_cache(cache);
+	free(cache->buckets);
+	free(cache);
+	ctx->arith = NULL;
+}
@@ -0,0 +1,315 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Environment Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_env.h"
+#include "../include/shell_internal_cmds.h"
+#include "../include/shell_stats.h"
+#include "../include/Variables.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+extern char **environ;
+
+Result env_init(PShellContext ctx)
+{
+	size_t count = 0;
+
+	while (*(environ + count) != NULL)
+		++count;
+
+	PShellEnv env = (PShellEnv)calloc(1, sizeof(ShellEnv));
+
+	if (env == NULL || (env->base = (char **)calloc(count + 1, sizeof(char *))) == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)");
+		free(env);
+		return Failure;
+	}
+
+	ctx->env = env;
+
+	for (; env->num_base < count; ++env->num_base)
+	{
+		if ((*(env->base + env->num_base) = strdup(*(environ + env->num_base))) == NULL)
+		{
+			perror("Internal error: System call faliure: strdup(3)");
+			return Failure;
+		}
+	}
+
+	env->dirty = true;
+
+	return Success;
+}
+
+bool env_valid_name(const char *name)
+{
+	if (!isalpha((unsigned char)*name) && *name != '_')
+		return false;
+
+	while (isalnum((unsigned char)*name) || *name == '_')
+		++name;
+
+	return *name == '\0';
+}
+
+/*
+ * @brief Find an inherited variable.
+ * @param env The environment.
+ * @param name The name of the variable.
+ * @return The index of the variable in the inherited variables, or -1 if it isn't there.
+ */
+static long find_base(PShellEnv env, const char *name)
+{
+	size_t len = strlen(name);
+
+	for (size_t i = 0; i < env->num_base; ++i)
+	{
+		if (strncmp(*(env->base + i), name, len) == 0 && *(*(env->base + i) + len) == '=')
+			return (long)i;
+	}
+
+	return -1;
+}
+
+/*
+ * @brief Find a shell variable.
+ * @param ctx The shell context.
+ * @param name The name of the variable.
+ * @return The variable, or NULL if there is no such variable.
+ */
+static PVariable find_variable(PShellContext ctx, const char *name)
+{
+	for (PNode curr = ctx->variableList->head; curr != NULL; curr = curr->next)
+	{
+		if (strcmp(((PVariable)curr->data)->name, name) == 0)
+			return (PVariable)curr->data;
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief Remove an inherited variable, keeping the order of the rest.
+ * @param env The environment.
+ * @param index The index of the variable.
+ */
+static void remove_base(PShellEnv env, size_t index)
+{
+	free(*(env->base + index));
+	memmove(env->base + index, env->base + index + 1, (env->num_base - index) * sizeof(char *));
+	--env->num_base;
+	env->dirty = true;
+}
+
+/*
+ * @brief Apply the $PATH of the environment to the shell itself.
+ * @param envp The environment.
+ */
+static void sync_path(char **envp)
+{
+	for (; *envp != NULL; ++envp)
+	{
+		if (strncmp(*envp, "PATH=", 5) == 0)
+		{
+			const char *path = getenv("PATH");
+
+			if (path == NULL || strcmp(path, *envp + 5) != 0)
+				setenv("PATH", *envp + 5, 1);
+
+			return;
+		}
+	}
+
+	unsetenv("PATH");
+}
+
+/*
+ * @brief Free the cached environment, and the entries it formatted.
+ * @param env The environment.
+ */
+static void free_envp(PShellEnv env)
+{
+	if (env->envp == NULL)
+		return;
+
+	size_t total = 0;
+
+	while (*(env->envp + total) != NULL)
+		++total;
+
+	for (size_t i = total - env->num_owned; i < total; ++i)
+		free(*(env->envp + i));
+
+	free(env->envp);
+	env->envp = NULL;
+}
+
+char **env_get(PShellContext ctx)
+{
+	PShellEnv env = ctx->env;
+
+	if (!env->dirty)
+		return env->envp;
+
+	size_t num_exported = 0;
+
+	for (PNode curr = ctx->variableList->head; curr != NULL; curr = curr->next)
+		num_exported += ((PVariable)curr->data)->exported;
+
+	// The inherited variables are shared with the new array, only the exported ones are formatted.
+	// On failure, the inherited variables alone are better than an environment with freed entries.
+	char **envp = (char **)malloc((env->num_base + num_exported + 1) * sizeof(char *));
+
+	if (envp == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return env->base;
+	}
+
+	memcpy(envp, env->base, env->num_base * sizeof(char *));
+
+	size_t n = env->num_base;
+
+	for (PNode curr = ctx->variableList->head; curr != NULL; curr = curr->next)
+	{
+		PVariable variable = (PVariable)curr->data;
+
+		if (!variable->exported)
+			continue;
+
+		size_t name_len = strlen(variable->name), value_len = strlen(variable->value);
+		char *entry = (char *)malloc(name_len + value_len + 2);
+
+		if (entry == NULL)
+		{
+			perror("Internal error: System call faliure: malloc(3)");
+
+			while (n > env->num_base)
+				free(*(envp + --n));
+
+			free(envp);
+			return env->base;
+		}
+
+		memcpy(entry, variable->name, name_len);
+		*(entry + name_len) = '=';
+		memcpy(entry + name_len + 1, variable->value, value_len + 1);
+		*(envp + n++) = entry;
+	}
+
+	*(envp + n) = NULL;
+	STATS_ADD(allocations, num_exported + 1);
+
+	free_envp(env);
+	env->envp = envp;
+	env->num_owned = num_exported;
+	env->dirty = false;
+	sync_path(envp);
+
+	return envp;
+}
+
+Result env_export(PShellContext ctx, const char *name)
+{
+	if (!env_valid_name(name))
+		return Failure;
+
+	PShellEnv env = ctx->env;
+	PVariable variable = find_variable(ctx, name);
+	long index = find_base(env, name);
+
+	if (variable == NULL)
+	{
+		// Nothing to export.
+		if (index == -1)
+			return Success;
+
+		if (setVariable(ctx, (char *)name, strchr(*(env->base + index), '=') + 1) == Failure ||
+			(variable = find_variable(ctx, name)) == NULL)
+			return Failure;
+	}
+
+	// The shell variable takes the place of the inherited one.
+	if (index != -1)
+		remove_base(env, index);
+
+	variable->exported = true;
+	env->dirty = true;
+
+	return Success;
+}
+
+void env_unset(PShellContext ctx, const char *name)
+{
+	long index = find_base(ctx->env, name);
+
+	if (index != -1)
+		remove_base(ctx->env, index);
+}
+
+/*
+ * @brief Compare two environment entries by name.
+ */
+static int compare_entry(const void *a, const void *b)
+{
+	const char *ea = *(const char **)a, *eb = *(const char **)b;
+	size_t la = strcspn(ea, "="), lb = strcspn(eb, "=");
+	int cmp = strncmp(ea, eb, (la < lb) ? la : lb);
+
+	return (cmp != 0) ? cmp : (la > lb) - (la < lb);
+}
+
+void env_print(PShellContext ctx, FILE *out)
+{
+	char **envp = env_get(ctx);
+	size_t count = 0;
+
+	while (*(envp + count) != NULL)
+		++count;
+
+	char *sorted[count + 1];
+
+	memcpy(sorted, envp, count * sizeof(char *));
+	qsort(sorted, count, sizeof(char *), compare_entry);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		size_t name_len = strcspn(*(sorted + i), "=");
+
+		fprintf(out, "export %.*s=\"%s\"\n", (int)name_len, *(sorted + i), *(sorted + i) + name_len + 1);
+	}
+}
+
+void env_free(PShellContext ctx)
+{
+	PShellEnv env = ctx->env;
+
+	if (env == NULL)
+		return;
+
+	free_envp(env);
+
+	for (size_t i = 0; i < env->num_base; ++i)
+		free(*(env->base + i));
+
+	free(env->base);
+	free(env);
+	ctx->env = NULL;
+}
@@ -0,0 +1,169 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Fan-out Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_fanout.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+
+/*
+ * @brief Move exactly len bytes from one pipe to another.
+ * @param in_fd The pipe to move the data from.
+ * @param out_fd The pipe to move the data to.
+ * @param len The number of bytes to move.
+ * @return Success if all the bytes were moved, Failure otherwise (e.g. the reader of out_fd is gone).
+ */
+static Result splice_all(int in_fd, int out_fd, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = splice(in_fd, NULL, out_fd, NULL, len, SPLICE_F_MOVE);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		else if (n <= 0)
+			return Failure;
+
+		len -= (size_t)n;
+	}
+
+	return Success;
+}
+
+/*
+ * @brief Drop a consumer that stopped reading.
+ * @param lag The consumer's lag pipe.
+ * @param out_fd The consumer's pipe.
+ * @param alive The consumer's state.
+ */
+static void drop_consumer(int *lag, int out_fd, bool *alive)
+{
+	close(*lag);
+	close(*(lag + 1));
+	close(out_fd);
+	*alive = false;
+}
+
+void run_fanout_relay(int in_fd, const int *out_fds, int num_outs)
+{
+	// Each consumer gets a lag pipe: tee(2) duplicates a whole chunk into the empty lag pipes at once,
+	// and the chunk is then drained into each consumer at its own pace.
+	int lag[num_outs * 2];
+	bool alive[num_outs];
+	int pipe_size = fcntl(in_fd, F_GETPIPE_SZ);
+
+	// A consumer that exits must not kill the relay, splice(2) reports EPIPE instead.
+	signal(SIGPIPE, SIG_IGN);
+
+	for (int k = 0; k < num_outs; ++k)
+	{
+		if (pipe2(lag + k * 2, O_CLOEXEC) == -1)
+		{
+			perror("Internal error: System call faliure: pipe2(2)");
+			exit(EXIT_FAILURE);
+		}
+
+		// The lag pipe must hold everything the producer's pipe can hold, so a tee(2) is never partial.
+		if (pipe_size > 0)
+			fcntl(*(lag + k * 2 + 1), F_SETPIPE_SZ, pipe_size);
+
+		*(alive + k) = true;
+	}
+
+	while (true)
+	{
+		int first = -1, last = -1;
+
+		for (int k = 0; k < num_outs; ++k)
+		{
+			if (*(alive + k))
+			{
+				if (first == -1)
+					first = k;
+
+				last = k;
+			}
+		}
+
+		// Every consumer is gone, closing the producer's pipe sends it EPIPE.
+		if (first == -1)
+			break;
+
+		// A single consumer left, it gets the producer's data directly.
+		if (first == last)
+		{
+			ssize_t n = splice(in_fd, NULL, *(out_fds + first), NULL, INT_MAX, SPLICE_F_MOVE);
+
+			if (n == -1 && errno == EINTR)
+				continue;
+
+			else if (n == -1)
+				drop_consumer(lag + first * 2, *(out_fds + first), alive + first);
+
+			// The producer closed its end.
+			else if (n == 0)
+				break;
+
+			continue;
+		}
+
+		// Wait for the producer and duplicate whatever it wrote into the first lag pipe.
+		ssize_t n = tee(in_fd, *(lag + first * 2 + 1), INT_MAX, 0);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		else if (n == -1)
+		{
+			perror("Internal error: System call faliure: tee(2)");
+			break;
+		}
+
+		// The producer closed its end.
+		else if (n == 0)
+			break;
+
+		// Duplicate the same chunk for the consumers in between, the last one consumes it from the producer's pipe.
+		for (int k = first + 1; k < last; ++k)
+		{
+			if (*(alive + k) && tee(in_fd, *(lag + k * 2 + 1), (size_t)n, 0) != n)
+				drop_consumer(lag + k * 2, *(out_fds + k), alive + k);
+		}
+
+		if (splice_all(in_fd, *(lag + last * 2 + 1), (size_t)n) == Failure)
+		{
+			perror("Internal error: System call faliure: splice(2)");
+			break;
+		}
+
+		// Drain each lag pipe into its consumer, blocking on a full consumer pipe holds back the producer.
+		for (int k = first; k <= last; ++k)
+		{
+			if (*(alive + k) && splice_all(*(lag + k * 2), *(out_fds + k), (size_t)n) == Failure)
+				drop_consumer(lag + k * 2, *(out_fds + k), alive + k);
+		}
+	}
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,460 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Functions Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_function.h"
+#include "../include/shell_utils.h"
+#include "../include/shell_lineedit.h"
+#include "../include/shell_redirect.h"
+#include "../include/shell_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+/*
+ * @brief Parse the head of a function definition ("name() {").
+ * @param command The command line.
+ * @param name_len Where to store the length of the name (the name starts at the command line itself).
+ * @return The rest of the line after the "{", or NULL if the line isn't a function definition.
+ */
+static const char *parse_head(const char *command, size_t *name_len)
+{
+	const char *p = command;
+
+	if (!isalpha((unsigned char)*p) && *p != '_')
+		return NULL;
+
+	while (isalnum((unsigned char)*p) || *p == '_')
+		++p;
+
+	*name_len = p - command;
+
+	while (*p == ' ' || *p == '\t')
+		++p;
+
+	if (*p++ != '(')
+		return NULL;
+
+	while (*p == ' ' || *p == '\t')
+		++p;
+
+	if (*p++ != ')')
+		return NULL;
+
+	while (*p == ' ' || *p == '\t')
+		++p;
+
+	if (*p++ != '{' || (*p != '\0' && *p != ' ' && *p != '\t'))
+		return NULL;
+
+	return p;
+}
+
+bool function_is_definition(const char *command)
+{
+	size_t name_len;
+
+	return parse_head(command, &name_len) != NULL;
+}
+
+/*
+ * @brief Free a function.
+ * @param function The function.
+ */
+static void destroy_function(PShellFunction function)
+{
+	for (int i = 0; i < function->num_lines; ++i)
+	{
+		free(*(function->lines + i));
+		freeUpMem(function->tokens + i);
+		freeUpMem(function->heredocs + i);
+	}
+
+	free(function->lines);
+	free(function->tokens);
+	free(function->heredocs);
+	free(function->name);
+	free(function);
+}
+
+void function_release(PShellFunction function)
+{
+	if (--function->refs == 0)
+		destroy_function(function);
+}
+
+/*
+ * @brief Trim the spaces around a line, in place.
+ * @param line The line.
+ * @param len The length of the line, updated to the length of the trimmed line.
+ * @return The start of the trimmed line.
+ */
+static char *trim_line(char *line, size_t *len)
+{
+	while (*len > 0 && (*line == ' ' || *line == '\t'))
+	{
+		++line;
+		--*len;
+	}
+
+	while (*len > 0 && (*(line + *len - 1) == ' ' || *(line + *len - 1) == '\t' || *(line + *len - 1) == '\n'))
+		--*len;
+
+	*(line + *len) = '\0';
+
+	return line;
+}
+
+/*
+ * @brief Check if a trimmed line ends with the closing "}" of a function's body.
+ * @param line The line.
+ * @param len The length of the line.
+ * @return true if the line closes the body, false otherwise.
+ * @note The "}" is a word of its own, after a space or the ";" that ends the last command (e.g. "echo hi; }").
+ */
+static bool closes_body(const char *line, size_t len)
+{
+	return len > 0 && *(line + len - 1) == '}' &&
+		   (len == 1 || *(line + len - 2) == ' ' || *(line + len - 2) == '\t' || *(line + len - 2) == ';');
+}
+
+/*
+ * @brief Add a line to the body of a function, and tokenize it.
+ * @param function The function.
+ * @param capacity The capacity of the body arrays, updated if they grow.
+ * @param line The line, already trimmed and not empty.
+ * @return true on success, false on failure.
+ * @note The bodies of the line's here-documents follow it in the input, so they're read now, and kept with the line.
+ */
+static bool add_line(PShellFunction function, int *capacity, const char *line)
+{
+	if (function->num_lines == *capacity)
+	{
+		int new_capacity = (*capacity == 0) ? 8 : *capacity * 2;
+		char **lines = (char **)realloc(function->lines, new_capacity * sizeof(char *));
+
+		if (lines != NULL)
+			function->lines = lines;
+
+		char ***tokens = (lines != NULL) ? (char ***)realloc(function->tokens, new_capacity * sizeof(char **)) : NULL;
+
+		if (tokens != NULL)
+			function->tokens = tokens;
+
+		char ***heredocs = (tokens != NULL) ? (char ***)realloc(function->heredocs, new_capacity * sizeof(char **)) : NULL;
+
+		if (heredocs == NULL)
+		{
+			perror("Internal error: System call faliure: realloc(3)");
+			return false;
+		}
+
+		function->heredocs = heredocs;
+		*capacity = new_capacity;
+	}
+
+	int num_tokens = count_tokens(line);
+	char **tokens = (num_tokens > 0) ? tokenize_command(line, num_tokens) : (char **)calloc(1, sizeof(char *));
+	char *text = strdup(line);
+	char **heredocs = NULL;
+
+	if (tokens == NULL || text == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)/strdup(3)");
+		freeUpMem(&tokens);
+		free(text);
+		return false;
+	}
+
+	if (read_heredoc_bodies(tokens, &heredocs) == Failure)
+	{
+		freeUpMem(&tokens);
+		free(text);
+		return false;
+	}
+
+	*(function->lines + function->num_lines) = text;
+	*(function->heredocs + function->num_lines) = heredocs;
+	*(function->tokens + function->num_lines++) = tokens;
+
+	return true;
+}
+
+/*
+ * @brief Add the commands of a line to the body of a function, one line for each command.
+ * @param function The function.
+ * @param capacity The capacity of the body arrays, updated if they grow.
+ * @param line The line, already trimmed. It's split in place.
+ * @return true on success, false on failure.
+ * @note The commands of a one-line body are separated by ";" (e.g. "f() { echo a; echo b; }"), a ";" inside
+ * 		 double quotes or inside a substitution doesn't separate them. Empty commands are dropped.
+ */
+static bool add_commands(PShellFunction function, int *capacity, char *line)
+{
+	bool in_quotes = false;
+	int depth = 0;
+
+	for (char *c = line, *start = line;; ++c)
+	{
+		if (*c == '"')
+			in_quotes = !in_quotes;
+
+		else if (!in_quotes && *c == '(')
+			++depth;
+
+		else if (!in_quotes && *c == ')' && depth > 0)
+			--depth;
+
+		else if (*c == '\0' || (*c == ';' && !in_quotes && depth == 0))
+		{
+			bool last = (*c == '\0');
+			size_t len = c - start;
+			char *command = trim_line(start, &len);
+
+			if (len > 0 && !add_line(function, capacity, command))
+				return false;
+
+			if (last)
+				return true;
+
+			start = c + 1;
+		}
+	}
+}
+
+/*
+ * @brief Read the body of a function from the input, until the line that ends with its closing "}".
+ * @param function The function.
+ * @param capacity The capacity of the body arrays.
+ * @return true on success, false on failure (the rest of the body is still read).
+ */
+static bool read_body(PShellFunction function, int *capacity)
+{
+	const char *prompt = isatty(STDIN_FILENO) ? SHELL_HEREDOC_PROMPT : NULL;
+	bool ok = true;
+	size_t len;
+	char *line;
+
+	while (1)
+	{
+		// The body follows the definition in the same input, so it's read through the line editor.
+		if ((line = read_line(prompt, &len, NULL)) == NULL)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_FUNCTION_EOF);
+			return false;
+		}
+
+		line = trim_line(line, &len);
+
+		if (len == 0 || (!ok && !closes_body(line, len)))
+			continue;
+
+		// A whole definition on one line is allowed, it defines the function when the body runs.
+		else if (function_is_definition(line))
+		{
+			if (!closes_body(line, len))
+			{
+				fprintf(stderr, "%s\n", SHELL_ERR_FUNCTION_NESTED);
+				ok = false;
+			}
+
+			else if (!add_line(function, capacity, line))
+				ok = false;
+		}
+
+		// The last line may have commands before its "}" (e.g. "echo b; }"), as in the one-line form.
+		else if (closes_body(line, len))
+		{
+			--len;
+			line = trim_line(line, &len);
+
+			return (ok && add_commands(function, capacity, line));
+		}
+
+		else if (!add_commands(function, capacity, line))
+			ok = false;
+	}
+}
+
+Result function_define(PShellContext ctx, const char *command)
+{
+	size_t name_len, rest_len;
+	const char *rest = parse_head(command, &name_len);
+	int capacity = 0;
+	bool ok = true;
+
+	if (rest == NULL)
+		return Failure;
+
+	PShellFunction function = (PShellFunction)calloc(1, sizeof(ShellFunction));
+
+	if (function == NULL || (function->name = strndup(command, name_len)) == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)/strndup(3)");
+		free(function);
+		return Failure;
+	}
+
+	function->refs = 1;
+
+	// The rest of the first line is either the whole body ("{ body }"), or its first line.
+	char first[SHELL_MAX_COMMAND_LENGTH + 1] = {0};
+	strncpy(first, rest, SHELL_MAX_COMMAND_LENGTH);
+	rest_len = strlen(first);
+
+	char *line = trim_line(first, &rest_len);
+
+	if (closes_body(line, rest_len))
+	{
+		--rest_len;
+		line = trim_line(line, &rest_len);
+		ok = add_commands(function, &capacity, line);
+	}
+
+	else
+	{
+		ok = add_commands(function, &capacity, line);
+
+		// The body is read even after a failure, so its lines aren't run as commands.
+		ok = read_body(function, &capacity) && ok;
+	}
+
+	if (!ok)
+	{
+		destroy_function(function);
+		return Failure;
+	}
+
+	// A function with the same name is replaced, and freed once it's not running.
+	function_unset(ctx, function->name);
+
+	if (ctx->functions == NULL && (ctx->functions = (PNameTable)calloc(1, sizeof(NameTable))) == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)");
+		destroy_function(function);
+		return Failure;
+	}
+
+	if (name_table_insert(ctx->functions, function) == Failure)
+	{
+		destroy_function(function);
+		return Failure;
+	}
+
+	return Success;
+}
+
+PShellFunction function_lookup(PShellContext ctx, const char *name)
+{
+	return (PShellFunction)name_table_lookup(ctx->functions, name);
+}
+
+Result function_unset(PShellContext ctx, const char *name)
+{
+	PShellFunction function = (PShellFunction)name_table_remove(ctx->functions, name);
+
+	if (function == NULL)
+		return Failure;
+
+	function_release(function);
+
+	return Success;
+}
+
+char **function_copy_line(PShellFunction function, int line)
+{
+	char **tokens = *(function->tokens + line);
+	int num_tokens = 0;
+
+	while (*(tokens + num_tokens) != NULL)
+		++num_tokens;
+
+	char **copy = (char **)calloc(num_tokens + 1, sizeof(char *));
+
+	if (copy == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)");
+		return NULL;
+	}
+
+	for (int i = 0; i < num_tokens; ++i)
+	{
+		if ((*(copy + i) = strdup(*(tokens + i))) == NULL)
+		{
+			perror("Internal error: System call faliure: strdup(3)");
+			freeUpMem(&copy);
+			return NULL;
+		}
+	}
+
+	STATS_ADD(allocations, num_tokens + 1);
+
+	return copy;
+}
+
+int function_expand_positional(PShellContext ctx, char ***argv, int index)
+{
+	PShellFrame frame = ctx->frame;
+	const char *name = *(*argv + index) + 1;
+
+	if (frame == NULL || *(name - 1) != '$' || *name == '\0')
+		return -1;
+
+	if (strcmp(name, "#") == 0)
+	{
+		char count[16] = {0}, *word = count;
+
+		snprintf(count, sizeof(count), "%d", frame->argc - 1);
+
+		return splice_words(argv, index, &word, 1) ? 1 : -1;
+	}
+
+	else if (strcmp(name, "@") == 0)
+		return splice_words(argv, index, frame->args + 1, frame->argc - 1) ? frame->argc - 1 : -1;
+
+	for (const char *p = name; *p != '\0'; ++p)
+	{
+		if (!isdigit((unsigned char)*p))
+			return -1;
+	}
+
+	// A parameter past the last argument expands to nothing (long numbers are past it, and never overflow).
+	long n = (strlen(name) > 9) ? frame->argc : atol(name);
+
+	if (n >= frame->argc)
+		return splice_words(argv, index, NULL, 0) ? 0 : -1;
+
+	return splice_words(argv, index, frame->args + n, 1) ? 1 : -1;
+}
+
+void function_free(PShellContext ctx)
+{
+	if (ctx->functions == NULL)
+		return;
+
+	for (size_t i = 0; i < ctx->functions->capacity; ++i)
+	{
+		if (*(ctx->functions->slots + i) != NULL)
+			function_release((PShellFunction)*(ctx->functions->slots + i));
+	}
+
+	name_table_free(ctx->functions);
+	free(ctx->functions);
+	ctx->functions = NULL;
+}
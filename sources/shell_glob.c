@@ -0,0 +1,1177 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Globbing Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_glob.h"
+#include "../include/shell_pathindex.h"
+#include "../include/shell_redirect.h"
+#include "../include/shell_subst.h"
+#include "../include/shell_stats.h"
+#include "../include/shell_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/*
+ * @brief A list of paths, kept in a single growing buffer.
+ * @param arena The paths, each one NUL terminated.
+ * @param len The used size of the arena.
+ * @param cap The size of the arena.
+ * @param offsets The offset of each path in the arena.
+ * @param count The number of paths.
+ * @param offsets_cap The size of the offsets array.
+ * @note A directory with millions of matching entries costs two allocations that grow geometrically,
+ * 		 instead of one allocation per entry.
+ */
+typedef struct GlobList {
+	char *arena;
+	size_t len;
+	size_t cap;
+	size_t *offsets;
+	size_t count;
+	size_t offsets_cap;
+} GlobList, *PGlobList;
+
+/*
+ * @brief The state of a directory scan.
+ * @param pattern The pattern the entries are matched against.
+ * @param dirs_only True if only directories are kept (more components follow).
+ * @param fd The directory.
+ * @param prefix The path of the directory, as it's written in the matches.
+ * @param prefix_len The length of the prefix.
+ * @param matches The list of matching paths.
+ * @param failed True if an allocation failed.
+ */
+typedef struct GlobScan {
+	const GlobPattern *pattern;
+	bool dirs_only;
+	int fd;
+	const char *prefix;
+	size_t prefix_len;
+	PGlobList matches;
+	bool failed;
+} GlobScan, *PGlobScan;
+
+/*
+ * @brief A directory of a recursive walk, shared with the walks of its subdirectories.
+ * @param fd The directory, its subdirectories are opened relative to it.
+ * @param path The path of the directory, as it's written in the matches.
+ * @param path_len The length of the path.
+ * @param refs One for the walker that reads it, plus one for each subdirectory that wasn't opened yet.
+ */
+typedef struct GlobDir {
+	int fd;
+	char *path;
+	size_t path_len;
+	int refs;
+} GlobDir, *PGlobDir;
+
+/*
+ * @brief A directory waiting to be walked.
+ * @param parent The parent directory, or NULL for a directory the walk starts at.
+ * @param path The path of the directory, owned by the task.
+ * @param name The offset of the name of the directory in its path.
+ */
+typedef struct GlobTask {
+	PGlobDir parent;
+	char *path;
+	size_t name;
+} GlobTask, *PGlobTask;
+
+/*
+ * @brief The directories waiting to be walked by a walker.
+ * @param lock Protects the deque, the owner takes from the tail and the other walkers steal from the head.
+ * @param tasks The tasks, from head to tail.
+ * @param head The index of the oldest task.
+ * @param tail The index after the newest task.
+ * @param cap The size of the tasks array.
+ * @note The owner walks depth first, so few directories are kept open, while the thieves get the oldest
+ * 		 (and usually largest) subtrees.
+ */
+typedef struct GlobDeque {
+	pthread_mutex_t lock;
+	PGlobTask tasks;
+	size_t head;
+	size_t tail;
+	size_t cap;
+} GlobDeque, *PGlobDeque;
+
+/*
+ * @brief A directory walker, a thread of a recursive walk.
+ * @param pool The walk.
+ * @param id The index of the walker in the walk.
+ * @param deque The directories waiting to be walked by this walker.
+ * @param results The paths this walker matched.
+ * @param dir The directory being read.
+ * @param failed True if an allocation failed.
+ */
+typedef struct GlobWalker {
+	struct GlobPool *pool;
+	int id;
+	GlobDeque deque;
+	GlobList results;
+	PGlobDir dir;
+	bool failed;
+} GlobWalker, *PGlobWalker;
+
+/*
+ * @brief A recursive ("**") walk.
+ * @param walkers The walkers.
+ * @param num_walkers The number of walkers.
+ * @param pattern The pattern of the entries to match, or NULL to match the directories themselves.
+ * @param pending The number of tasks that are queued or being walked, the walk is done when it's 0.
+ * @param available The number of tasks that are queued.
+ * @param idle The number of walkers that wait for a task.
+ * @param lock Protects the waiting.
+ * @param wake Signaled when a task is queued, and when the walk is done.
+ */
+typedef struct GlobPool {
+	PGlobWalker walkers;
+	int num_walkers;
+	const GlobPattern *pattern;
+	long pending;
+	long available;
+	int idle;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+} GlobPool, *PGlobPool;
+
+// The options of the recursive walks.
+static GlobOptions glob_options = {0};
+
+/*
+ * @brief Set a character in a class bitmap.
+ */
+static void class_set(uint64_t *class, unsigned char c)
+{
+	*(class + (c >> 6)) |= 1ULL << (c & 63);
+}
+
+/*
+ * @brief Check if a character is in a class bitmap.
+ */
+static bool class_has(const uint64_t *class, unsigned char c)
+{
+	return (*(class + (c >> 6)) >> (c & 63)) & 1;
+}
+
+/*
+ * @brief Read a character of a pattern, resolving an escape.
+ * @param str The pattern.
+ * @param len The length of the pattern.
+ * @param i The index of the character, advanced past it.
+ * @param escaped Where to store whether the character was escaped.
+ * @return The character.
+ */
+static unsigned char read_char(const char *str, size_t len, size_t *i, bool *escaped)
+{
+	*escaped = (*(str + *i) == GLOB_ESCAPE && *i + 1 < len && GLOB_IS_SPECIAL(*(str + *i + 1)));
+
+	if (*escaped)
+		++*i;
+
+	return (unsigned char)*(str + (*i)++);
+}
+
+/*
+ * @brief Compile a character class ("[...]").
+ * @param pattern The compiled pattern.
+ * @param str The pattern.
+ * @param len The length of the pattern.
+ * @param i The index of the "[", advanced past the closing "]" on success.
+ * @return true if the class was compiled, false if it has no closing "]" (the "[" is a literal then).
+ */
+static bool compile_class(PGlobPattern pattern, const char *str, size_t len, size_t *i)
+{
+	uint64_t *class = *(pattern->classes + pattern->num_classes);
+	size_t j = *i + 1;
+	bool negate = false, escaped;
+
+	memset(class, 0, 4 * sizeof(uint64_t));
+
+	if (j < len && (*(str + j) == '!' || *(str + j) == '^'))
+	{
+		negate = true;
+		++j;
+	}
+
+	// A "]" right after the "[" (or "[!") is a member of the class.
+	for (bool first = true; j < len; first = false)
+	{
+		if (*(str + j) == ']' && !first)
+		{
+			if (negate)
+			{
+				for (int k = 0; k < 4; ++k)
+					*(class + k) = ~*(class + k);
+			}
+
+			// A name never contains a "/".
+			*(class + ('/' >> 6)) &= ~(1ULL << ('/' & 63));
+			*i = j + 1;
+			return true;
+		}
+
+		unsigned char lo = read_char(str, len, &j, &escaped), hi = lo;
+
+		if (j + 1 < len && *(str + j) == '-' && *(str + j + 1) != ']')
+		{
+			++j;
+			hi = read_char(str, len, &j, &escaped);
+		}
+
+		for (unsigned c = lo; c <= hi; ++c)
+			class_set(class, (unsigned char)c);
+	}
+
+	return false;
+}
+
+Result glob_compile(PGlobPattern pattern, const char *str, size_t len)
+{
+	bool escaped, literal_prefix = true;
+	size_t i = 0;
+
+	pattern->num_ops = pattern->num_classes = 0;
+	pattern->min_len = pattern->prefix_len = pattern->suffix_len = 0;
+	pattern->has_star = false;
+
+	while (i < len)
+	{
+		if (pattern->num_ops == GLOB_MAX_OPS)
+			return Failure;
+
+		PGlobOp op = pattern->ops + pattern->num_ops++;
+		char c = *(str + i);
+
+		if (c == '*')
+		{
+			op->type = GLOB_OP_STAR;
+			pattern->has_star = true;
+			pattern->suffix_len = 0;
+			literal_prefix = false;
+			++i;
+
+			// Consecutive stars are a single one.
+			while (i < len && *(str + i) == '*')
+				++i;
+
+			continue;
+		}
+
+		++pattern->min_len;
+
+		if (c == '?')
+		{
+			op->type = GLOB_OP_ANY;
+			literal_prefix = false;
+			pattern->suffix_len = 0;
+			++i;
+			continue;
+		}
+
+		if (c == '[' && pattern->num_classes < GLOB_MAX_CLASSES && compile_class(pattern, str, len, &i))
+		{
+			op->type = GLOB_OP_CLASS;
+			op->class = pattern->num_classes++;
+			literal_prefix = false;
+			pattern->suffix_len = 0;
+			continue;
+		}
+
+		else if (c == '[' && pattern->num_classes == GLOB_MAX_CLASSES)
+			return Failure;
+
+		op->type = GLOB_OP_CHAR;
+		op->ch = read_char(str, len, &i, &escaped);
+
+		if (literal_prefix)
+			*(pattern->prefix + pattern->prefix_len++) = op->ch;
+
+		*(pattern->suffix + pattern->suffix_len++) = op->ch;
+	}
+
+	// Without a star, the whole pattern is the prefix.
+	if (!pattern->has_star)
+		pattern->suffix_len = 0;
+
+	pattern->hidden = (pattern->prefix_len > 0 && *pattern->prefix == '.');
+
+	return Success;
+}
+
+/*
+ * @brief Check if an operation matches a character.
+ */
+static bool op_matches(const GlobPattern *pattern, const GlobOp *op, unsigned char c)
+{
+	switch (op->type)
+	{
+		case GLOB_OP_CHAR:
+			return op->ch == c;
+
+		case GLOB_OP_ANY:
+			return true;
+
+		case GLOB_OP_CLASS:
+			return class_has(*(pattern->classes + op->class), c);
+
+		default:
+			return false;
+	}
+}
+
+bool glob_match(const GlobPattern *pattern, const char *name, size_t len)
+{
+	// Hidden files are only matched by a pattern that starts with a ".".
+	if (*name == '.' && !pattern->hidden)
+		return false;
+
+	// Most entries are rejected here, by their length and their literal prefix and suffix.
+	if (len < pattern->min_len || (!pattern->has_star && len != pattern->min_len) ||
+		memcmp(name, pattern->prefix, pattern->prefix_len) != 0 ||
+		memcmp(name + len - pattern->suffix_len, pattern->suffix, pattern->suffix_len) != 0)
+		return false;
+
+	// Match the rest, backtracking only to the last star.
+	int op = 0, star_op = -1;
+	size_t s = 0, star_s = 0;
+
+	while (s < len)
+	{
+		if (op < pattern->num_ops && (pattern->ops + op)->type == GLOB_OP_STAR)
+		{
+			star_op = op++;
+			star_s = s;
+		}
+
+		else if (op < pattern->num_ops && op_matches(pattern, pattern->ops + op, (unsigned char)*(name + s)))
+		{
+			++op;
+			++s;
+		}
+
+		else if (star_op != -1)
+		{
+			op = star_op + 1;
+			s = ++star_s;
+		}
+
+		else
+			return false;
+	}
+
+	while (op < pattern->num_ops && (pattern->ops + op)->type == GLOB_OP_STAR)
+		++op;
+
+	return op == pattern->num_ops;
+}
+
+/*
+ * @brief Add a path to a list.
+ * @param list The list.
+ * @param prefix The directory of the path (may be empty).
+ * @param prefix_len The length of the directory.
+ * @param name The name of the path.
+ * @param name_len The length of the name.
+ * @return true on success, false on allocation failure.
+ */
+static bool list_add(PGlobList list, const char *prefix, size_t prefix_len, const char *name, size_t name_len)
+{
+	bool slash = (prefix_len > 0 && *(prefix + prefix_len - 1) != '/');
+	size_t needed = prefix_len + slash + name_len + 1;
+
+	if (list->len + needed > list->cap)
+	{
+		size_t cap = (list->cap == 0) ? 4096 : list->cap;
+
+		while (list->len + needed > cap)
+			cap *= 2;
+
+		char *tmp = (char *)realloc(list->arena, cap);
+
+		if (tmp == NULL)
+			return false;
+
+		list->arena = tmp;
+		list->cap = cap;
+	}
+
+	if (list->count == list->offsets_cap)
+	{
+		size_t cap = (list->offsets_cap == 0) ? 64 : list->offsets_cap * 2;
+		size_t *tmp = (size_t *)realloc(list->offsets, cap * sizeof(size_t));
+
+		if (tmp == NULL)
+			return false;
+
+		list->offsets = tmp;
+		list->offsets_cap = cap;
+	}
+
+	char *path = list->arena + list->len;
+
+	memcpy(path, prefix, prefix_len);
+
+	if (slash)
+		*(path + prefix_len) = '/';
+
+	memcpy(path + prefix_len + slash, name, name_len);
+	*(path + needed - 1) = '\0';
+
+	*(list->offsets + list->count++) = list->len;
+	list->len += needed;
+
+	return true;
+}
+
+/*
+ * @brief Free the memory of a list, and empty it.
+ */
+static void list_free(PGlobList list)
+{
+	free(list->arena);
+	free(list->offsets);
+	memset(list, 0, sizeof(GlobList));
+}
+
+/*
+ * @brief Match a directory entry, and add it to the matches.
+ * @param name The name of the entry.
+ * @param type The type of the entry.
+ * @param ctx The scan.
+ */
+static void match_entry(const char *name, unsigned char type, void *ctx)
+{
+	PGlobScan scan = (PGlobScan)ctx;
+	size_t len = strlen(name);
+	struct stat st;
+
+	if (!glob_match(scan->pattern, name, len))
+		return;
+
+	// Only a symbolic link (or a file system without entry types) needs a system call to tell a directory.
+	if (scan->dirs_only && type != DT_DIR &&
+		((type != DT_LNK && type != DT_UNKNOWN) || fstatat(scan->fd, name, &st, 0) == -1 || !S_ISDIR(st.st_mode)))
+		return;
+
+	if (!list_add(scan->matches, scan->prefix, scan->prefix_len, name, len))
+		scan->failed = true;
+}
+
+/*
+ * @brief Remove the escapes of the pattern characters, in place.
+ * @param str The string.
+ * @param len The length of the string, or where it ends.
+ * @return The new length of the string.
+ */
+static size_t unescape(char *str, size_t len)
+{
+	size_t out = 0;
+
+	for (size_t i = 0; i < len; ++i)
+	{
+		if (*(str + i) == GLOB_ESCAPE && i + 1 < len && GLOB_IS_SPECIAL(*(str + i + 1)))
+			++i;
+
+		*(str + out++) = *(str + i);
+	}
+
+	*(str + out) = '\0';
+
+	return out;
+}
+
+/*
+ * @brief Check if a string has an unescaped pattern character.
+ * @param str The string.
+ * @param len The length of the string.
+ * @return true if the string is a pattern, false otherwise.
+ */
+static bool has_pattern(const char *str, size_t len)
+{
+	for (size_t i = 0; i < len; ++i)
+	{
+		if (*(str + i) == GLOB_ESCAPE && i + 1 < len && GLOB_IS_SPECIAL(*(str + i + 1)))
+			++i;
+
+		// A "[" is only a pattern character if it's closed.
+		else if (*(str + i) == '*' || *(str + i) == '?' || (*(str + i) == '[' && memchr(str + i, ']', len - i) != NULL))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * @brief Drop a reference to a directory of a walk, and close it if it was the last one.
+ */
+static void dir_release(PGlobDir dir)
+{
+	if (__atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) > 0)
+		return;
+
+	close(dir->fd);
+	free(dir->path);
+	free(dir);
+}
+
+/*
+ * @brief Queue a directory in a walker's deque.
+ * @param walker The walker.
+ * @param task The directory.
+ * @return true on success, false on allocation failure.
+ */
+static bool push_task(PGlobWalker walker, GlobTask task)
+{
+	PGlobDeque deque = &walker->deque;
+	PGlobPool pool = walker->pool;
+
+	pthread_mutex_lock(&deque->lock);
+
+	// Reuse the space the thieves left at the head before growing.
+	if (deque->tail == deque->cap && deque->head > 0)
+	{
+		memmove(deque->tasks, deque->tasks + deque->head, (deque->tail - deque->head) * sizeof(GlobTask));
+		deque->tail -= deque->head;
+		deque->head = 0;
+	}
+
+	if (deque->tail == deque->cap)
+	{
+		size_t cap = (deque->cap == 0) ? 64 : deque->cap * 2;
+		PGlobTask tmp = (PGlobTask)realloc(deque->tasks, cap * sizeof(GlobTask));
+
+		if (tmp == NULL)
+		{
+			pthread_mutex_unlock(&deque->lock);
+			return false;
+		}
+
+		deque->tasks = tmp;
+		deque->cap = cap;
+	}
+
+	*(deque->tasks + deque->tail++) = task;
+	__atomic_add_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&deque->lock);
+
+	// Wake a waiting walker, so it can steal the task.
+	__atomic_add_fetch(&pool->available, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST) > 0)
+	{
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->wake);
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	return true;
+}
+
+/*
+ * @brief Take a directory to walk: the newest of the walker's own, or the oldest of another walker's.
+ * @param walker The walker.
+ * @param task Where to store the directory.
+ * @return true if a directory was taken, false if there are none queued.
+ */
+static bool take_task(PGlobWalker walker, PGlobTask task)
+{
+	PGlobPool pool = walker->pool;
+
+	for (int k = 0; k < pool->num_walkers; ++k)
+	{
+		PGlobDeque deque = &(pool->walkers + (walker->id + k) % pool->num_walkers)->deque;
+		bool taken = false;
+
+		pthread_mutex_lock(&deque->lock);
+
+		if (deque->tail > deque->head)
+		{
+			*task = (k == 0) ? *(deque->tasks + --deque->tail) : *(deque->tasks + deque->head++);
+			taken = true;
+
+			if (deque->head == deque->tail)
+				deque->head = deque->tail = 0;
+		}
+
+		pthread_mutex_unlock(&deque->lock);
+
+		if (taken)
+		{
+			__atomic_sub_fetch(&pool->available, 1, __ATOMIC_SEQ_CST);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * @brief Check if a recursive walk skips a directory (hidden, or ignored by name).
+ */
+static bool is_pruned(const char *name)
+{
+	if (*name == '.' && !glob_options.hidden)
+		return true;
+
+	for (int i = 0; i < glob_options.num_ignored; ++i)
+	{
+		if (strcmp(*(glob_options.ignored + i), name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * @brief Match an entry of a walked directory, and queue it if it's a directory to walk.
+ * @param name The name of the entry.
+ * @param type The type of the entry.
+ * @param ctx The walker.
+ */
+static void walk_entry(const char *name, unsigned char type, void *ctx)
+{
+	PGlobWalker walker = (PGlobWalker)ctx;
+	PGlobDir dir = walker->dir;
+	size_t len = strlen(name);
+	struct stat st;
+
+	if (walker->pool->pattern != NULL && glob_match(walker->pool->pattern, name, len) &&
+		!list_add(&walker->results, dir->path, dir->path_len, name, len))
+		walker->failed = true;
+
+	// Symbolic links aren't followed, so a walk can't loop.
+	if (type == DT_UNKNOWN && fstatat(dir->fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode))
+		type = DT_DIR;
+
+	if (type != DT_DIR || is_pruned(name))
+		return;
+
+	bool slash = (dir->path_len > 0 && *(dir->path + dir->path_len - 1) != '/');
+	GlobTask task = {dir, (char *)malloc(dir->path_len + slash + len + 1), dir->path_len + slash};
+
+	if (task.path == NULL)
+	{
+		walker->failed = true;
+		return;
+	}
+
+	memcpy(task.path, dir->path, dir->path_len);
+
+	if (slash)
+		*(task.path + dir->path_len) = '/';
+
+	memcpy(task.path + task.name, name, len + 1);
+	__atomic_add_fetch(&dir->refs, 1, __ATOMIC_RELAXED);
+
+	if (!push_task(walker, task))
+	{
+		walker->failed = true;
+		free(task.path);
+		dir_release(dir);
+	}
+}
+
+/*
+ * @brief Walk a directory: match its entries, and queue its subdirectories.
+ * @param walker The walker.
+ * @param task The directory.
+ */
+static void walk_directory(PGlobWalker walker, PGlobTask task)
+{
+	int fd = (task->parent != NULL) ? openat(task->parent->fd, task->path + task->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+									: open((*task->path != '\0') ? task->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (task->parent != NULL)
+		dir_release(task->parent);
+
+	PGlobDir dir = (fd != -1) ? (PGlobDir)malloc(sizeof(GlobDir)) : NULL;
+
+	// An unreadable directory is skipped, like by a single level pattern.
+	if (dir == NULL)
+	{
+		if (fd != -1)
+			close(fd);
+
+		free(task->path);
+		return;
+	}
+
+	dir->fd = fd;
+	dir->path = task->path;
+	dir->path_len = strlen(task->path);
+	dir->refs = 1;
+
+	// Without a pattern, "**" matches the directories themselves (the next components are matched in them).
+	if (walker->pool->pattern == NULL && !list_add(&walker->results, "", 0, dir->path, dir->path_len))
+		walker->failed = true;
+
+	walker->dir = dir;
+	scan_directory(fd, walk_entry, walker);
+	walker->dir = NULL;
+	dir_release(dir);
+}
+
+/*
+ * @brief The main loop of a walker: walk directories until none are queued or being walked.
+ * @param arg The walker.
+ * @return NULL.
+ */
+static void *walker_run(void *arg)
+{
+	PGlobWalker walker = (PGlobWalker)arg;
+	PGlobPool pool = walker->pool;
+	GlobTask task;
+
+	for (;;)
+	{
+		if (take_task(walker, &task))
+		{
+			walk_directory(walker, &task);
+
+			if (__atomic_sub_fetch(&pool->pending, 1, __ATOMIC_SEQ_CST) == 0)
+			{
+				pthread_mutex_lock(&pool->lock);
+				pthread_cond_broadcast(&pool->wake);
+				pthread_mutex_unlock(&pool->lock);
+			}
+
+			continue;
+		}
+
+		// Nothing to steal, wait until a directory is queued, or the walk is done.
+		pthread_mutex_lock(&pool->lock);
+		__atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+
+		while (__atomic_load_n(&pool->available, __ATOMIC_SEQ_CST) == 0 && __atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) > 0)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+
+		__atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&pool->lock);
+
+		if (__atomic_load_n(&pool->pending, __ATOMIC_SEQ_CST) == 0)
+			return NULL;
+	}
+}
+
+/*
+ * @brief Walk the trees under a list of directories, with a pool of walkers.
+ * @param roots The directories to walk.
+ * @param pattern The pattern of the entries to match, or NULL to match every directory of the trees.
+ * @param matches The list to add the matching paths to (in no particular order).
+ * @return Success on success, Failure on allocation failure.
+ */
+static Result walk_trees(PGlobList roots, const GlobPattern *pattern, PGlobList matches)
+{
+	long threads = (glob_options.threads > 0) ? glob_options.threads : sysconf(_SC_NPROCESSORS_ONLN);
+	GlobPool pool = {NULL, 0, pattern, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+	pthread_t tids[GLOB_MAX_THREADS];
+	Result res = Success;
+
+	threads = (threads < 1) ? 1 : (threads > GLOB_MAX_THREADS) ? GLOB_MAX_THREADS : threads;
+
+	if ((pool.walkers = (PGlobWalker)calloc(threads, sizeof(GlobWalker))) == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)");
+		return Failure;
+	}
+
+	pool.num_walkers = (int)threads;
+
+	for (int i = 0; i < pool.num_walkers; ++i)
+	{
+		(pool.walkers + i)->pool = &pool;
+		(pool.walkers + i)->id = i;
+		pthread_mutex_init(&(pool.walkers + i)->deque.lock, NULL);
+	}
+
+	// The trees are dealt to the walkers, they steal the rest of the work from each other.
+	for (size_t i = 0; i < roots->count && res == Success; ++i)
+	{
+		GlobTask task = {NULL, strdup(roots->arena + *(roots->offsets + i)), 0};
+
+		if (task.path == NULL || !push_task(pool.walkers + i % pool.num_walkers, task))
+		{
+			free(task.path);
+			res = Failure;
+		}
+	}
+
+	// The calling thread is the first walker, a single threaded walk doesn't start any thread.
+	int started = 1;
+
+	for (; res == Success && started < pool.num_walkers; ++started)
+	{
+		if (pthread_create(tids + started, NULL, walker_run, pool.walkers + started) != 0)
+			break;
+	}
+
+	walker_run(pool.walkers);
+
+	for (int i = 1; i < started; ++i)
+		pthread_join(*(tids + i), NULL);
+
+	// A failed queueing leaves tasks behind, they still hold their paths.
+	GlobTask task;
+
+	while (take_task(pool.walkers, &task))
+	{
+		if (task.parent != NULL)
+			dir_release(task.parent);
+
+		free(task.path);
+	}
+
+	for (int i = 0; i < pool.num_walkers; ++i)
+	{
+		PGlobWalker walker = pool.walkers + i;
+
+		for (size_t j = 0; j < walker->results.count && res == Success; ++j)
+		{
+			const char *path = walker->results.arena + *(walker->results.offsets + j);
+
+			if (!list_add(matches, "", 0, path, strlen(path)))
+				res = Failure;
+		}
+
+		if (walker->failed)
+			res = Failure;
+
+		list_free(&walker->results);
+		free(walker->deque.tasks);
+		pthread_mutex_destroy(&walker->deque.lock);
+	}
+
+	free(pool.walkers);
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.wake);
+
+	return res;
+}
+
+/*
+ * @brief Expand a pattern into the paths it matches.
+ * @param word The pattern, modified by the function.
+ * @param results The list to add the matching paths to (unsorted).
+ * @return Success on success, Failure on allocation failure.
+ */
+static Result expand_pattern(char *word, PGlobList results)
+{
+	GlobList level[2] = {{0}, {0}};
+	PGlobList curr = level, next = level + 1;
+	PGlobPattern pattern = (PGlobPattern)malloc(sizeof(GlobPattern));
+	Result res = Success;
+
+	if (pattern == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return Failure;
+	}
+
+	// The paths are built one component at a time, starting from the root or the working directory.
+	bool absolute = (*word == '/');
+
+	if (!list_add(curr, absolute ? "/" : "", absolute, "", 0))
+		res = Failure;
+
+	for (char *component = word + absolute; res == Success && component != NULL && curr->count > 0;)
+	{
+		char *slash = strchr(component, '/');
+		size_t len = (slash != NULL) ? (size_t)(slash - component) : strlen(component);
+		bool last = (slash == NULL);
+
+		// "**" walks the trees under every path. When a single component follows it, the component is matched
+		// during the walk, otherwise the walk collects the directories the next components are matched in.
+		if (len == 2 && strncmp(component, "**", 2) == 0)
+		{
+			const char *rest = last ? "*" : slash + 1;
+			bool match_rest = ((last || (strchr(rest, '/') == NULL && strcmp(rest, "**") != 0)) &&
+							   glob_compile(pattern, rest, strlen(rest)) == Success);
+
+			if (walk_trees(curr, match_rest ? pattern : NULL, next) == Failure)
+				res = Failure;
+
+			last |= match_rest;
+		}
+
+		// A literal component is appended to every path, only the last one is checked for existence.
+		else if (!has_pattern(component, len) || glob_compile(pattern, component, len) == Failure)
+		{
+			// Unescaped in a copy, the word is passed as is if nothing matches.
+			char literal[len + 1];
+
+			memcpy(literal, component, len);
+			len = unescape(literal, len);
+
+			for (size_t i = 0; i < curr->count && res == Success; ++i)
+			{
+				const char *prefix = curr->arena + *(curr->offsets + i);
+				size_t prefix_len = strlen(prefix);
+				struct stat st;
+
+				if (!list_add(next, prefix, prefix_len, literal, len))
+					res = Failure;
+
+				else if (last && fstatat(AT_FDCWD, next->arena + *(next->offsets + next->count - 1), &st, AT_SYMLINK_NOFOLLOW) == -1)
+				{
+					next->len = *(next->offsets + --next->count);
+				}
+			}
+		}
+
+		else
+		{
+			for (size_t i = 0; i < curr->count && res == Success; ++i)
+			{
+				const char *prefix = curr->arena + *(curr->offsets + i);
+				GlobScan scan = {pattern, !last, -1, prefix, strlen(prefix), next, false};
+
+				if ((scan.fd = open((*prefix != '\0') ? prefix : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+					continue;
+
+				scan_directory(scan.fd, match_entry, &scan);
+				close(scan.fd);
+
+				if (scan.failed)
+					res = Failure;
+			}
+		}
+
+		// The next level becomes the current one.
+		PGlobList tmp = curr;
+		curr = next;
+		next = tmp;
+		next->len = next->count = 0;
+
+		if (last)
+			break;
+
+		component = slash + 1;
+	}
+
+	if (res == Success)
+	{
+		for (size_t i = 0; i < curr->count && res == Success; ++i)
+		{
+			const char *path = curr->arena + *(curr->offsets + i);
+
+			if (!list_add(results, "", 0, path, strlen(path)))
+				res = Failure;
+		}
+	}
+
+	else
+		perror("Internal error: System call faliure: realloc(3)");
+
+	list_free(level);
+	list_free(level + 1);
+	free(pattern);
+
+	return res;
+}
+
+/*
+ * @brief Compare two paths, for qsort(3).
+ */
+static int compare_paths(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/*
+ * @brief Replace an argument with the paths it matched, sorted.
+ * @param argv A pointer to the array of arguments.
+ * @param index The index of the argument.
+ * @param results The paths (at least one).
+ * @return The number of arguments the argument was replaced with, or -1 on allocation failure.
+ */
+static long splice_results(char ***argv, int index, PGlobList results)
+{
+	size_t count = results->count, num_args = 0;
+	char **command = *argv, **paths = (char **)malloc(count * sizeof(char *));
+
+	while (*(command + num_args) != NULL)
+		++num_args;
+
+	if (paths == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return -1;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+		*(paths + i) = results->arena + *(results->offsets + i);
+
+	qsort(paths, count, sizeof(char *), compare_paths);
+
+	// Each argument is freed on its own, so each path gets its own copy.
+	for (size_t i = 0; i < count; ++i)
+	{
+		if ((*(paths + i) = strdup(*(paths + i))) == NULL)
+		{
+			perror("Internal error: System call faliure: strdup(3)");
+
+			while (i > 0)
+				free(*(paths + --i));
+
+			free(paths);
+			return -1;
+		}
+	}
+
+	char **tmp = (char **)realloc(command, (num_args + count) * sizeof(char *));
+
+	if (tmp == NULL)
+	{
+		perror("Internal error: System call faliure: realloc(3)");
+
+		for (size_t i = 0; i < count; ++i)
+			free(*(paths + i));
+
+		free(paths);
+		return -1;
+	}
+
+	STATS_ADD(allocations, count + 1);
+
+	command = *argv = tmp;
+	free(*(command + index));
+	memmove(command + index + count, command + index + 1, (num_args - index) * sizeof(char *));
+	memcpy(command + index, paths, count * sizeof(char *));
+	free(paths);
+
+	return (long)count;
+}
+
+char *glob_unescape(char *str)
+{
+	unescape(str, strlen(str));
+
+	return str;
+}
+
+void glob_expand(char ***argv)
+{
+	// The value of an assignment ("$x = *") is never expanded.
+	bool assignment = (**argv != NULL && *(*argv + 1) != NULL && strcmp(*(*argv + 1), "=") == 0);
+	bool in_test = false;
+
+	for (int i = 0; *(*argv + i) != NULL; ++i)
+	{
+		char *word = *(*argv + i);
+
+		// The words of a "[[ ... ]]" test are patterns of the test itself, it unescapes them.
+		if ((in_test = in_test_expression(word, in_test)))
+			continue;
+
+		// Most arguments have nothing to expand or unescape.
+		if (strpbrk(word, "*?[\\") == NULL)
+			continue;
+
+		size_t len = strlen(word);
+
+		if ((assignment && i >= 2) || is_redirect(word) || is_process_substitution(word) ||
+			(i > 0 && redirect_word_follows(*(*argv + i - 1))) || !has_pattern(word, len))
+		{
+			// Process substitutions are parsed again by their subshell, with their quotes.
+			if (!is_process_substitution(word))
+				unescape(word, len);
+
+			continue;
+		}
+
+		GlobList results = {0};
+
+		if (expand_pattern(word, &results) == Success && results.count > 0)
+		{
+			long count = splice_results(argv, i, &results);
+
+			if (count > 0)
+			{
+				list_free(&results);
+				i += count - 1;
+				continue;
+			}
+		}
+
+		// A pattern that matches nothing is passed as is.
+		list_free(&results);
+		unescape(*(*argv + i), strlen(*(*argv + i)));
+	}
+}
+
+Result glob_set_option(const char *name, const char *value)
+{
+	if (strcmp(name, "threads") == 0)
+	{
+		char *end = NULL;
+		long threads = strtol(value, &end, 10);
+
+		if (*value == '\0' || *end != '\0' || threads < 0 || threads > GLOB_MAX_THREADS)
+			return Failure;
+
+		glob_options.threads = (int)threads;
+		return Success;
+	}
+
+	if (strcmp(name, "hidden") == 0 && (strcmp(value, "on") == 0 || strcmp(value, "off") == 0))
+	{
+		glob_options.hidden = (strcmp(value, "on") == 0);
+		return Success;
+	}
+
+	if (strcmp(name, "ignore") != 0)
+		return Failure;
+
+	glob_free_options();
+
+	if (strcmp(value, "off") == 0)
+		return Success;
+
+	// The list is ":" separated, like $PATH.
+	for (const char *start = value; *start != '\0';)
+	{
+		size_t len = strcspn(start, ":");
+
+		if (len > 0)
+		{
+			if (glob_options.num_ignored == GLOB_MAX_IGNORED ||
+				(*(glob_options.ignored + glob_options.num_ignored) = strndup(start, len)) == NULL)
+				return Failure;
+
+			++glob_options.num_ignored;
+		}
+
+		start += len + (*(start + len) == ':');
+	}
+
+	return Success;
+}
+
+void glob_free_options()
+{
+	for (int i = 0; i < glob_options.num_ignored; ++i)
+		free(*(glob_options.ignored + i));
+
+	glob_options.num_ignored = 0;
+}
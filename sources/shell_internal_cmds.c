@@ -23,8 +23,11 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <ctype.h>
+#include <errno.h>
 
-Result cmdCD(char *path, int argc)
+Result cmdCD(PShellContext ctx, char *path, int argc)
 {
 	// Only one argument is allowed, like in the original shell.
 	if (argc > 2)
@@ -38,9 +41,9 @@ Result cmdCD(char *path, int argc)
 		if (strcmp(path, "~") == 0)
 		{
 			// Save current working directory before changing it.
-			getcwd(workingdir, SHELL_MAX_PATH_LENGTH);
+			getcwd(ctx->workingdir, SHELL_MAX_PATH_LENGTH);
 
-			if (chdir(homedir) == -1)
+			if (chdir(ctx->homedir) == -1)
 			{
 				perror("Internal error: System call faliure: chdir(2)");
 				return Failure;
@@ -52,21 +55,21 @@ Result cmdCD(char *path, int argc)
 		// Previous directory.
 		else if (strcmp(path, "-") == 0)
 		{
-			if (strcmp(workingdir, "") == 0)
+			if (strcmp(ctx->workingdir, "") == 0)
 				return Success;
 
-			if (chdir(workingdir) == -1)
+			if (chdir(ctx->workingdir) == -1)
 			{
 				perror("Internal error: System call faliure: chdir(2)");
 				return Failure;
 			}
 
-			getcwd(workingdir, SHELL_MAX_PATH_LENGTH);
+			getcwd(ctx->workingdir, SHELL_MAX_PATH_LENGTH);
 
 			return Success;
 		}
 
-		getcwd(workingdir, SHELL_MAX_PATH_LENGTH);
+		getcwd(ctx->workingdir, SHELL_MAX_PATH_LENGTH);
 
 		if (chdir(path) == -1)
 		{
@@ -78,9 +81,9 @@ Result cmdCD(char *path, int argc)
 	// No arguments - go to home directory.
 	else
 	{
-		getcwd(workingdir, SHELL_MAX_PATH_LENGTH);
+		getcwd(ctx->workingdir, SHELL_MAX_PATH_LENGTH);
 
-		if (chdir(homedir) == -1)
+		if (chdir(ctx->homedir) == -1)
 		{
 			perror("Internal error: System call faliure: chdir(2)");
 			return Failure;
@@ -90,9 +93,9 @@ Result cmdCD(char *path, int argc)
 	return Success;
 }
 
-Result cmdPWD()
+Result cmdPWD(PShellContext ctx)
 {
-	fprintf(stdout, "%s\n", cwd);
+	fprintf(stdout, "%s\n", ctx->cwd);
 	return Success;
 }
 
@@ -103,7 +106,7 @@ Result cmdClear()
 	return Success;
 }
 
-Result cmdChangePrompt(char *new_prompt)
+Result cmdChangePrompt(PShellContext ctx, char *new_prompt)
 {
 	if (new_prompt == NULL)
 	{
@@ -117,19 +120,19 @@ Result cmdChangePrompt(char *new_prompt)
 		return Failure;
 	}
 
-	strcpy(curr_prompt, new_prompt);
+	strcpy(ctx->curr_prompt, new_prompt);
 	return Success;
 }
 
-Result cmdrepeatLastCommand()
+Result cmdrepeatLastCommand(PShellContext ctx)
 {
-	if (commandHistory->tail == NULL)
+	if (ctx->commandHistory->tail == NULL)
 	{
 		fprintf(stderr, "No commands in history.\n");
 		return Failure;
 	}
 
-	PCommand lastCommand = (PCommand)commandHistory->tail->data;
+	PCommand lastCommand = (PCommand)ctx->commandHistory->tail->data;
 	if (lastCommand == NULL || strlen(lastCommand->command) == 0)
 	{
 		fprintf(stderr, "No last command to repeat.\n");
@@ -137,27 +140,15 @@ Result cmdrepeatLastCommand()
 	}
 
 	// Resend the last command to the parser and executor
-	char **argv = NULL;
-
-	if (parse_command(lastCommand->command, &argv) == External)
-		execute_command(argv);
-
-	// Free argv after execution
-	if (argv != NULL)
-	{
-		for (size_t k = 0; *(argv + k) != NULL; ++k)
-			free(*(argv + k));
-
-		free(argv);
-	}
+	shell_run_command(ctx, lastCommand->command);
 
 	return Success;
 }
 
-Result setVariable(char *name, char *value)
+Result setVariable(PShellContext ctx, char *name, char *value)
 {
 	// Check if the variable already exists. If yes, update its value.
-	PNode curr = variableList->head;
+	PNode curr = ctx->variableList->head;
 	while (curr != NULL)
 	{
 		PVariable variable = (PVariable)(curr->data);
@@ -171,23 +162,30 @@ Result setVariable(char *name, char *value)
 				return Failure;
 			}
 
+			STATS_INC(allocations);
 			strcpy(tmp, value);
 			free(variable->value);
 			variable->value = tmp;
+
+			// The environment is rebuilt before the next command is executed.
+			if (variable->exported)
+				ctx->env->dirty = true;
+
 			return Success;
 		}
 		curr = curr->next;
 	}
 
-	// Add a new variable
+	// Add a new variable (the variable, its name, its value and its list node).
 	PVariable variable = create_variable(name, value);
+	STATS_ADD(allocations, 4);
 	if (variable == NULL)
 	{
 		fprintf(stderr, "Error: setVariable() failed: create_variable() failed\n");
 		return Failure;
 	}
 
-	if (addNode(variableList, variable) == 1)
+	if (addNode(ctx->variableList, variable) == 1)
 	{
 		fprintf(stderr, "Error: setVariable() failed: add_node() failed\n");
 		destroy_variable(variable);
@@ -197,43 +195,726 @@ Result setVariable(char *name, char *value)
 	return Success;
 }
 
-Result cmdRead(char *variableName)
+Result unsetVariable(PShellContext ctx, char *name)
 {
-	char input[SHELL_MAX_COMMAND_LENGTH] = {0};
+	for (PNode curr = ctx->variableList->head; curr != NULL; curr = curr->next)
+	{
+		PVariable variable = (PVariable)(curr->data);
 
-	if (fgets(input, sizeof(input), stdin) == NULL)
+		if (strcmp(variable->name, name) == 0)
+		{
+			if (variable->exported)
+				ctx->env->dirty = true;
+
+			removeNode(ctx->variableList, variable);
+			destroy_variable(variable);
+			return Success;
+		}
+	}
+
+	return Failure;
+}
+
+Result cmdRead(PShellContext ctx, char *variableName)
+{
+	// Read through the line editor, it may already hold the next lines of input.
+	char *input = read_line(NULL, NULL, NULL);
+
+	if (input == NULL)
 		return Failure; // Error or end-of-file
 
-	// Remove newline character
-	*(input + strcspn(input, "\n")) = '\0';
+	return setVariable(ctx, variableName, input);
+}
+
+/*
+ * @brief Print a history entry with its timing.
+ * @param index The number of the entry in the history.
+ * @param command The entry.
+ * @param now_mono The current time, from a monotonic clock.
+ * @param now_real The current time, from the real time clock.
+ */
+static void print_timed_command(int index, PCommand command, uint64_t now_mono, uint64_t now_real)
+{
+	char start[16] = "-", duration[32] = "-", pids[64] = "-";
+
+	// The monotonic start is converted to a wall clock time for display.
+	if (command->start_ns != 0)
+	{
+		uint64_t start_real = now_real - (now_mono - command->start_ns);
+		time_t start_sec = (time_t)(start_real / 1000000000ULL);
+		struct tm tm;
+
+		if (localtime_r(&start_sec, &tm) != NULL)
+		{
+			size_t len = strftime(start, sizeof(start), "%H:%M:%S", &tm);
+			snprintf(start + len, sizeof(start) - len, ".%03d", (int)(start_real / 1000000ULL % 1000));
+		}
+	}
+
+	if (command->end_ns != 0)
+		snprintf(duration, sizeof(duration), "%.3fms", (command->end_ns - command->start_ns) / 1e6);
 
-	return setVariable(variableName, input);
+	for (int i = 0, len = 0; i < command->num_pids && len < (int)sizeof(pids); ++i)
+		len += snprintf(pids + len, sizeof(pids) - len, "%s%d", (i > 0) ? "," : "", (int)*(command->pids + i));
+
+	fprintf(stdout, "%d\t%-12s\t%-12s\t%-5s\t%-20s\t%s\n", index, start, duration,
+			(command->timed_out ? "TIME" : (command->status == 0 ? "SUCC" : "FAIL")), pids, command->command);
 }
 
-Result cmdHistory(int argc)
+/*
+ * @brief A finished history entry, along with its number in the history.
+ */
+typedef struct TimedEntry {
+	PCommand command;
+	int index;
+} TimedEntry, *PTimedEntry;
+
+/*
+ * @brief Compare two history entries by their duration, the slowest first.
+ */
+static int compare_duration(const void *a, const void *b)
 {
-	if (argc > 2)
+	PCommand ca = ((PTimedEntry)a)->command, cb = ((PTimedEntry)b)->command;
+	uint64_t da = ca->end_ns - ca->start_ns, db = cb->end_ns - cb->start_ns;
+
+	return (da < db) - (da > db);
+}
+
+Result cmdHistory(PShellContext ctx, char **args)
+{
+	bool timed = false;
+	long slowest = -1;
+
+	if (*args != NULL && strcmp(*args, "-t") == 0 && *(args + 1) == NULL)
+		timed = true;
+
+	else if (*args != NULL && strcmp(*args, "--slowest") == 0 && *(args + 1) != NULL && *(args + 2) == NULL)
 	{
-		fprintf(stderr, "Too many arguments.\n");
+		char *end = NULL;
+		slowest = strtol(*(args + 1), &end, 10);
+
+		if (*end != '\0' || slowest < 0)
+			slowest = -1;
+	}
+
+	if (*args != NULL && !timed && slowest < 0)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_CMD_HISTORY_USAGE);
 		return Failure;
 	}
 
-	// Print all history
-	PNode curr = commandHistory->head;
+	PNode curr = ctx->commandHistory->head;
 	int i = 1;
 	fprintf(stdout, "Command History:\n");
-	fprintf(stdout, "#\t%-20s\t%-5s\t%-5s\t%-5s\n", "CMD", "STAT", "INT", "BG");
 
-	while (curr != NULL)
+	if (!timed && slowest < 0)
 	{
-		PCommand command = (PCommand)(curr->data);
-		fprintf(stdout, "%d\t%-20s\t%-5s\t%-5s\t%-5s\n", i, command->command,
-				(command->status == 0 ? "SUCC" : "FAIL"),
-				(command->isInternal == 0 ? "NO" : "YES"),
-				(command->background == 0 ? "NO" : "YES"));
-		curr = curr->next;
-		i++;
+		// Print all history
+		fprintf(stdout, "#\t%-20s\t%-5s\t%-5s\t%-5s\n", "CMD", "STAT", "INT", "BG");
+
+		while (curr != NULL)
+		{
+			PCommand command = (PCommand)(curr->data);
+			fprintf(stdout, "%d\t%-20s\t%-5s\t%-5s\t%-5s\n", i, command->command,
+					(command->timed_out ? "TIME" : (command->status == 0 ? "SUCC" : "FAIL")),
+					(command->isInternal == 0 ? "NO" : "YES"),
+					(command->background == 0 ? "NO" : "YES"));
+			curr = curr->next;
+			i++;
+		}
+
+		return Success;
+	}
+
+	uint64_t now_mono = stats_now();
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	uint64_t now_real = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+
+	fprintf(stdout, "#\t%-12s\t%-12s\t%-5s\t%-20s\t%s\n", "START", "DURATION", "STAT", "PIDS", "CMD");
+
+	if (timed)
+	{
+		for (; curr != NULL; curr = curr->next, ++i)
+			print_timed_command(i, (PCommand)(curr->data), now_mono, now_real);
+
+		return Success;
+	}
+
+	// Rank the finished commands by their duration.
+	size_t count = 0;
+
+	for (PNode node = curr; node != NULL; node = node->next)
+		count += (((PCommand)(node->data))->end_ns != 0);
+
+	PTimedEntry finished = (PTimedEntry)malloc((count + 1) * sizeof(TimedEntry));
+
+	if (finished == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return Failure;
+	}
+
+	for (count = 0; curr != NULL; curr = curr->next, ++i)
+	{
+		if (((PCommand)(curr->data))->end_ns != 0)
+		{
+			(finished + count)->command = (PCommand)(curr->data);
+			(finished + count++)->index = i;
+		}
+	}
+
+	qsort(finished, count, sizeof(TimedEntry), compare_duration);
+
+	// The slowest commands keep their number in the history, the same one history and history -t print.
+	for (size_t k = 0; k < count && k < (size_t)slowest; ++k)
+		print_timed_command((finished + k)->index, (finished + k)->command, now_mono, now_real);
+
+	free(finished);
+
+	return Success;
+}
+
+Result cmdStats(char **args)
+{
+	bool json = false, reset = false;
+
+	for (; *args != NULL; ++args)
+	{
+		if (strcmp(*args, "-j") == 0 || strcmp(*args, "--json") == 0)
+			json = true;
+
+		else if (strcmp(*args, "-r") == 0 || strcmp(*args, "--reset") == 0)
+			reset = true;
+
+		else
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_STATS_USAGE);
+			return Failure;
+		}
+	}
+
+	if (reset)
+		stats_reset();
+
+	else
+		stats_print(stdout, json);
+
+	return Success;
+}
+
+Result cmdSet(char **args)
+{
+	if (*args != NULL && strcmp(*args, "glob") == 0 && *(args + 1) != NULL && *(args + 2) != NULL && *(args + 3) == NULL)
+	{
+		if (glob_set_option(*(args + 1), *(args + 2)) == Failure)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_SET_USAGE);
+			return Failure;
+		}
+
+		return Success;
+	}
+
+	if (*args == NULL || strcmp(*args, "trace") != 0 || *(args + 1) == NULL || *(args + 2) != NULL)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_CMD_SET_USAGE);
+		return Failure;
+	}
+
+	if (strcmp(*(args + 1), "off") == 0)
+	{
+		trace_close();
+		return Success;
+	}
+
+	return trace_open(*(args + 1));
+}
+
+Result cmdAlias(PShellContext ctx, char **args)
+{
+	Result res = Success;
+
+	if (*args == NULL)
+		return alias_print(ctx, stdout, NULL);
+
+	for (; *args != NULL; ++args)
+	{
+		char *equals = strchr(*args, '=');
+
+		if (equals == NULL)
+		{
+			if (alias_print(ctx, stdout, *args) == Failure)
+			{
+				fprintf(stderr, "%s: %s\n", SHELL_ERR_CMD_ALIAS_NOT_FOUND, *args);
+				res = Failure;
+			}
+
+			continue;
+		}
+
+		*equals = '\0';
+
+		if (equals == *args || alias_set(ctx, *args, equals + 1) == Failure)
+		{
+			*equals = '=';
+			fprintf(stderr, "%s: %s\n", SHELL_ERR_CMD_ALIAS_INVALID, *args);
+			res = Failure;
+		}
+	}
+
+	return res;
+}
+
+Result cmdUnalias(PShellContext ctx, char **args)
+{
+	Result res = Success;
+
+	if (*args == NULL)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_CMD_UNALIAS_USAGE);
+		return Failure;
+	}
+
+	if (strcmp(*args, "-a") == 0 && *(args + 1) == NULL)
+	{
+		alias_free(ctx);
+		return Success;
+	}
+
+	for (; *args != NULL; ++args)
+	{
+		if (alias_unset(ctx, *args) == Failure)
+		{
+			fprintf(stderr, "%s: %s\n", SHELL_ERR_CMD_ALIAS_NOT_FOUND, *args);
+			res = Failure;
+		}
+	}
+
+	return res;
+}
+
+int cmdReturn(PShellContext ctx, char **args)
+{
+	if (ctx->frame == NULL)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_CMD_RETURN_OUTSIDE);
+		return 1;
+	}
+
+	ctx->frame->returning = true;
+
+	// Without a status, the function returns the status of the last command.
+	char *status = (*args != NULL) ? *args : get_variable(ctx->variableList, SHELL_CMD_LAST_STATUS);
+
+	return (status != NULL) ? atoi(status) & 0xff : 0;
+}
+
+Result cmdExport(PShellContext ctx, char **args)
+{
+	Result res = Success;
+
+	if (*args == NULL)
+	{
+		env_print(ctx, stdout);
+		return Success;
+	}
+
+	for (; *args != NULL; ++args)
+	{
+		char *equals = strchr(*args, '=');
+
+		if (equals != NULL)
+			*equals = '\0';
+
+		// The value is set first, the variable is exported along with it.
+		if (!env_valid_name(*args) || (equals != NULL && setVariable(ctx, *args, equals + 1) == Failure) ||
+			env_export(ctx, *args) == Failure)
+		{
+			if (equals != NULL)
+				*equals = '=';
+
+			fprintf(stderr, "%s: %s: %s\n", SHELL_CMD_EXPORT, SHELL_ERR_CMD_VAR_INVALID, *args);
+			res = Failure;
+		}
 	}
 
+	return res;
+}
+
+Result cmdUnset(PShellContext ctx, char **args)
+{
+	Result res = Success;
+	bool functions = false;
+
+	if (*args != NULL && (strcmp(*args, "-f") == 0 || strcmp(*args, "-v") == 0))
+		functions = (*(*args++ + 1) == 'f');
+
+	if (*args == NULL)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_CMD_UNSET_USAGE);
+		return Failure;
+	}
+
+	for (; *args != NULL; ++args)
+	{
+		if (functions)
+		{
+			function_unset(ctx, *args);
+			continue;
+		}
+
+		// $? is reserved.
+		if (!env_valid_name(*args))
+		{
+			fprintf(stderr, "%s: %s: %s\n", SHELL_CMD_UNSET, SHELL_ERR_CMD_VAR_INVALID, *args);
+			res = Failure;
+			continue;
+		}
+
+		// Unsetting a variable that doesn't exist isn't an error.
+		unsetVariable(ctx, *args);
+		env_unset(ctx, *args);
+	}
+
+	return res;
+}
+
+int cmdTest(char **args, const char *name)
+{
+	int argc = 0;
+	bool extended = (strcmp(name, SHELL_CMD_DBRACKET) == 0);
+	const char *end = extended ? SHELL_CMD_DBRACKET_END : (strcmp(name, SHELL_CMD_BRACKET) == 0) ? SHELL_CMD_BRACKET_END : NULL;
+
+	while (*(args + argc) != NULL)
+		++argc;
+
+	if (end != NULL)
+	{
+		if (argc == 0 || strcmp(*(args + argc - 1), end) != 0)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_CMD_TEST_BRACKET);
+			return TEST_ERROR;
+		}
+
+		--argc;
+	}
+
+	return test_evaluate(args, argc, extended);
+}
+
+/*
+ * @brief Decode a backslash escape.
+ * @param str The escape, starting at its backslash.
+ * @param octal_zero True if an octal escape starts with a "0" ("\0nnn", as in echo and %b), False otherwise ("\nnn").
+ * @param ch The decoded character, EOF for "\c" (stop the output), or a backslash if the escape isn't known.
+ * @return A pointer to the last character of the escape.
+ */
+static const char *decode_escape(const char *str, bool octal_zero, int *ch)
+{
+	const char *simple = "\\\\a\ab\be\033f\fn\nr\rt\tv\v", *digit = str + 1;
+	int value = 0, count = 0;
+
+	for (; *simple != '\0'; simple += 2)
+	{
+		if (*(str + 1) == *simple)
+		{
+			*ch = (unsigned char)*(simple + 1);
+			return str + 1;
+		}
+	}
+
+	switch (*(str + 1))
+	{
+		case 'c':
+			*ch = EOF;
+			return str + 1;
+
+		case 'x':
+			for (++digit; count < 2 && isxdigit((unsigned char)*digit); ++count, ++digit)
+				value = value * 16 + (isdigit((unsigned char)*digit) ? *digit - '0' : tolower((unsigned char)*digit) - 'a' + 10);
+
+			break;
+
+		default:
+			if (*digit < '0' || *digit > '7' || (octal_zero && *digit++ != '0'))
+				break;
+
+			for (; count < 3 && *digit >= '0' && *digit <= '7'; ++count, ++digit)
+				value = value * 8 + (*digit - '0');
+
+			// "\0" alone is a valid escape of echo.
+			count += (octal_zero && count == 0);
+			break;
+	}
+
+	if (count == 0)
+	{
+		*ch = '\\';
+		return str;
+	}
+
+	*ch = value & 0xFF;
+
+	return digit - 1;
+}
+
+/*
+ * @brief Print a string, interpreting its backslash escapes (as "echo -e" and printf's %b do).
+ * @param str The string.
+ * @return False if the output was stopped by a "\c" escape, True otherwise.
+ */
+static bool print_escaped(const char *str)
+{
+	for (; *str != '\0'; ++str)
+	{
+		// Print the run of plain characters at once.
+		size_t plain = strcspn(str, "\\");
+
+		if (plain > 0)
+		{
+			fwrite(str, 1, plain, stdout);
+			str += plain - 1;
+			continue;
+		}
+
+		int ch = 0;
+
+		str = decode_escape(str, true, &ch);
+
+		if (ch == EOF)
+			return false;
+
+		putchar(ch);
+	}
+
+	return true;
+}
+
+Result cmdEcho(char **args)
+{
+	bool newline = true, escapes = false;
+
+	// A word is an option only if all of its characters are options ("-nx" is printed).
+	for (; *args != NULL && **args == '-' && *(*args + 1) != '\0' && strspn(*args + 1, "neE") == strlen(*args + 1); ++args)
+	{
+		for (const char *opt = *args + 1; *opt != '\0'; ++opt)
+		{
+			if (*opt == 'n')
+				newline = false;
+
+			else
+				escapes = (*opt == 'e');
+		}
+	}
+
+	for (char **arg = args; *arg != NULL; ++arg)
+	{
+		if (arg != args)
+			putchar(' ');
+
+		if (!escapes)
+			fputs(*arg, stdout);
+
+		else if (!print_escaped(*arg))
+			return Success;
+	}
+
+	if (newline)
+		putchar('\n');
+
 	return Success;
-}
\ No newline at end of file
+}
+
+/*
+ * @brief Parse a numeric argument of printf.
+ * @param arg The argument, NULL if it's missing (it's 0 then).
+ * @param conv The conversion it's printed with.
+ * @param value The parsed value, as a signed or an unsigned integer, or as a floating point number.
+ * @return Success if the argument is a number, Failure otherwise (the value is what was parsed of it).
+ * @note An argument that starts with a quote is the code of the character after it, as in other shells.
+ */
+static Result parse_printf_number(const char *arg, char conv, long long *sval, unsigned long long *uval, double *dval)
+{
+	char *end = NULL;
+
+	*sval = 0;
+	*uval = 0;
+	*dval = 0;
+
+	if (arg == NULL || *arg == '\0')
+		return Success;
+
+	else if (*arg == '\'' || *arg == '"')
+	{
+		*sval = (unsigned char)*(arg + 1);
+		*uval = (unsigned long long)*sval;
+		*dval = (double)*sval;
+		return Success;
+	}
+
+	errno = 0;
+
+	if (strchr("feEgG", conv) != NULL)
+		*dval = strtod(arg, &end);
+
+	else if (conv == 'd' || conv == 'i')
+		*sval = strtoll(arg, &end, 0);
+
+	else
+		*uval = strtoull(arg, &end, 0);
+
+	return (errno == 0 && end != arg && *end == '\0') ? Success : Failure;
+}
+
+/*
+ * @brief Print a single conversion of a printf format.
+ * @param spec The conversion, starting at its "%".
+ * @param args A pointer to the next argument, advanced past the arguments the conversion consumed.
+ * @param res The result of the command, set to Failure if the argument isn't valid.
+ * @param stop Set to True if the output was stopped by a "\c" escape of a %b argument.
+ * @return A pointer to the last character of the conversion.
+ */
+static const char *print_conversion(const char *spec, char ***args, Result *res, bool *stop)
+{
+	// The flags, width and precision are passed to printf(3) as they are, along with a length modifier.
+	size_t len = 1 + strspn(spec + 1, "-+ #0");
+
+	len += strspn(spec + len, "0123456789");
+
+	if (*(spec + len) == '.')
+		len += 1 + strspn(spec + len + 1, "0123456789");
+
+	char conv = *(spec + len), format[32];
+	const char *arg = **args;
+
+	if (conv == '\0' || strchr("sbcdiuoxXfeEgG", conv) == NULL || len + 3 >= sizeof(format))
+	{
+		fwrite(spec, 1, len + (conv != '\0'), stdout);
+		return spec + len - (conv == '\0');
+	}
+
+	if (arg != NULL)
+		++*args;
+
+	memcpy(format, spec, len);
+
+	if (conv == 's' || conv == 'c' || conv == 'b')
+	{
+		char first[2] = {(arg != NULL) ? *arg : '\0', '\0'};
+
+		*(format + len) = 's';
+		*(format + len + 1) = '\0';
+
+		if (conv == 'b')
+			*stop = (arg != NULL && !print_escaped(arg));
+
+		else
+			printf(format, (conv == 'c') ? first : (arg != NULL) ? arg : "");
+
+		return spec + len;
+	}
+
+	long long sval = 0;
+	unsigned long long uval = 0;
+	double dval = 0;
+
+	if (parse_printf_number(arg, conv, &sval, &uval, &dval) == Failure)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_CMD_PRINTF_NUMBER);
+		*res = Failure;
+	}
+
+	if (strchr("feEgG", conv) != NULL)
+	{
+		*(format + len) = conv;
+		*(format + len + 1) = '\0';
+		printf(format, dval);
+	}
+
+	else
+	{
+		*(format + len) = 'l';
+		*(format + len + 1) = 'l';
+		*(format + len + 2) = conv;
+		*(format + len + 3) = '\0';
+
+		if (conv == 'd' || conv == 'i')
+			printf(format, sval);
+
+		else
+			printf(format, uval);
+	}
+
+	return spec + len;
+}
+
+Result cmdPrintf(char **args)
+{
+	if (*args == NULL)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_CMD_PRINTF_USAGE);
+		return Failure;
+	}
+
+	const char *format = *args++;
+	Result res = Success;
+	bool stop = false;
+	char **start = NULL;
+
+	// The format is reused as long as it consumes arguments.
+	do
+	{
+		start = args;
+
+		for (const char *p = format; *p != '\0' && !stop; ++p)
+		{
+			size_t plain = strcspn(p, "\\%");
+
+			if (plain > 0)
+			{
+				fwrite(p, 1, plain, stdout);
+				p += plain - 1;
+			}
+
+			else if (*p == '\\')
+			{
+				int ch = 0;
+
+				p = decode_escape(p, false, &ch);
+
+				if (ch == EOF)
+					stop = true;
+
+				else
+					putchar(ch);
+			}
+
+			else if (*(p + 1) == '%')
+				putchar(*p++);
+
+			else
+				p = print_conversion(p, &args, &res, &stop);
+		}
+	} while (!stop && *args != NULL && args != start);
+
+	return res;
+}
+
+bool is_utility(const char *name)
+{
+	return (strcmp(name, SHELL_CMD_ECHO) == 0 || strcmp(name, SHELL_CMD_PRINTF) == 0 ||
+			strcmp(name, SHELL_CMD_TRUE) == 0 || strcmp(name, SHELL_CMD_FALSE) == 0 ||
+			strcmp(name, SHELL_CMD_COLON) == 0);
+}
+
+int cmdUtility(char **argv)
+{
+	if (strcmp(*argv, SHELL_CMD_ECHO) == 0)
+		return (cmdEcho(argv + 1) == Success) ? 0 : 1;
+
+	else if (strcmp(*argv, SHELL_CMD_PRINTF) == 0)
+		return (cmdPrintf(argv + 1) == Success) ? 0 : 1;
+
+	return (strcmp(*argv, SHELL_CMD_FALSE) == 0) ? 1 : 0;
+}
@@ -0,0 +1,547 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Job Control Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_job.h"
+#include "../include/shell_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/pidfd.h>
+#include <sys/wait.h>
+
+/*
+ * @brief True if pipelines run as jobs in their own process groups.
+ */
+static bool job_control = false;
+
+/*
+ * @brief The process group of the shell, which owns the terminal while no foreground job runs.
+ */
+static pid_t shell_pgid = 0;
+
+/*
+ * @brief The terminal modes of the shell, restored after each foreground job.
+ */
+static struct termios shell_termios;
+
+/*
+ * @brief The process group of the foreground job, 0 if there is none. Read by the signal handler.
+ */
+static volatile sig_atomic_t foreground_pgid = 0;
+
+/*
+ * @brief A job that was stopped, or resumed in the background with bg.
+ * @param pgid The process group of the job.
+ * @param pids The processes of the job, 0 for the ones that were already reaped.
+ * @param num_pids The number of processes, the last one is the last pipeline stage.
+ * @param status The status of the last process, once it was reaped.
+ * @param running True if the job runs in the background, False if it's stopped.
+ * @param command The command line of the job.
+ */
+typedef struct Job {
+	pid_t pgid;
+	pid_t *pids;
+	int num_pids;
+	int status;
+	bool running;
+	char *command;
+} Job, *PJob;
+
+/*
+ * @brief The job table, job number N is at index N - 1 (NULL for an unused number).
+ */
+static PJob jobs[SHELL_MAX_JOBS] = {0};
+
+/*
+ * @brief Remove a job from the table.
+ * @param id The number of the job.
+ */
+static void remove_job(int id)
+{
+	PJob job = *(jobs + id - 1);
+
+	free(job->pids);
+	free(job->command);
+	free(job);
+	*(jobs + id - 1) = NULL;
+}
+
+Result job_control_init()
+{
+	if (!isatty(STDIN_FILENO))
+		return Success;
+
+	// A shell started in the background waits (stopped) until it's moved to the foreground.
+	while (tcgetpgrp(STDIN_FILENO) != (shell_pgid = getpgrp()))
+		kill(-shell_pgid, SIGTTIN);
+
+	signal(SIGTTIN, SIG_IGN);
+	signal(SIGTTOU, SIG_IGN);
+
+	// Lead a process group of its own, so the jobs' groups never include the shell.
+	if (shell_pgid != getpid() && setpgid(0, 0) == -1)
+	{
+		perror("Internal error: System call faliure: setpgid(2)");
+		return Failure;
+	}
+
+	shell_pgid = getpid();
+
+	if (tcsetpgrp(STDIN_FILENO, shell_pgid) == -1 || tcgetattr(STDIN_FILENO, &shell_termios) == -1)
+	{
+		perror("Internal error: System call faliure: tcsetpgrp(3)");
+		return Failure;
+	}
+
+	job_control = true;
+
+	return Success;
+}
+
+bool job_control_enabled()
+{
+	return job_control;
+}
+
+void job_reset_signals()
+{
+	job_control = false;
+	foreground_pgid = 0;
+
+	for (int id = 1; id <= SHELL_MAX_JOBS; ++id)
+	{
+		if (*(jobs + id - 1) != NULL)
+			remove_job(id);
+	}
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGTTIN, SIG_DFL);
+	signal(SIGTTOU, SIG_DFL);
+}
+
+void job_child_init(pid_t pgid, bool foreground, bool isolate)
+{
+	if (job_control || isolate)
+	{
+		if (pgid == 0)
+			pgid = getpid();
+
+		setpgid(0, pgid);
+
+		// SIGTTOU is still ignored here, so a child of a background group can take the terminal.
+		if (job_control && foreground)
+			tcsetpgrp(STDIN_FILENO, pgid);
+	}
+
+	job_reset_signals();
+}
+
+pid_t job_add_process(pid_t pid, pid_t pgid, bool foreground, bool isolate)
+{
+	if (!job_control && !isolate)
+		return 0;
+
+	if (pgid == 0)
+		pgid = pid;
+
+	// Fails with EACCES if the child already exec'ed, it's in the group by then.
+	setpgid(pid, pgid);
+
+	// The signals sent to the shell are forwarded to the foreground job, which only gets the terminal with job control.
+	if (foreground && pid == pgid)
+	{
+		foreground_pgid = pgid;
+
+		if (job_control)
+			tcsetpgrp(STDIN_FILENO, pgid);
+	}
+
+	return pgid;
+}
+
+pid_t job_wait(pid_t pid, int *status)
+{
+	pid_t res = -1;
+
+	while ((res = waitpid(pid, status, job_control ? WUNTRACED : 0)) == -1 && errno == EINTR)
+		;
+
+	return res;
+}
+
+void job_foreground_done()
+{
+	foreground_pgid = 0;
+
+	if (!job_control)
+		return;
+
+	tcsetpgrp(STDIN_FILENO, shell_pgid);
+
+	// The job may have left the terminal in any mode (e.g. an editor that was killed).
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_termios);
+}
+
+/*
+ * @brief Send a signal to a job.
+ * @param fds The pidfds of the processes of the job, -1 for the ones that already exited.
+ * @param count The number of pidfds.
+ * @param pgid The process group of the job, or 0 to signal each process by itself.
+ * @param signum The signal.
+ */
+static void signal_job(struct pollfd *fds, int count, pid_t pgid, int signum)
+{
+	if (pgid > 0)
+	{
+		kill(-pgid, signum);
+		return;
+	}
+
+	// A pidfd can't refer to a reused process ID.
+	for (int i = 0; i < count; ++i)
+	{
+		if ((fds + i)->fd != -1)
+			pidfd_send_signal((fds + i)->fd, signum, NULL, 0);
+	}
+}
+
+bool job_wait_deadline(pid_t *pids, int count, pid_t pgid, uint64_t timeout_ns, uint64_t kill_after_ns)
+{
+	struct pollfd fds[count];
+	int remaining = 0, signals_sent = 0;
+
+	for (int i = 0; i < count; ++i)
+	{
+		(fds + i)->fd = pidfd_open(*(pids + i), 0);
+		(fds + i)->events = POLLIN;
+		(fds + i)->revents = 0;
+
+		if ((fds + i)->fd == -1)
+			perror("Internal error: System call faliure: pidfd_open(2)");
+
+		else
+			++remaining;
+	}
+
+	uint64_t deadline = stats_now() + timeout_ns;
+
+	while (remaining > 0)
+	{
+		uint64_t now = stats_now();
+
+		// First SIGTERM (and SIGCONT, for a stopped job), then SIGKILL once the grace period passes too.
+		if (signals_sent < 2 && now >= deadline)
+		{
+			if (signals_sent++ == 0)
+			{
+				signal_job(fds, count, pgid, SIGTERM);
+				signal_job(fds, count, pgid, SIGCONT);
+				deadline = now + kill_after_ns;
+			}
+
+			else
+				signal_job(fds, count, pgid, SIGKILL);
+
+			continue;
+		}
+
+		uint64_t left = deadline - now;
+		struct timespec timeout = {(time_t)(left / 1000000000ULL), (long)(left % 1000000000ULL)};
+
+		// A negative descriptor is skipped by ppoll(2), and a pidfd is readable once its process exited.
+		if (ppoll(fds, count, (signals_sent < 2) ? &timeout : NULL, NULL) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			perror("Internal error: System call faliure: ppoll(2)");
+			break;
+		}
+
+		for (int i = 0; i < count; ++i)
+		{
+			if ((fds + i)->fd != -1 && (fds + i)->revents != 0)
+			{
+				close((fds + i)->fd);
+				(fds + i)->fd = -1;
+				--remaining;
+			}
+		}
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		if ((fds + i)->fd != -1)
+			close((fds + i)->fd);
+	}
+
+	return signals_sent > 0;
+}
+
+Result job_parse_duration(const char *str, uint64_t *ns)
+{
+	char *end = NULL;
+
+	errno = 0;
+	double seconds = strtod(str, &end);
+
+	if (end == str || errno != 0 || seconds < 0)
+		return Failure;
+
+	switch (*end)
+	{
+		case 'd':
+			seconds *= 24;
+			/* fall through */
+		case 'h':
+			seconds *= 60;
+			/* fall through */
+		case 'm':
+			seconds *= 60;
+			/* fall through */
+		case 's':
+			++end;
+			break;
+	}
+
+	// Durations of centuries are as good as no timeout, and don't overflow.
+	if (*end != '\0' || seconds != seconds)
+		return Failure;
+
+	*ns = (seconds > 1e10) ? (uint64_t)1e19 : (uint64_t)(seconds * 1e9);
+
+	return Success;
+}
+
+int job_stop(pid_t pgid, const pid_t *pids, int count, const char *command)
+{
+	int id = 1;
+	PJob job = NULL;
+
+	while (id <= SHELL_MAX_JOBS && *(jobs + id - 1) != NULL)
+		++id;
+
+	if (id > SHELL_MAX_JOBS || (job = (PJob)calloc(1, sizeof(Job))) == NULL ||
+		(job->pids = (pid_t *)malloc(count * sizeof(pid_t))) == NULL || (job->command = strdup(command)) == NULL)
+	{
+		if (job != NULL)
+		{
+			free(job->pids);
+			free(job);
+		}
+
+		fprintf(stderr, "\n%s\n", SHELL_ERR_JOB_TABLE_FULL);
+		kill(-pgid, SIGCONT);
+		return -1;
+	}
+
+	memcpy(job->pids, pids, count * sizeof(pid_t));
+	job->pgid = pgid;
+	job->num_pids = count;
+	*(jobs + id - 1) = job;
+
+	fprintf(stdout, "\n[%d] Stopped\t%s\n", id, command);
+
+	return id;
+}
+
+/*
+ * @brief Find a job by its specification.
+ * @param spec The job, "%N" or "N", or NULL for the last one.
+ * @return The number of the job, or 0 if there is no such job.
+ */
+static int find_job(const char *spec)
+{
+	if (spec == NULL)
+	{
+		for (int id = SHELL_MAX_JOBS; id > 0; --id)
+		{
+			if (*(jobs + id - 1) != NULL)
+				return id;
+		}
+
+		return 0;
+	}
+
+	char *end = NULL;
+	long id = strtol(spec + (*spec == '%'), &end, 10);
+
+	if (end == spec + (*spec == '%') || *end != '\0' || id < 1 || id > SHELL_MAX_JOBS || *(jobs + id - 1) == NULL)
+		return 0;
+
+	return (int)id;
+}
+
+/*
+ * @brief Reap the processes of a job that ended or stopped, without blocking.
+ * @param job The job.
+ * @return True if all the processes of the job ended, False otherwise.
+ */
+static bool reap_job(PJob job)
+{
+	bool done = true;
+	int status = 0;
+
+	for (int k = 0; k < job->num_pids; ++k)
+	{
+		if (*(job->pids + k) == 0)
+			continue;
+
+		pid_t res = waitpid(*(job->pids + k), &status, WNOHANG | WUNTRACED);
+
+		if (res == 0 || (res > 0 && WIFSTOPPED(status)))
+		{
+			job->running = job->running && res == 0;
+			done = false;
+			continue;
+		}
+
+		if (res > 0 && k == job->num_pids - 1)
+			job->status = status;
+
+		*(job->pids + k) = 0;
+	}
+
+	return done;
+}
+
+Result job_resume(const char *spec, bool foreground, int *status)
+{
+	int id = find_job(spec);
+
+	if (id == 0)
+		return Failure;
+
+	PJob job = *(jobs + id - 1);
+
+	if (!foreground)
+	{
+		job->running = true;
+		kill(-job->pgid, SIGCONT);
+		fprintf(stdout, "[%d] %s &\n", id, job->command);
+		*status = 0;
+		return Success;
+	}
+
+	fprintf(stdout, "%s\n", job->command);
+	fflush(stdout);
+
+	// The job gets the terminal back before it continues, so it doesn't stop again on its first read.
+	foreground_pgid = job->pgid;
+
+	if (job_control)
+		tcsetpgrp(STDIN_FILENO, job->pgid);
+
+	job->running = true;
+	kill(-job->pgid, SIGCONT);
+
+	for (int k = 0; k < job->num_pids; ++k)
+	{
+		int res = 0;
+
+		if (*(job->pids + k) == 0 || job_wait(*(job->pids + k), &res) == -1)
+			continue;
+
+		// Stopped again, it stays in the table.
+		if (WIFSTOPPED(res))
+		{
+			job_foreground_done();
+			job->running = false;
+			fprintf(stdout, "\n[%d] Stopped\t%s\n", id, job->command);
+			*status = 128 + WSTOPSIG(res);
+			return Success;
+		}
+
+		if (k == job->num_pids - 1)
+			job->status = res;
+
+		*(job->pids + k) = 0;
+	}
+
+	job_foreground_done();
+
+	*status = WIFSIGNALED(job->status) ? 128 + WTERMSIG(job->status) : WEXITSTATUS(job->status);
+
+	// The terminal echoed "^C" without a newline.
+	if (WIFSIGNALED(job->status) && WTERMSIG(job->status) == SIGINT && job_control)
+		fputc('\n', stdout);
+
+	remove_job(id);
+
+	return Success;
+}
+
+void job_list(FILE *out)
+{
+	for (int id = 1; id <= SHELL_MAX_JOBS; ++id)
+	{
+		PJob job = *(jobs + id - 1);
+
+		if (job == NULL)
+			continue;
+
+		if (reap_job(job))
+		{
+			fprintf(out, "[%d] Done\t%s\n", id, job->command);
+			remove_job(id);
+		}
+
+		else
+			fprintf(out, "[%d] %s\t%s\n", id, job->running ? "Running" : "Stopped", job->command);
+	}
+}
+
+void job_free()
+{
+	for (int id = 1; id <= SHELL_MAX_JOBS; ++id)
+	{
+		PJob job = *(jobs + id - 1);
+
+		if (job == NULL)
+			continue;
+
+		// A stopped job would never continue, nor be reaped, once the shell is gone.
+		if (!job->running)
+		{
+			kill(-job->pgid, SIGHUP);
+			kill(-job->pgid, SIGCONT);
+		}
+
+		remove_job(id);
+	}
+}
+
+bool job_forward_signal(int signum)
+{
+	pid_t pgid = (pid_t)foreground_pgid;
+
+	if (pgid <= 0)
+		return false;
+
+	kill(-pgid, signum);
+
+	return true;
+}
@@ -0,0 +1,1091 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Line Editor Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_lineedit.h"
+#include "../include/Command.h"
+#include "../include/shell_pathindex.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+/*
+ * @brief Control keys, as read from the terminal in raw mode.
+ */
+typedef enum _Key {
+	KEY_CTRL_A = 1,
+	KEY_CTRL_B = 2,
+	KEY_CTRL_C = 3,
+	KEY_CTRL_D = 4,
+	KEY_CTRL_E = 5,
+	KEY_CTRL_F = 6,
+	KEY_CTRL_H = 8,
+	KEY_TAB = 9,
+	KEY_LINE_FEED = 10,
+	KEY_CTRL_K = 11,
+	KEY_CTRL_L = 12,
+	KEY_ENTER = 13,
+	KEY_CTRL_N = 14,
+	KEY_CTRL_P = 16,
+	KEY_CTRL_U = 21,
+	KEY_CTRL_W = 23,
+	KEY_ESC = 27,
+	KEY_BACKSPACE = 127
+} Key;
+
+/*
+ * @brief Completions with more candidates than this ask before listing them.
+ */
+#define COMPLETION_LIST_LIMIT 100
+
+/*
+ * @brief The candidates of a completion.
+ * @param items The candidates, directories end with a '/'.
+ * @param count The number of candidates.
+ * @param cap The capacity of the candidates array.
+ * @param base The base name the candidates of a file name must start with.
+ * @param base_len The length of the base name.
+ * @param dir_fd The directory of the file name candidates.
+ */
+typedef struct Completions {
+	char **items;
+	size_t count;
+	size_t cap;
+	const char *base;
+	size_t base_len;
+	int dir_fd;
+} Completions, *PCompletions;
+
+/*
+ * @brief The state of the line being edited.
+ * @param prompt The prompt printed before the line.
+ * @param prompt_len The length of the prompt.
+ * @param pos The position of the cursor in the line.
+ * @param dirty True if the line changed since it was last drawn.
+ * @param history The commands of the history, oldest first (collected on the first recall).
+ * @param history_count The number of commands in the history.
+ * @param history_index How many commands back the line is (0 is the line being typed).
+ * @param saved The line being typed, saved while recalling the history.
+ */
+typedef struct EditState {
+	const char *prompt;
+	size_t prompt_len;
+	size_t pos;
+	bool dirty;
+	char **history;
+	size_t history_count;
+	size_t history_index;
+	char *saved;
+} EditState, *PEditState;
+
+// Bytes read from the standard input and not consumed yet.
+static char input[SHELL_INPUT_BUFFER_SIZE];
+static size_t input_start = 0, input_end = 0;
+
+// The current line, grown geometrically.
+static char *line = NULL;
+static size_t line_len = 0, line_cap = 0;
+
+// True while inside a bracketed paste, which may span several lines (and calls).
+static bool in_paste = false;
+
+// The terminal settings to restore when leaving raw mode.
+static struct termios orig_termios;
+
+/*
+ * @brief Make sure the line can hold more characters.
+ * @param extra The number of characters to add.
+ * @return True on success, False on allocation failure.
+ */
+static bool reserve_line(size_t extra)
+{
+	if (line_len + extra + 1 <= line_cap)
+		return true;
+
+	size_t cap = (line_cap == 0) ? 256 : line_cap;
+
+	while (line_len + extra + 1 > cap)
+		cap *= 2;
+
+	char *tmp = (char *)realloc(line, cap);
+
+	if (tmp == NULL)
+	{
+		perror("Internal error: System call faliure: realloc(3)");
+		return false;
+	}
+
+	line = tmp;
+	line_cap = cap;
+
+	return true;
+}
+
+/*
+ * @brief Refill the input buffer, once everything in it was consumed.
+ * @return True if new input was read, False on end-of-file or error.
+ */
+static bool fill_input()
+{
+	ssize_t n;
+
+	while ((n = read(STDIN_FILENO, input, sizeof(input))) == -1 && errno == EINTR)
+		;
+
+	if (n <= 0)
+		return false;
+
+	input_start = 0;
+	input_end = (size_t)n;
+
+	return true;
+}
+
+/*
+ * @brief Write a whole buffer to the terminal.
+ * @param buf The buffer to write.
+ * @param len The length of the buffer.
+ */
+static void write_all(const char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(STDOUT_FILENO, buf, len);
+
+		if (n == -1 && errno == EINTR)
+			continue;
+
+		else if (n <= 0)
+			return;
+
+		buf += n;
+		len -= (size_t)n;
+	}
+}
+
+/*
+ * @brief Read a line when the standard input isn't a terminal.
+ * @return The line, or NULL on end-of-file.
+ */
+static char *read_line_plain()
+{
+	bool got_input = false;
+
+	while (1)
+	{
+		if (input_start == input_end && !fill_input())
+			return got_input ? line : NULL;
+
+		got_input = true;
+
+		char *start = input + input_start, *newline = memchr(start, '\n', input_end - input_start);
+		size_t chunk = (newline != NULL) ? (size_t)(newline - start) : input_end - input_start;
+
+		if (!reserve_line(chunk))
+			return NULL;
+
+		memcpy(line + line_len, start, chunk);
+		line_len += chunk;
+		*(line + line_len) = '\0';
+		input_start += chunk;
+
+		if (newline != NULL)
+		{
+			++input_start;
+			return line;
+		}
+	}
+}
+
+/*
+ * @brief Get the width of the terminal.
+ * @return The number of columns of the terminal (80 if unknown).
+ */
+static size_t terminal_columns()
+{
+	struct winsize ws;
+
+	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+		return 80;
+
+	return ws.ws_col;
+}
+
+/*
+ * @brief Redraw the prompt and the line, in a single write.
+ * @param state The edit state.
+ * @note Lines wider than the terminal scroll horizontally around the cursor.
+ */
+static void refresh_line(PEditState state)
+{
+	size_t cols = terminal_columns(), start = 0, len = line_len, pos = state->pos;
+
+	// Scroll the line so the cursor stays visible, and cut it at the edge of the terminal.
+	while (state->prompt_len + pos >= cols && pos > 0)
+	{
+		++start;
+		--len;
+		--pos;
+	}
+
+	if (state->prompt_len + len > cols)
+		len = (cols > state->prompt_len) ? cols - state->prompt_len : 0;
+
+	// Room for the carriage return and the escape sequences.
+	size_t out_len = 0, out_cap = state->prompt_len + len + 64;
+	char *out = (char *)malloc(out_cap);
+
+	if (out == NULL)
+		return;
+
+	*(out + out_len++) = '\r';
+	memcpy(out + out_len, state->prompt, state->prompt_len);
+	out_len += state->prompt_len;
+	memcpy(out + out_len, line + start, len);
+	out_len += len;
+
+	// Erase to the end of the line, then move the cursor to its position.
+	out_len += snprintf(out + out_len, out_cap - out_len, "\33[0K\r");
+
+	if (state->prompt_len + pos > 0)
+		out_len += snprintf(out + out_len, out_cap - out_len, "\33[%zuC", state->prompt_len + pos);
+
+	write_all(out, out_len);
+	free(out);
+
+	state->dirty = false;
+}
+
+/*
+ * @brief Get the next byte of input, reading more if needed.
+ * @param state The edit state.
+ * @param c A pointer to store the byte.
+ * @return True on success, False on end-of-file or error.
+ * @note The line is only redrawn right before blocking on the terminal, so all the keys that arrived together
+ * 		 (e.g. a whole paste) cost a single redraw.
+ */
+static bool next_byte(PEditState state, unsigned char *c)
+{
+	if (input_start == input_end)
+	{
+		if (state->dirty)
+			refresh_line(state);
+
+		if (!fill_input())
+			return false;
+	}
+
+	*c = (unsigned char)*(input + input_start++);
+
+	return true;
+}
+
+/*
+ * @brief Insert characters at the cursor.
+ * @param state The edit state.
+ * @param str The characters to insert.
+ * @param len The number of characters.
+ */
+static void insert_chars(PEditState state, const char *str, size_t len)
+{
+	if (!reserve_line(len))
+		return;
+
+	memmove(line + state->pos + len, line + state->pos, line_len - state->pos);
+	memcpy(line + state->pos, str, len);
+	line_len += len;
+	state->pos += len;
+	*(line + line_len) = '\0';
+	state->dirty = true;
+}
+
+/*
+ * @brief Delete characters from the line.
+ * @param state The edit state.
+ * @param from The position of the first character to delete.
+ * @param count The number of characters to delete.
+ */
+static void delete_chars(PEditState state, size_t from, size_t count)
+{
+	if (count == 0 || from >= line_len)
+		return;
+
+	if (from + count > line_len)
+		count = line_len - from;
+
+	memmove(line + from, line + from + count, line_len - from - count);
+	line_len -= count;
+	*(line + line_len) = '\0';
+
+	if (state->pos > from + count)
+		state->pos -= count;
+
+	else if (state->pos > from)
+		state->pos = from;
+
+	state->dirty = true;
+}
+
+/*
+ * @brief Replace the whole line.
+ * @param state The edit state.
+ * @param str The new line.
+ */
+static void set_line(PEditState state, const char *str)
+{
+	line_len = 0;
+	state->pos = 0;
+
+	if (!reserve_line(0))
+		return;
+
+	*line = '\0';
+	insert_chars(state, str, strlen(str));
+}
+
+/*
+ * @brief Move through the history.
+ * @param state The edit state.
+ * @param list The command history.
+ * @param older True to recall an older command, False for a newer one.
+ */
+static void recall_history(PEditState state, PLinkedList list, bool older)
+{
+	// Collect the history on the first recall, it doesn't change while the line is edited.
+	if (state->history == NULL)
+	{
+		for (PNode curr = list->head; curr != NULL; curr = curr->next)
+			++state->history_count;
+
+		if (state->history_count == 0 || (state->history = (char **)malloc(state->history_count * sizeof(char *))) == NULL)
+		{
+			state->history_count = 0;
+			return;
+		}
+
+		size_t i = 0;
+
+		for (PNode curr = list->head; curr != NULL; curr = curr->next)
+			*(state->history + i++) = ((PCommand)(curr->data))->command;
+	}
+
+	if (older && state->history_index < state->history_count)
+	{
+		// Keep the line being typed, to get back to it.
+		if (state->history_index == 0)
+		{
+			free(state->saved);
+			state->saved = strdup(line);
+		}
+
+		++state->history_index;
+	}
+
+	else if (!older && state->history_index > 0)
+		--state->history_index;
+
+	else
+		return;
+
+	if (state->history_index == 0)
+		set_line(state, (state->saved != NULL) ? state->saved : "");
+
+	else
+		set_line(state, *(state->history + state->history_count - state->history_index));
+}
+
+/*
+ * @brief Add a candidate to a completion.
+ * @param comp The completion.
+ * @param prefix A prefix to prepend to the candidate, or NULL.
+ * @param prefix_len The length of the prefix.
+ * @param name The candidate.
+ * @param is_dir True to append a '/' to the candidate.
+ */
+static void add_candidate(PCompletions comp, const char *prefix, size_t prefix_len, const char *name, bool is_dir)
+{
+	if (comp->count == comp->cap)
+	{
+		size_t cap = (comp->cap == 0) ? 64 : comp->cap * 2;
+		char **tmp = (char **)realloc(comp->items, cap * sizeof(char *));
+
+		if (tmp == NULL)
+			return;
+
+		comp->items = tmp;
+		comp->cap = cap;
+	}
+
+	size_t name_len = strlen(name);
+	char *item = (char *)malloc(prefix_len + name_len + 2);
+
+	if (item == NULL)
+		return;
+
+	if (prefix_len > 0)
+		memcpy(item, prefix, prefix_len);
+
+	memcpy(item + prefix_len, name, name_len);
+
+	if (is_dir)
+		*(item + prefix_len + name_len++) = '/';
+
+	*(item + prefix_len + name_len) = '\0';
+	*(comp->items + comp->count++) = item;
+}
+
+/*
+ * @brief Add a directory entry to a file name completion, if it matches.
+ * @param name The name of the entry.
+ * @param type The type of the entry.
+ * @param ctx The completion.
+ */
+static void add_file_candidate(const char *name, unsigned char type, void *ctx)
+{
+	PCompletions comp = (PCompletions)ctx;
+	struct stat st;
+
+	// Hidden files are only completed when asked for explicitly.
+	if ((*name == '.' && *comp->base != '.') || strncmp(name, comp->base, comp->base_len) != 0)
+		return;
+
+	// Symbolic links (and file systems without entry types) need a stat(2) to tell a directory.
+	bool is_dir = (type == DT_DIR);
+
+	if ((type == DT_LNK || type == DT_UNKNOWN) && fstatat(comp->dir_fd, name, &st, 0) == 0)
+		is_dir = S_ISDIR(st.st_mode);
+
+	add_candidate(comp, NULL, 0, name, is_dir);
+}
+
+/*
+ * @brief Compare two candidates, for qsort(3).
+ */
+static int compare_candidates(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * @brief Check if a word is in a command position (the first word, or the first after a pipe or a control command).
+ * @param word_start The position of the word in the line.
+ * @return True if the word is a command name.
+ */
+static bool is_command_position(size_t word_start)
+{
+	size_t end = word_start, start;
+
+	while (end > 0 && *(line + end - 1) == ' ')
+		--end;
+
+	if (end == 0)
+		return true;
+
+	for (start = end; start > 0 && *(line + start - 1) != ' '; --start)
+		;
+
+	size_t len = end - start;
+	const char *prev = line + start;
+
+	return ((len == 1 && *prev == '|') || (len == 2 && strncmp(prev, "|>", 2) == 0) ||
+			(len == 2 && strncmp(prev, "if", 2) == 0) || (len == 4 && strncmp(prev, "then", 4) == 0) ||
+			(len == 4 && strncmp(prev, "else", 4) == 0));
+}
+
+/*
+ * @brief List the candidates of a completion under the line.
+ * @param state The edit state.
+ * @param comp The completion.
+ * @param skip The number of characters to skip at the start of each candidate (its directory).
+ */
+static void list_candidates(PEditState state, PCompletions comp, size_t skip)
+{
+	size_t cols = terminal_columns(), width = 0, used = 0;
+	char answer[64];
+
+	if (comp->count > COMPLETION_LIST_LIMIT)
+	{
+		unsigned char c = 0;
+		int len = snprintf(answer, sizeof(answer), "\r\nDisplay all %zu possibilities? (y or n)", comp->count);
+
+		write_all(answer, (size_t)len);
+
+		if (!next_byte(state, &c) || (c != 'y' && c != 'Y'))
+		{
+			write_all("\r\n", 2);
+			state->dirty = true;
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < comp->count; ++i)
+	{
+		size_t len = strlen(*(comp->items + i) + skip);
+
+		if (len > width)
+			width = len;
+	}
+
+	width += 2;
+	write_all("\r\n", 2);
+
+	// Candidates are padded to the widest one, as many in a row as fit in the terminal.
+	for (size_t i = 0; i < comp->count; ++i)
+	{
+		const char *item = *(comp->items + i) + skip;
+		size_t len = strlen(item);
+
+		if (used > 0 && used + width > cols)
+		{
+			write_all("\r\n", 2);
+			used = 0;
+		}
+
+		write_all(item, len);
+
+		for (size_t pad = len; pad < width && i + 1 < comp->count; ++pad)
+			write_all(" ", 1);
+
+		used += width;
+	}
+
+	write_all("\r\n", 2);
+	state->dirty = true;
+}
+
+/*
+ * @brief Complete the word before the cursor: a command name, or a file name.
+ * @param state The edit state.
+ * @note A single candidate is inserted, several candidates are completed to their longest common prefix,
+ * 		 and listed if there is nothing more to insert.
+ */
+static void complete_word(PEditState state)
+{
+	static const char *builtins[] = {SHELL_CMD_EXIT, SHELL_CMD_CD, SHELL_CMD_PWD, SHELL_CMD_CLEAR, SHELL_CMD_HISTORY,
+									 SHELL_CMD_CHANGE_PROMPT, SHELL_CMD_READ, SHELL_CMD_STATS, SHELL_CMD_SET,
+									 SHELL_CMD_ALIAS, SHELL_CMD_UNALIAS, SHELL_CMD_RETURN, SHELL_CMD_EXPORT, SHELL_CMD_UNSET, SHELL_CMD_TEST,
+									 SHELL_CMD_ECHO, SHELL_CMD_PRINTF, SHELL_CMD_TRUE, SHELL_CMD_FALSE, SHELL_CMD_TIMEOUT, SHELL_CMD_FG, SHELL_CMD_BG, SHELL_CMD_JOBS, "if", "then", "else", "fi"};
+	Completions comp = {0};
+	size_t word_start = state->pos, skip = 0;
+
+	while (word_start > 0 && *(line + word_start - 1) != ' ')
+		--word_start;
+
+	const char *word = line + word_start;
+	size_t word_len = state->pos - word_start;
+
+	if (is_command_position(word_start) && memchr(word, '/', word_len) == NULL)
+	{
+		size_t count = 0;
+		const char **names = path_index_complete(word, word_len, &count);
+
+		for (size_t i = 0; i < sizeof(builtins) / sizeof(*builtins); ++i)
+		{
+			if (strncmp(*(builtins + i), word, word_len) == 0)
+				add_candidate(&comp, NULL, 0, *(builtins + i), false);
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			add_candidate(&comp, NULL, 0, *(names + i), false);
+	}
+
+	else
+	{
+		// Split the word into its directory (kept as typed) and the base name to complete.
+		const char *slash = (const char *)memrchr(word, '/', word_len);
+		char dir[SHELL_MAX_PATH_LENGTH + 1] = ".";
+
+		skip = (slash != NULL) ? (size_t)(slash - word + 1) : 0;
+
+		if (skip > 0)
+		{
+			size_t dir_len = (skip < sizeof(dir)) ? skip : sizeof(dir) - 1;
+
+			memcpy(dir, word, dir_len);
+			*(dir + dir_len) = '\0';
+		}
+
+		char base[SHELL_MAX_PATH_LENGTH + 1] = {0};
+		size_t base_len = word_len - skip;
+
+		if (base_len > SHELL_MAX_PATH_LENGTH)
+			base_len = SHELL_MAX_PATH_LENGTH;
+
+		memcpy(base, word + skip, base_len);
+		comp.base = base;
+		comp.base_len = base_len;
+
+		if ((comp.dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) != -1)
+		{
+			scan_directory(comp.dir_fd, add_file_candidate, &comp);
+			close(comp.dir_fd);
+		}
+
+		// The candidates are inserted after the typed directory.
+		for (size_t i = 0; i < comp.count; ++i)
+		{
+			char *item = *(comp.items + i), *full = (char *)malloc(skip + strlen(item) + 1);
+
+			if (full == NULL)
+				continue;
+
+			memcpy(full, word, skip);
+			strcpy(full + skip, item);
+			free(item);
+			*(comp.items + i) = full;
+		}
+	}
+
+	qsort(comp.items, comp.count, sizeof(char *), compare_candidates);
+
+	// Drop the duplicates (a builtin may also be a command in $PATH).
+	size_t unique = 0;
+
+	for (size_t i = 0; i < comp.count; ++i)
+	{
+		if (unique > 0 && strcmp(*(comp.items + unique - 1), *(comp.items + i)) == 0)
+			free(*(comp.items + i));
+
+		else
+			*(comp.items + unique++) = *(comp.items + i);
+	}
+
+	comp.count = unique;
+
+	if (comp.count == 0)
+		write_all("\a", 1);
+
+	else if (comp.count == 1)
+	{
+		const char *item = *comp.items;
+		size_t item_len = strlen(item);
+
+		insert_chars(state, item + word_len, item_len - word_len);
+
+		// A complete word is followed by a space, a directory is left open for its contents.
+		if (*(item + item_len - 1) != '/')
+			insert_chars(state, " ", 1);
+	}
+
+	else
+	{
+		// The longest common prefix of the sorted candidates is the one of the first and the last.
+		const char *first = *comp.items, *last = *(comp.items + comp.count - 1);
+		size_t common = 0;
+
+		while (*(first + common) != '\0' && *(first + common) == *(last + common))
+			++common;
+
+		if (common > word_len)
+			insert_chars(state, first + word_len, common - word_len);
+
+		else
+			list_candidates(state, &comp, skip);
+	}
+
+	for (size_t i = 0; i < comp.count; ++i)
+		free(*(comp.items + i));
+
+	free(comp.items);
+}
+
+/*
+ * @brief Handle an escape sequence (arrow keys, home, end, delete and the bracketed paste markers).
+ * @param state The edit state.
+ * @param history The command history.
+ * @return True on success, False on end-of-file.
+ */
+static bool handle_escape(PEditState state, PLinkedList history)
+{
+	unsigned char c, final;
+	int num = 0;
+
+	if (!next_byte(state, &c))
+		return false;
+
+	if (c != '[' && c != 'O')
+		return true;
+
+	if (!next_byte(state, &final))
+		return false;
+
+	// Sequences with a numeric parameter end with '~' (e.g. "\33[3~" for delete).
+	while (isdigit(final))
+	{
+		num = num * 10 + (final - '0');
+
+		if (!next_byte(state, &final))
+			return false;
+	}
+
+	if (final == '~')
+	{
+		if (num == 200)
+			in_paste = true;
+
+		else if (num == 3)
+			delete_chars(state, state->pos, 1);
+
+		else if (num == 1 || num == 7)
+			state->pos = 0;
+
+		else if (num == 4 || num == 8)
+			state->pos = line_len;
+
+		state->dirty = true;
+		return true;
+	}
+
+	switch (final)
+	{
+		case 'A':
+			if (history != NULL)
+				recall_history(state, history, true);
+			break;
+
+		case 'B':
+			if (history != NULL)
+				recall_history(state, history, false);
+			break;
+
+		case 'C':
+			if (state->pos < line_len)
+				++state->pos;
+			break;
+
+		case 'D':
+			if (state->pos > 0)
+				--state->pos;
+			break;
+
+		case 'H':
+			state->pos = 0;
+			break;
+
+		case 'F':
+			state->pos = line_len;
+			break;
+
+		default:
+			break;
+	}
+
+	state->dirty = true;
+
+	return true;
+}
+
+/*
+ * @brief Take the text of a bracketed paste, up to its end marker or the end of the line.
+ * @param state The edit state.
+ * @param done A pointer to set to True if the pasted text ended the line.
+ * @return True on success, False on end-of-file.
+ * @note The pasted text is inserted in chunks straight from the input buffer, never interpreted as keys.
+ */
+static bool take_paste(PEditState state, bool *done)
+{
+	static const char end_marker[] = "\33[201~";
+	const size_t marker_len = sizeof(end_marker) - 1;
+
+	while (in_paste)
+	{
+		if (input_start == input_end)
+		{
+			if (state->dirty)
+				refresh_line(state);
+
+			if (!fill_input())
+				return false;
+		}
+
+		char *start = input + input_start;
+		size_t avail = input_end - input_start, chunk = 0;
+
+		while (chunk < avail && *(start + chunk) != '\33' && *(start + chunk) != '\n' && *(start + chunk) != '\r')
+			++chunk;
+
+		insert_chars(state, start, chunk);
+		input_start += chunk;
+
+		if (chunk == avail)
+			continue;
+
+		char c = *(start + chunk);
+
+		if (c == '\n' || c == '\r')
+		{
+			++input_start;
+
+			// A pasted "\r\n" is a single line break.
+			if (c == '\r' && input_start < input_end && *(input + input_start) == '\n')
+				++input_start;
+
+			*done = true;
+			return true;
+		}
+
+		// The end marker may be split between two reads, compare it byte by byte.
+		size_t matched = 0;
+		unsigned char b = 0;
+		bool ok = true;
+
+		while (matched < marker_len && (ok = next_byte(state, &b)) && b == (unsigned char)*(end_marker + matched))
+			++matched;
+
+		if (!ok)
+			return false;
+
+		else if (matched == marker_len)
+			in_paste = false;
+
+		// Not the end marker, the bytes are part of the pasted text (the mismatching one is read again).
+		else
+		{
+			insert_chars(state, end_marker, matched);
+			--input_start;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * @brief Read a line from the terminal in raw mode.
+ * @param state The edit state.
+ * @param history The command history, or NULL.
+ * @return The line, or NULL on end-of-file.
+ */
+static char *edit_line(PEditState state, PLinkedList history)
+{
+	unsigned char c;
+
+	state->dirty = true;
+
+	while (1)
+	{
+		bool done = false;
+
+		if (in_paste)
+		{
+			if (!take_paste(state, &done))
+				return NULL;
+
+			if (done)
+				break;
+
+			continue;
+		}
+
+		if (!next_byte(state, &c))
+			return (line_len > 0) ? line : NULL;
+
+		switch (c)
+		{
+			case KEY_ENTER:
+			case KEY_LINE_FEED:
+				done = true;
+				break;
+
+			case KEY_CTRL_C:
+				// Let the shell's SIGINT handler report it, then start over on an empty line.
+				write_all("\n", 1);
+				raise(SIGINT);
+				set_line(state, "");
+				break;
+
+			case KEY_CTRL_D:
+				if (line_len == 0)
+				{
+					write_all("\r\n", 2);
+					return NULL;
+				}
+
+				delete_chars(state, state->pos, 1);
+				break;
+
+			case KEY_BACKSPACE:
+			case KEY_CTRL_H:
+				if (state->pos > 0)
+					delete_chars(state, state->pos - 1, 1);
+				break;
+
+			case KEY_CTRL_A:
+				state->pos = 0;
+				state->dirty = true;
+				break;
+
+			case KEY_CTRL_E:
+				state->pos = line_len;
+				state->dirty = true;
+				break;
+
+			case KEY_CTRL_B:
+				if (state->pos > 0)
+					--state->pos;
+				state->dirty = true;
+				break;
+
+			case KEY_CTRL_F:
+				if (state->pos < line_len)
+					++state->pos;
+				state->dirty = true;
+				break;
+
+			case KEY_CTRL_K:
+				delete_chars(state, state->pos, line_len - state->pos);
+				break;
+
+			case KEY_CTRL_U:
+				delete_chars(state, 0, state->pos);
+				break;
+
+			case KEY_CTRL_W:
+			{
+				size_t from = state->pos;
+
+				while (from > 0 && *(line + from - 1) == ' ')
+					--from;
+
+				while (from > 0 && *(line + from - 1) != ' ')
+					--from;
+
+				delete_chars(state, from, state->pos - from);
+				break;
+			}
+
+			case KEY_TAB:
+				complete_word(state);
+				break;
+
+			case KEY_CTRL_L:
+				write_all(SHELL_CMD_CLEAR_FLUSH, SHELL_CMD_CLEAR_FLUSH_LEN);
+				state->dirty = true;
+				break;
+
+			case KEY_CTRL_P:
+			case KEY_CTRL_N:
+				if (history != NULL)
+					recall_history(state, history, c == KEY_CTRL_P);
+				break;
+
+			case KEY_ESC:
+				if (!handle_escape(state, history))
+					return NULL;
+				break;
+
+			default:
+			{
+				// Take all the printable characters that arrived together at once.
+				size_t chunk = 1;
+
+				if (c < ' ')
+					break;
+
+				while (input_start + chunk - 1 < input_end && (unsigned char)*(input + input_start + chunk - 1) >= ' ' &&
+					   (unsigned char)*(input + input_start + chunk - 1) != KEY_BACKSPACE)
+					++chunk;
+
+				insert_chars(state, input + input_start - 1, chunk);
+				input_start += chunk - 1;
+				break;
+			}
+		}
+
+		if (done)
+			break;
+	}
+
+	if (state->dirty)
+		refresh_line(state);
+
+	write_all("\r\n", 2);
+
+	return line;
+}
+
+char *read_line(const char *prompt, size_t *len, PLinkedList history)
+{
+	char *ret = NULL;
+
+	line_len = 0;
+
+	if (!reserve_line(0))
+		return NULL;
+
+	*line = '\0';
+
+	// Raw mode is only used when both ends are a terminal that understands the escape sequences.
+	const char *term = getenv("TERM");
+	bool raw = (isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) && (term == NULL || strcmp(term, "dumb") != 0) &&
+				tcgetattr(STDIN_FILENO, &orig_termios) == 0);
+
+	if (!raw)
+	{
+		if (prompt != NULL)
+		{
+			fprintf(stdout, "%s", prompt);
+			fflush(stdout);
+		}
+
+		ret = read_line_plain();
+	}
+
+	else
+	{
+		struct termios raw_termios = orig_termios;
+		EditState state = {0};
+
+		state.prompt = (prompt != NULL) ? prompt : "";
+		state.prompt_len = strlen(state.prompt);
+
+		// No echo, no line buffering and no signal keys: every key is handled here.
+		raw_termios.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+		raw_termios.c_cflag |= CS8;
+		raw_termios.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+		raw_termios.c_cc[VMIN] = 1;
+		raw_termios.c_cc[VTIME] = 0;
+
+		fflush(stdout);
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &raw_termios);
+
+		// Enable bracketed paste, so a paste arrives as one block instead of a stream of keys.
+		write_all("\33[?2004h", 8);
+
+		ret = edit_line(&state, history);
+
+		write_all("\33[?2004l", 8);
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &orig_termios);
+
+		free(state.history);
+		free(state.saved);
+	}
+
+	if (len != NULL)
+		*len = (ret != NULL) ? line_len : 0;
+
+	return ret;
+}
@@ -0,0 +1,441 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell PATH Index Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_pathindex.h"
+#include "../include/shell_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+ * @brief The $PATH used when the variable isn't set.
+ */
+#define PATH_INDEX_DEFAULT_PATH "/usr/local/bin:/usr/bin:/bin"
+
+/*
+ * @brief The directory changes that invalidate the index.
+ */
+#define PATH_INDEX_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/*
+ * @brief A directory of $PATH.
+ * @param path The path of the directory.
+ * @param wd The inotify watch of the directory, or -1 if it's checked by its modification time.
+ * @param mtime The modification time of the directory when it was scanned.
+ */
+typedef struct PathDir {
+	char *path;
+	int wd;
+	struct timespec mtime;
+} PathDir, *PPathDir;
+
+/*
+ * @brief A command found in a directory of $PATH.
+ * @param path The offset of the full path of the command in the arena.
+ * @param name The offset of the name of the command in the arena.
+ */
+typedef struct PathEntry {
+	size_t path;
+	size_t name;
+} PathEntry, *PPathEntry;
+
+/*
+ * @brief The index of the commands in $PATH.
+ * @param built True if the index was built.
+ * @param path_env The value of $PATH the index was built from.
+ * @param relative True if $PATH has a relative directory, whose commands depend on the working directory.
+ * @param dirs The directories of $PATH.
+ * @param num_dirs The number of directories.
+ * @param inotify_fd The inotify instance watching the directories, or -1.
+ * @param owner The process that owns the inotify instance (forked children check modification times instead).
+ * @param arena The full paths of all the commands, as "dir/name\0" records.
+ * @param entries The commands, in $PATH order.
+ * @param table A hash table of the first entry of each name (entry index + 1, 0 for an empty slot).
+ * @param names The unique names of the commands, sorted.
+ */
+typedef struct PathIndex {
+	bool built;
+	char *path_env;
+	bool relative;
+	PPathDir dirs;
+	size_t num_dirs;
+	int inotify_fd;
+	pid_t owner;
+	char *arena;
+	size_t arena_len, arena_cap;
+	PPathEntry entries;
+	size_t num_entries, entries_cap;
+	size_t *table;
+	size_t table_size;
+	const char **names;
+	size_t num_names;
+} PathIndex, *PPathIndex;
+
+static PathIndex path_index = {.inotify_fd = -1};
+
+/*
+ * @brief Find the first entry of a name in the hash table.
+ * @param name The name of the command.
+ * @return The slot of the name, or the empty slot where it should be inserted.
+ */
+static size_t *find_slot(const char *name)
+{
+	size_t mask = path_index.table_size - 1, i = hash_string(name, strlen(name)) & mask;
+
+	while (*(path_index.table + i) != 0)
+	{
+		PPathEntry entry = path_index.entries + *(path_index.table + i) - 1;
+
+		if (strcmp(path_index.arena + entry->name, name) == 0)
+			break;
+
+		i = (i + 1) & mask;
+	}
+
+	return path_index.table + i;
+}
+
+Result scan_directory(int fd, void (*callback)(const char *name, unsigned char type, void *ctx), void *ctx)
+{
+	// A single getdents64(2) call returns hundreds of entries.
+	long buf[4096];
+	ssize_t n;
+
+	while ((n = getdents64(fd, buf, sizeof(buf))) > 0)
+	{
+		for (ssize_t off = 0; off < n;)
+		{
+			struct dirent64 *entry = (struct dirent64 *)((char *)buf + off);
+			const char *name = entry->d_name;
+
+			off += entry->d_reclen;
+
+			if (*name == '.' && (*(name + 1) == '\0' || (*(name + 1) == '.' && *(name + 2) == '\0')))
+				continue;
+
+			callback(name, entry->d_type, ctx);
+		}
+	}
+
+	return (n == 0) ? Success : Failure;
+}
+
+/*
+ * @brief Add a directory entry to the index.
+ * @param name The name of the entry.
+ * @param type The type of the entry.
+ * @param ctx The directory of the entry.
+ * @note Only the entry type is checked, the execute permission is left to execve(2), to keep the scan free of per-file system calls.
+ */
+static void add_entry(const char *name, unsigned char type, void *ctx)
+{
+	const char *dir = (const char *)ctx;
+	size_t dir_len = strlen(dir), name_len = strlen(name), needed = dir_len + name_len + 2;
+
+	if (type != DT_REG && type != DT_LNK && type != DT_UNKNOWN)
+		return;
+
+	if (path_index.arena_len + needed > path_index.arena_cap)
+	{
+		size_t cap = (path_index.arena_cap == 0) ? 65536 : path_index.arena_cap;
+
+		while (path_index.arena_len + needed > cap)
+			cap *= 2;
+
+		char *tmp = (char *)realloc(path_index.arena, cap);
+
+		if (tmp == NULL)
+			return;
+
+		path_index.arena = tmp;
+		path_index.arena_cap = cap;
+	}
+
+	if (path_index.num_entries == path_index.entries_cap)
+	{
+		size_t cap = (path_index.entries_cap == 0) ? 1024 : path_index.entries_cap * 2;
+		PPathEntry tmp = (PPathEntry)realloc(path_index.entries, cap * sizeof(PathEntry));
+
+		if (tmp == NULL)
+			return;
+
+		path_index.entries = tmp;
+		path_index.entries_cap = cap;
+	}
+
+	PPathEntry entry = path_index.entries + path_index.num_entries++;
+	char *record = path_index.arena + path_index.arena_len;
+
+	memcpy(record, dir, dir_len);
+	*(record + dir_len) = '/';
+	memcpy(record + dir_len + 1, name, name_len + 1);
+
+	entry->path = path_index.arena_len;
+	entry->name = path_index.arena_len + dir_len + 1;
+	path_index.arena_len += needed;
+}
+
+/*
+ * @brief Compare two command names, for qsort(3).
+ */
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/*
+ * @brief Get the current $PATH.
+ * @return The value of $PATH, or the default one.
+ */
+static const char *current_path()
+{
+	const char *path = getenv("PATH");
+
+	return (path != NULL) ? path : PATH_INDEX_DEFAULT_PATH;
+}
+
+/*
+ * @brief Get the modification time of a directory.
+ * @param path The path of the directory.
+ * @param mtime A pointer to store the modification time (zero if the directory doesn't exist).
+ */
+static void dir_mtime(const char *path, struct timespec *mtime)
+{
+	struct stat st;
+
+	if (stat(path, &st) == 0)
+		*mtime = st.st_mtim;
+
+	else
+		mtime->tv_sec = mtime->tv_nsec = 0;
+}
+
+void path_index_free()
+{
+	for (size_t i = 0; i < path_index.num_dirs; ++i)
+		free((path_index.dirs + i)->path);
+
+	if (path_index.inotify_fd != -1)
+		close(path_index.inotify_fd);
+
+	free(path_index.path_env);
+	free(path_index.dirs);
+	free(path_index.arena);
+	free(path_index.entries);
+	free(path_index.table);
+	free(path_index.names);
+
+	memset(&path_index, 0, sizeof(path_index));
+	path_index.inotify_fd = -1;
+}
+
+/*
+ * @brief Build the index from scratch.
+ * @return Success on success, Failure otherwise.
+ */
+static Result build_index()
+{
+	path_index_free();
+
+	if ((path_index.path_env = strdup(current_path())) == NULL)
+		return Failure;
+
+	// Each ':' separates two directories.
+	size_t max_dirs = 1;
+
+	for (const char *p = path_index.path_env; *p != '\0'; ++p)
+		max_dirs += (*p == ':');
+
+	if ((path_index.dirs = (PPathDir)calloc(max_dirs, sizeof(PathDir))) == NULL)
+		return Failure;
+
+	path_index.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	path_index.owner = getpid();
+
+	char *copy = strdup(path_index.path_env), *saveptr = NULL;
+
+	if (copy == NULL)
+		return Failure;
+
+	for (char *dir = strtok_r(copy, ":", &saveptr); dir != NULL; dir = strtok_r(NULL, ":", &saveptr))
+	{
+		PPathDir pdir = path_index.dirs + path_index.num_dirs;
+
+		if (*dir != '/')
+		{
+			path_index.relative = true;
+			continue;
+		}
+
+		if ((pdir->path = strdup(dir)) == NULL)
+			break;
+
+		++path_index.num_dirs;
+
+		// Watch before scanning, so a change during the scan isn't missed.
+		pdir->wd = (path_index.inotify_fd != -1) ? inotify_add_watch(path_index.inotify_fd, dir, PATH_INDEX_EVENTS) : -1;
+
+		int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		struct stat st;
+
+		if (fd == -1)
+			continue;
+
+		if (fstat(fd, &st) == 0)
+			pdir->mtime = st.st_mtim;
+
+		scan_directory(fd, add_entry, pdir->path);
+		close(fd);
+	}
+
+	free(copy);
+
+	// An empty ("::") or trailing (":") entry also means the working directory.
+	if (*path_index.path_env == '\0' || *path_index.path_env == ':' || strstr(path_index.path_env, "::") != NULL ||
+		*(path_index.path_env + strlen(path_index.path_env) - 1) == ':')
+		path_index.relative = true;
+
+	// The hash table keeps the first entry of each name, as the $PATH search does.
+	path_index.table_size = 1024;
+
+	while (path_index.table_size < path_index.num_entries * 2)
+		path_index.table_size *= 2;
+
+	path_index.table = (size_t *)calloc(path_index.table_size, sizeof(size_t));
+	path_index.names = (const char **)malloc((path_index.num_entries + 1) * sizeof(char *));
+
+	if (path_index.table == NULL || path_index.names == NULL)
+		return Failure;
+
+	for (size_t i = 0; i < path_index.num_entries; ++i)
+	{
+		const char *name = path_index.arena + (path_index.entries + i)->name;
+		size_t *slot = find_slot(name);
+
+		if (*slot != 0)
+			continue;
+
+		*slot = i + 1;
+		*(path_index.names + path_index.num_names++) = name;
+	}
+
+	qsort(path_index.names, path_index.num_names, sizeof(char *), compare_names);
+
+	path_index.built = true;
+
+	return Success;
+}
+
+/*
+ * @brief Check if the index is out of date.
+ * @return True if $PATH or one of its directories changed since the index was built.
+ */
+static bool index_changed()
+{
+	bool changed = (strcmp(path_index.path_env, current_path()) != 0);
+	bool owner = (path_index.owner == getpid());
+
+	// Drain the pending events, any event means a command was added or removed.
+	if (!changed && owner && path_index.inotify_fd != -1)
+	{
+		char events[4096];
+		ssize_t n;
+
+		while ((n = read(path_index.inotify_fd, events, sizeof(events))) > 0)
+			changed = true;
+	}
+
+	// Directories without a watch are checked by their modification time, and so is every directory in a forked
+	// child, which must not consume the events of the shell's inotify instance.
+	for (size_t i = 0; !changed && i < path_index.num_dirs; ++i)
+	{
+		PPathDir dir = path_index.dirs + i;
+		struct timespec mtime;
+
+		if (dir->wd != -1 && owner)
+			continue;
+
+		dir_mtime(dir->path, &mtime);
+		changed = (mtime.tv_sec != dir->mtime.tv_sec || mtime.tv_nsec != dir->mtime.tv_nsec);
+	}
+
+	return changed;
+}
+
+const char *path_index_lookup(const char *name)
+{
+	if (strchr(name, '/') != NULL || *name == '\0')
+		return NULL;
+
+	if (!path_index.built || strcmp(path_index.path_env, current_path()) != 0)
+	{
+		if (build_index() == Failure)
+			return NULL;
+	}
+
+	// A relative $PATH directory may shadow any command, leave the search to execvp(3).
+	if (path_index.relative)
+		return NULL;
+
+	// A hit may be shadowed by a command that was added to an earlier directory, and a miss may be a new command,
+	// so the index is brought up to date first (a single non-blocking read of the pending inotify events).
+	if (index_changed() && build_index() == Failure)
+		return NULL;
+
+	size_t *slot = find_slot(name);
+
+	return (*slot != 0) ? path_index.arena + (path_index.entries + *slot - 1)->path : NULL;
+}
+
+const char **path_index_complete(const char *prefix, size_t prefix_len, size_t *count)
+{
+	*count = 0;
+
+	if (!path_index.built || index_changed())
+	{
+		if (build_index() == Failure)
+			return NULL;
+	}
+
+	// The names are sorted, so all the matches are adjacent: find the first one with a binary search.
+	size_t low = 0, high = path_index.num_names;
+
+	while (low < high)
+	{
+		size_t mid = low + (high - low) / 2;
+
+		if (strncmp(*(path_index.names + mid), prefix, prefix_len) < 0)
+			low = mid + 1;
+
+		else
+			high = mid;
+	}
+
+	for (size_t i = low; i < path_index.num_names && strncmp(*(path_index.names + i), prefix, prefix_len) == 0; ++i)
+		++*count;
+
+	return path_index.names + low;
+}
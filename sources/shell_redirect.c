@@ -0,0 +1,819 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Redirections Implementation File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_redirect.h"
+#include "../include/shell_utils.h"
+#include "../include/shell_lineedit.h"
+#include "../include/shell_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+/*
+ * @brief Redirection operators, as written by the user.
+ */
+typedef enum _RedirectOp
+{
+	OP_IN,			 /* < */
+	OP_OUT,			 /* > */
+	OP_APPEND,		 /* >> */
+	OP_CLOBBER,		 /* >| */
+	OP_READ_WRITE,	 /* <> */
+	OP_DUP_IN,		 /* <& */
+	OP_DUP_OUT,		 /* >& */
+	OP_ALL,			 /* &> */
+	OP_ALL_APPEND,	 /* &>> */
+	OP_HEREDOC,		 /* << */
+	OP_HEREDOC_TABS, /* <<- */
+	OP_HERESTRING	 /* <<< */
+} RedirectOp;
+
+/*
+ * @brief The redirection operators that may follow an optional file descriptor number, longest first.
+ */
+static const struct
+{
+	const char *token;
+	RedirectOp op;
+	int default_fd;
+} redirect_ops[] = {
+	{"<<<", OP_HERESTRING, STDIN_FILENO},
+	{"<<-", OP_HEREDOC_TABS, STDIN_FILENO},
+	{"<<", OP_HEREDOC, STDIN_FILENO},
+	{"<>", OP_READ_WRITE, STDIN_FILENO},
+	{"<&", OP_DUP_IN, STDIN_FILENO},
+	{"<", OP_IN, STDIN_FILENO},
+	{">>", OP_APPEND, STDOUT_FILENO},
+	{">|", OP_CLOBBER, STDOUT_FILENO},
+	{">&", OP_DUP_OUT, STDOUT_FILENO},
+	{">", OP_OUT, STDOUT_FILENO},
+};
+
+/*
+ * @brief The bodies of the next here-documents, read ahead of time (NULL terminated), NULL to read them from the input.
+ */
+static char *const *preset_bodies = NULL;
+
+/*
+ * @brief Parse the redirection operator at the start of an argument.
+ * @param arg The argument to parse.
+ * @param fd The redirected file descriptor, or -1 for both the standard output and error ("&>").
+ * @param explicit_fd True if the file descriptor number was written by the user.
+ * @param op The redirection operator.
+ * @param word The word that follows the operator inside the argument (may be empty).
+ * @return True if the argument starts with a redirection operator, False otherwise.
+ */
+static bool parse_redirect_op(const char *arg, int *fd, bool *explicit_fd, RedirectOp *op, const char **word)
+{
+	*fd = -1;
+	*explicit_fd = false;
+
+	if (*arg == '&' && *(arg + 1) == '>')
+	{
+		bool append = (*(arg + 2) == '>');
+
+		*op = append ? OP_ALL_APPEND : OP_ALL;
+		*word = arg + (append ? 3 : 2);
+
+		return true;
+	}
+
+	// Only the single digit descriptors (0-9) can be redirected, like in POSIX sh.
+	if (isdigit((unsigned char)*arg) && (*(arg + 1) == '<' || *(arg + 1) == '>'))
+	{
+		*fd = *arg - '0';
+		*explicit_fd = true;
+		++arg;
+	}
+
+	for (size_t k = 0; k < sizeof(redirect_ops) / sizeof(*redirect_ops); ++k)
+	{
+		size_t len = strlen(redirect_ops[k].token);
+
+		if (strncmp(arg, redirect_ops[k].token, len) != 0)
+			continue;
+
+		// "<(cmd)" and ">(cmd)" are process substitutions, not redirections.
+		if (!*explicit_fd && *(arg + len) == '(')
+			return false;
+
+		*op = redirect_ops[k].op;
+		*word = arg + len;
+
+		if (!*explicit_fd)
+			*fd = redirect_ops[k].default_fd;
+
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * @brief Find the redirection of a file descriptor in a list.
+ * @param list The redirection list.
+ * @param fd The file descriptor.
+ * @return The redirection, or NULL if the descriptor isn't redirected.
+ */
+static PRedirect find_redirect(PRedirectList list, int fd)
+{
+	for (int k = 0; k < list->count; ++k)
+	{
+		if ((list->redirects + k)->fd == fd)
+			return list->redirects + k;
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief Add a redirection to a list, overriding an earlier redirection of the same descriptor.
+ * @param list The redirection list.
+ * @param type The type of the redirection.
+ * @param fd The redirected file descriptor.
+ * @param source The source file descriptor.
+ * @return Success if the redirection was added, Failure otherwise.
+ */
+static Result add_redirect(PRedirectList list, RedirectType type, int fd, int source)
+{
+	PRedirect redirect = find_redirect(list, fd);
+
+	if (redirect == NULL)
+	{
+		PRedirect tmp = (PRedirect)realloc(list->redirects, (list->count + 1) * sizeof(Redirect));
+
+		if (tmp == NULL)
+		{
+			perror("Internal error: System call faliure: realloc(3)");
+			return Failure;
+		}
+
+		list->redirects = tmp;
+		redirect = list->redirects + list->count++;
+		redirect->fd = fd;
+	}
+
+	redirect->type = type;
+	redirect->source = source;
+
+	return Success;
+}
+
+/*
+ * @brief Add a duplication (fd>&source) to a list, resolved against the redirections before it.
+ * @param list The redirection list.
+ * @param fd The redirected file descriptor.
+ * @param source The duplicated file descriptor.
+ * @return Success if the redirection was added, Failure otherwise.
+ */
+static Result add_dup(PRedirectList list, int fd, int source)
+{
+	PRedirect redirect = find_redirect(list, source);
+
+	// The source is one of the child's original descriptors.
+	if (redirect == NULL)
+		return (fd == source) ? Success : add_redirect(list, REDIRECT_DUP, fd, source);
+
+	else if (redirect->type == REDIRECT_CLOSE)
+	{
+		fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_BAD_FD);
+		return Failure;
+	}
+
+	// The source was already redirected, so just share its source.
+	RedirectType type = redirect->type;
+	int redirect_source = redirect->source;
+
+	return add_redirect(list, type, fd, redirect_source);
+}
+
+int move_fd_high(int fd)
+{
+	if (fd >= SHELL_REDIRECT_FD_BASE)
+		return fd;
+
+	int high_fd = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_REDIRECT_FD_BASE);
+
+	if (high_fd == -1)
+		perror("Internal error: System call faliure: fcntl(2)");
+
+	close(fd);
+
+	return high_fd;
+}
+
+/*
+ * @brief Get the delimiter of a here-document, without the single quotes that disable the expansion of its body.
+ * @param word The word of the here-document operator.
+ * @param delimiter The delimiter, at least as long as the word.
+ * @return True if the delimiter was quoted, False otherwise.
+ */
+static bool heredoc_delimiter(const char *word, char *delimiter)
+{
+	size_t word_len = strlen(word);
+	bool quoted = (word_len >= 2 && *word == '\'' && *(word + word_len - 1) == '\'');
+
+	strcpy(delimiter, word + quoted);
+	*(delimiter + word_len - 2 * quoted) = '\0';
+
+	return quoted;
+}
+
+/*
+ * @brief Create the file descriptor of a here-document or a here-string.
+ * @param op The operator (OP_HEREDOC, OP_HEREDOC_TABS or OP_HERESTRING).
+ * @param word The delimiter of the here-document, or the here-string itself.
+ * @param variableList The list of variables, used to expand the body.
+ * @return The file descriptor, or -1 on failure.
+ */
+static int open_heredoc(RedirectOp op, const char *word, PLinkedList variableList)
+{
+	char *body = NULL;
+	size_t len = 0;
+
+	if (op == OP_HERESTRING)
+	{
+		if ((body = expand_variables_str(word, variableList)) == NULL)
+			return -1;
+
+		len = strlen(body);
+
+		// A here-string always ends with a newline.
+		char *tmp = (char *)realloc(body, len + 2);
+
+		if (tmp == NULL)
+		{
+			perror("Internal error: System call faliure: realloc(3)");
+			free(body);
+			return -1;
+		}
+
+		body = tmp;
+		*(body + len++) = '\n';
+		*(body + len) = '\0';
+	}
+
+	else
+	{
+		// A single quoted delimiter ('EOF') disables the expansion of the body.
+		char delimiter[strlen(word) + 1];
+		bool quoted = heredoc_delimiter(word, delimiter);
+
+		if ((body = read_heredoc_body(delimiter, (op == OP_HEREDOC_TABS), &len)) == NULL)
+			return -1;
+
+		if (!quoted)
+		{
+			char *expanded = expand_variables_str(body, variableList);
+			free(body);
+
+			if ((body = expanded) == NULL)
+				return -1;
+
+			len = strlen(body);
+		}
+	}
+
+	int fd = create_heredoc_fd(body, len);
+	free(body);
+
+	return (fd == -1) ? -1 : move_fd_high(fd);
+}
+
+/*
+ * @brief Resolve a single redirection operator into a redirection list.
+ * @param list The redirection list of the stage.
+ * @param fd The redirected file descriptor, or -1 for both the standard output and error.
+ * @param explicit_fd True if the file descriptor number was written by the user.
+ * @param op The redirection operator.
+ * @param word The word of the operator (file name, descriptor number, delimiter or here-string).
+ * @param variableList The list of variables.
+ * @return Success if the redirection was resolved, Failure otherwise.
+ */
+static Result add_operator(PRedirectList list, int fd, bool explicit_fd, RedirectOp op, const char *word, PLinkedList variableList)
+{
+	int flags = 0, source = -1;
+
+	switch (op)
+	{
+		case OP_DUP_IN:
+		case OP_DUP_OUT:
+		{
+			if (strcmp(word, "-") == 0)
+				return add_redirect(list, REDIRECT_CLOSE, fd, -1);
+
+			else if (isdigit((unsigned char)*word) && *(word + 1) == '\0')
+				return add_dup(list, fd, *word - '0');
+
+			// ">&file" is the same as "&>file".
+			else if (op == OP_DUP_OUT && !explicit_fd)
+			{
+				fd = -1;
+				flags = O_WRONLY | O_CREAT | O_TRUNC;
+				break;
+			}
+
+			fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_BAD_FD);
+			return Failure;
+		}
+
+		case OP_IN:
+			flags = O_RDONLY;
+			break;
+
+		// There is no noclobber option, so ">|" is the same as ">".
+		case OP_OUT:
+		case OP_CLOBBER:
+		case OP_ALL:
+			flags = O_WRONLY | O_CREAT | O_TRUNC;
+			break;
+
+		case OP_APPEND:
+		case OP_ALL_APPEND:
+			flags = O_WRONLY | O_CREAT | O_APPEND;
+			break;
+
+		case OP_READ_WRITE:
+			flags = O_RDWR | O_CREAT;
+			break;
+
+		case OP_HEREDOC:
+		case OP_HEREDOC_TABS:
+		case OP_HERESTRING:
+			source = open_heredoc(op, word, variableList);
+			break;
+	}
+
+	if (flags != 0 || op == OP_IN)
+	{
+		if ((source = open(word, flags | O_CLOEXEC, 0644)) == -1)
+			perror("Internal error: System call faliure: open(2)");
+
+		else
+			source = move_fd_high(source);
+	}
+
+	if (source == -1)
+		return Failure;
+
+	int *tmp = (int *)realloc(list->fds, (list->num_fds + 1) * sizeof(int));
+
+	if (tmp == NULL)
+	{
+		perror("Internal error: System call faliure: realloc(3)");
+		close(source);
+		return Failure;
+	}
+
+	list->fds = tmp;
+	*(list->fds + list->num_fds++) = source;
+
+	if (fd == -1)
+		return (add_redirect(list, REDIRECT_FILE, STDOUT_FILENO, source) == Success &&
+				add_redirect(list, REDIRECT_FILE, STDERR_FILENO, source) == Success) ? Success : Failure;
+
+	return add_redirect(list, REDIRECT_FILE, fd, source);
+}
+
+bool is_redirect(const char *arg)
+{
+	int fd;
+	bool explicit_fd;
+	RedirectOp op;
+	const char *word;
+
+	return parse_redirect_op(arg, &fd, &explicit_fd, &op, &word);
+}
+
+bool redirect_word_follows(const char *arg)
+{
+	int fd;
+	bool explicit_fd;
+	RedirectOp op;
+	const char *word;
+
+	return parse_redirect_op(arg, &fd, &explicit_fd, &op, &word) && *word == '\0';
+}
+
+char *read_heredoc_body(const char *delimiter, bool strip_tabs, size_t *len)
+{
+	size_t cap = SHELL_MAX_COMMAND_LENGTH, line_len, delimiter_len = strlen(delimiter);
+	char *body = (char *)malloc(cap), *line = NULL;
+	const char *prompt = isatty(STDIN_FILENO) ? SHELL_HEREDOC_PROMPT : NULL;
+
+	*len = 0;
+
+	if (body == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return NULL;
+	}
+
+	// The body was read ahead of time, when the command was (e.g. a line of a function's body).
+	if (preset_bodies != NULL && *preset_bodies != NULL)
+	{
+		free(body);
+		*len = strlen(*preset_bodies);
+
+		if ((body = strdup(*preset_bodies++)) == NULL)
+			perror("Internal error: System call faliure: strdup(3)");
+
+		return body;
+	}
+
+	while (1)
+	{
+		// The body follows the command in the same input, so it's read through the line editor.
+		if ((line = read_line(prompt, &line_len, NULL)) == NULL)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_HEREDOC_EOF);
+			break;
+		}
+
+		while (strip_tabs && *line == '\t')
+		{
+			++line;
+			--line_len;
+		}
+
+		if (line_len == delimiter_len && strncmp(line, delimiter, delimiter_len) == 0)
+			break;
+
+		// Grow the body geometrically, so multi-megabyte bodies are read in linear time.
+		if (*len + line_len + 2 > cap)
+		{
+			while (*len + line_len + 2 > cap)
+				cap *= 2;
+
+			char *tmp = (char *)realloc(body, cap);
+
+			if (tmp == NULL)
+			{
+				perror("Internal error: System call faliure: realloc(3)");
+				free(body);
+				return NULL;
+			}
+
+			body = tmp;
+		}
+
+		memcpy(body + *len, line, line_len);
+		*len += line_len;
+		*(body + (*len)++) = '\n';
+	}
+
+	*(body + *len) = '\0';
+
+	return body;
+}
+
+Result read_heredoc_bodies(char **argv, char ***bodies)
+{
+	int count = 0;
+
+	*bodies = NULL;
+
+	for (int i = 0; *(argv + i) != NULL; ++i)
+	{
+		const char *word = NULL;
+		bool explicit_fd = false;
+		RedirectOp op;
+		int fd;
+
+		if (!parse_redirect_op(*(argv + i), &fd, &explicit_fd, &op, &word) || (op != OP_HEREDOC && op != OP_HEREDOC_TABS))
+			continue;
+
+		// A missing delimiter is reported when the command runs.
+		if (*word == '\0' && (word = *(argv + i + 1)) == NULL)
+			break;
+
+		char delimiter[strlen(word) + 1];
+		size_t len = 0;
+		char **tmp = (char **)realloc(*bodies, (count + 2) * sizeof(char *));
+
+		heredoc_delimiter(word, delimiter);
+
+		if (tmp == NULL)
+		{
+			perror("Internal error: System call faliure: realloc(3)");
+			freeUpMem(bodies);
+			return Failure;
+		}
+
+		*bodies = tmp;
+		*(*bodies + count + 1) = NULL;
+
+		if ((*(*bodies + count) = read_heredoc_body(delimiter, (op == OP_HEREDOC_TABS), &len)) == NULL)
+		{
+			freeUpMem(bodies);
+			return Failure;
+		}
+
+		++count;
+	}
+
+	return Success;
+}
+
+void heredoc_preset(char *const *bodies)
+{
+	preset_bodies = bodies;
+}
+
+int create_heredoc_fd(const char *body, size_t len)
+{
+	int fd = memfd_create("heredoc", MFD_CLOEXEC), write_fd;
+
+	if (fd != -1)
+		write_fd = fd;
+
+	// No memfd support, fallback to a pipe that must hold the whole body.
+	else
+	{
+		int pipe_fds[2];
+
+		if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+		{
+			perror("Internal error: System call faliure: pipe2(2)");
+			return -1;
+		}
+
+		STATS_INC(pipes);
+
+		// Try to enlarge the pipe buffer, and never block the shell if it's still too small.
+		if (len > PIPE_BUF)
+			fcntl(*(pipe_fds + 1), F_SETPIPE_SZ, (int)(len < INT_MAX ? len : INT_MAX));
+
+		fcntl(*(pipe_fds + 1), F_SETFL, O_NONBLOCK);
+
+		fd = *pipe_fds;
+		write_fd = *(pipe_fds + 1);
+	}
+
+	for (size_t written = 0; written < len;)
+	{
+		ssize_t ret = write(write_fd, body + written, len - written);
+
+		if (ret == -1)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN)
+				fprintf(stderr, "%s\n", SHELL_ERR_HEREDOC_TOO_LARGE);
+
+			else
+				perror("Internal error: System call faliure: write(2)");
+
+			if (write_fd != fd)
+				close(write_fd);
+
+			close(fd);
+			return -1;
+		}
+
+		written += ret;
+	}
+
+	if (write_fd != fd)
+		close(write_fd);
+
+	else if (lseek(fd, 0, SEEK_SET) == -1)
+	{
+		perror("Internal error: System call faliure: lseek(2)");
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+Result resolve_redirects(char **argv, PRedirectList stage_redirects, int num_stages, PLinkedList variableList)
+{
+	int stage = 0, out = 0, i = 0;
+	bool in_test = false;
+
+	memset(stage_redirects, 0, num_stages * sizeof(RedirectList));
+
+	while (*(argv + i) != NULL)
+	{
+		char *arg = *(argv + i);
+		const char *word = NULL;
+		bool explicit_fd = false;
+		RedirectOp op;
+		int fd;
+
+		if (is_pipe_separator(arg) && stage < num_stages - 1)
+			++stage;
+
+		// The "<" and ">" of a "[[ ... ]]" test are comparisons, they stay in the test.
+		if ((in_test = in_test_expression(arg, in_test)) || !parse_redirect_op(arg, &fd, &explicit_fd, &op, &word))
+		{
+			*(argv + out++) = *(argv + i++);
+			continue;
+		}
+
+		// The word may be glued to the operator ("2>&1", "<<EOF") or be the next argument ("> file").
+		int consumed = 1;
+
+		if (*word == '\0')
+		{
+			if (*(argv + i + 1) == NULL || is_pipe_separator(*(argv + i + 1)))
+			{
+				fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_NO_FILE);
+				break;
+			}
+
+			word = *(argv + i + 1);
+			consumed = 2;
+		}
+
+		if (add_operator(stage_redirects + stage, fd, explicit_fd, op, word, variableList) == Failure)
+			break;
+
+		// Remove the operator and its word from the arguments array.
+		for (int k = 0; k < consumed; ++k)
+			free(*(argv + i++));
+	}
+
+	// Failed in the middle, keep the rest of the arguments so they can be freed by the caller.
+	if (*(argv + i) != NULL)
+	{
+		while (*(argv + i) != NULL)
+			*(argv + out++) = *(argv + i++);
+
+		*(argv + out) = NULL;
+		close_redirects(stage_redirects, num_stages);
+		return Failure;
+	}
+
+	*(argv + out) = NULL;
+
+	return Success;
+}
+
+Result apply_redirects(PRedirectList list)
+{
+	PRedirect redirects = list->redirects;
+
+	// Save the original descriptors that are duplicated but also overridden, before overriding them.
+	for (int i = 0; i < list->count; ++i)
+	{
+		int original = (redirects + i)->source;
+
+		if ((redirects + i)->type != REDIRECT_DUP || find_redirect(list, original) == NULL)
+			continue;
+
+		int saved = fcntl(original, F_DUPFD_CLOEXEC, SHELL_REDIRECT_FD_BASE);
+
+		if (saved == -1)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_BAD_FD);
+			return Failure;
+		}
+
+		// Every duplicate of the same descriptor shares the saved copy.
+		for (int j = i; j < list->count; ++j)
+		{
+			if ((redirects + j)->type == REDIRECT_DUP && (redirects + j)->source == original)
+				(redirects + j)->source = saved;
+		}
+	}
+
+	for (int i = 0; i < list->count; ++i)
+	{
+		if ((redirects + i)->type == REDIRECT_CLOSE)
+			close((redirects + i)->fd);
+
+		else if (dup2((redirects + i)->source, (redirects + i)->fd) == -1)
+		{
+			fprintf(stderr, "%s\n", SHELL_ERR_REDIRECT_BAD_FD);
+			return Failure;
+		}
+	}
+
+	return Success;
+}
+
+/*
+ * @brief Check if a file descriptor was opened by the shell for a redirection list.
+ * @param list The redirection list.
+ * @param fd The file descriptor.
+ * @return True if the descriptor belongs to the list, False otherwise.
+ */
+static bool is_list_fd(PRedirectList list, int fd)
+{
+	for (int j = 0; j < list->num_fds; ++j)
+	{
+		if (*(list->fds + j) == fd)
+			return true;
+	}
+
+	return false;
+}
+
+bool redirects_in_shell_supported(PRedirectList list)
+{
+	for (int i = 0; i < list->count; ++i)
+	{
+		PRedirect redirect = list->redirects + i;
+
+		if (redirect->fd > STDERR_FILENO ||
+			(redirect->type == REDIRECT_DUP && redirect->source > STDERR_FILENO && !is_list_fd(list, redirect->source)))
+			return false;
+	}
+
+	return true;
+}
+
+Result apply_redirects_in_shell(PRedirectList list, int *saved)
+{
+	fflush(stdout);
+	fflush(stderr);
+
+	for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd)
+		*(saved + fd) = fcntl(fd, F_DUPFD_CLOEXEC, SHELL_REDIRECT_FD_BASE);
+
+	if (apply_redirects(list) == Failure)
+	{
+		restore_redirects_in_shell(list, saved);
+		return Failure;
+	}
+
+	return Success;
+}
+
+void restore_redirects_in_shell(PRedirectList list, int *saved)
+{
+	fflush(stdout);
+	fflush(stderr);
+
+	for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd)
+	{
+		if (*(saved + fd) == -1)
+			close(fd);
+
+		else
+		{
+			dup2(*(saved + fd), fd);
+			close(*(saved + fd));
+		}
+	}
+
+	// apply_redirects() saves the descriptors that are both duplicated and overridden, these copies are the shell's now.
+	for (int i = 0; i < list->count; ++i)
+	{
+		int source = (list->redirects + i)->source;
+		bool seen = false;
+
+		if ((list->redirects + i)->type != REDIRECT_DUP || source < SHELL_REDIRECT_FD_BASE || is_list_fd(list, source))
+			continue;
+
+		for (int j = 0; j < i && !seen; ++j)
+			seen = ((list->redirects + j)->type == REDIRECT_DUP && (list->redirects + j)->source == source);
+
+		if (!seen)
+			close(source);
+	}
+}
+
+void close_redirects(PRedirectList stage_redirects, int num_stages)
+{
+	for (int k = 0; k < num_stages; ++k)
+	{
+		PRedirectList list = stage_redirects + k;
+
+		for (int j = 0; j < list->num_fds; ++j)
+			close(*(list->fds + j));
+
+		free(list->fds);
+		free(list->redirects);
+
+		list->fds = NULL;
+		list->redirects = NULL;
+		list->num_fds = 0;
+		list->count = 0;
+	}
+}
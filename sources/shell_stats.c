@@ -0,0 +1,241 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Statistics Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_stats.h"
+#include "../include/shell_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+ShellStats shell_stats = {0};
+
+/*
+ * @brief The latency histogram of a command. The name is the first member, the key of the latency table.
+ */
+typedef struct StatsLatency {
+	char *name;
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+	uint64_t buckets[STATS_LATENCY_BUCKETS];
+} StatsLatency, *PStatsLatency;
+
+// The latency histograms, keyed by the command name.
+static NameTable latency_table = {0};
+
+void stats_record_latency(const char *name, uint64_t elapsed_ns)
+{
+	if (name == NULL)
+		return;
+
+	PStatsLatency entry = (PStatsLatency)name_table_lookup(&latency_table, name);
+
+	if (entry == NULL)
+	{
+		if ((entry = (PStatsLatency)calloc(1, sizeof(StatsLatency))) == NULL || (entry->name = strdup(name)) == NULL)
+		{
+			perror("Internal error: System call faliure: calloc(3)/strdup(3)");
+			free(entry);
+			return;
+		}
+
+		if (name_table_insert(&latency_table, entry) == Failure)
+		{
+			free(entry->name);
+			free(entry);
+			return;
+		}
+	}
+
+	// The bucket is the base 2 logarithm of the latency in microseconds.
+	uint64_t us = elapsed_ns / 1000;
+	int bucket = (us < 2) ? 0 : 63 - __builtin_clzll(us);
+
+	if (bucket >= STATS_LATENCY_BUCKETS)
+		bucket = STATS_LATENCY_BUCKETS - 1;
+
+	++entry->count;
+	++*(entry->buckets + bucket);
+	entry->total_ns += elapsed_ns;
+
+	if (elapsed_ns > entry->max_ns)
+		entry->max_ns = elapsed_ns;
+}
+
+void stats_free()
+{
+	for (size_t i = 0; i < latency_table.capacity; ++i)
+	{
+		PStatsLatency entry = (PStatsLatency)*(latency_table.slots + i);
+
+		if (entry != NULL)
+		{
+			free(entry->name);
+			free(entry);
+		}
+	}
+
+	name_table_free(&latency_table);
+}
+
+void stats_reset()
+{
+	memset(&shell_stats, 0, sizeof(shell_stats));
+	stats_free();
+}
+
+/*
+ * @brief Estimate a percentile of a latency histogram.
+ * @param entry The histogram.
+ * @param percent The percentile.
+ * @return The upper bound of the bucket the percentile falls into, in microseconds.
+ */
+static uint64_t percentile_us(PStatsLatency entry, int percent)
+{
+	uint64_t rank = (entry->count * percent + 99) / 100, seen = 0;
+
+	for (int i = 0; i < STATS_LATENCY_BUCKETS; ++i)
+	{
+		if ((seen += *(entry->buckets + i)) >= rank)
+			return 2ULL << i;
+	}
+
+	return 2ULL << (STATS_LATENCY_BUCKETS - 1);
+}
+
+/*
+ * @brief Compare two latency histograms by their total time, the slowest first.
+ */
+static int compare_total(const void *a, const void *b)
+{
+	uint64_t ta = (*(const PStatsLatency *)a)->total_ns, tb = (*(const PStatsLatency *)b)->total_ns;
+
+	return (ta < tb) - (ta > tb);
+}
+
+/*
+ * @brief Print a string as a JSON string literal.
+ * @param out The stream to print to.
+ * @param str The string.
+ */
+static void print_json_string(FILE *out, const char *str)
+{
+	fputc('"', out);
+
+	for (; *str != '\0'; ++str)
+	{
+		if (*str == '"' || *str == '\\')
+			fprintf(out, "\\%c", *str);
+
+		else if ((unsigned char)*str < 0x20)
+			fprintf(out, "\\u%04x", (unsigned char)*str);
+
+		else
+			fputc(*str, out);
+	}
+
+	fputc('"', out);
+}
+
+void stats_print(FILE *out, bool json)
+{
+	const struct {
+		const char *name;
+		uint64_t value;
+	} counters[] = {
+		{"forks", shell_stats.forks},
+		{"execs", shell_stats.execs},
+		{"exec_failures", shell_stats.exec_failures},
+		{"pipes", shell_stats.pipes},
+		{"bytes_tokenized", shell_stats.bytes_tokenized},
+		{"var_lookups", shell_stats.var_lookups},
+		{"var_hits", shell_stats.var_hits},
+		{"skipped_lines", shell_stats.skipped_lines},
+		{"allocations", shell_stats.allocations},
+		{"parse_ns", shell_stats.parse_ns},
+		{"wait_ns", shell_stats.wait_ns},
+		{"builtin_ns", shell_stats.builtin_ns},
+	};
+	const size_t num_counters = sizeof(counters) / sizeof(*counters);
+
+	// Collect the histograms, sorted by total time.
+	PStatsLatency sorted[latency_table.count + 1];
+	size_t n = 0;
+
+	for (size_t i = 0; i < latency_table.capacity; ++i)
+	{
+		if (*(latency_table.slots + i) != NULL)
+			*(sorted + n++) = (PStatsLatency)*(latency_table.slots + i);
+	}
+
+	qsort(sorted, n, sizeof(PStatsLatency), compare_total);
+
+	if (json)
+	{
+		fputc('{', out);
+
+		for (size_t i = 0; i < num_counters; ++i)
+			fprintf(out, "\"%s\": %llu, ", counters[i].name, (unsigned long long)counters[i].value);
+
+		fprintf(out, "\"commands\": [");
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			PStatsLatency entry = *(sorted + i);
+			int last_bucket = STATS_LATENCY_BUCKETS - 1;
+
+			// Trailing empty buckets are omitted.
+			while (last_bucket > 0 && *(entry->buckets + last_bucket) == 0)
+				--last_bucket;
+
+			fprintf(out, "%s{\"name\": ", (i > 0) ? ", " : "");
+			print_json_string(out, entry->name);
+			fprintf(out, ", \"count\": %llu, \"total_ns\": %llu, \"mean_ns\": %llu, \"max_ns\": %llu, \"p50_us\": %llu, \"p99_us\": %llu, \"histogram_log2_us\": [",
+					(unsigned long long)entry->count, (unsigned long long)entry->total_ns,
+					(unsigned long long)(entry->total_ns / entry->count), (unsigned long long)entry->max_ns,
+					(unsigned long long)percentile_us(entry, 50), (unsigned long long)percentile_us(entry, 99));
+
+			for (int b = 0; b <= last_bucket; ++b)
+				fprintf(out, "%s%llu", (b > 0) ? ", " : "", (unsigned long long)*(entry->buckets + b));
+
+			fprintf(out, "]}");
+		}
+
+		fprintf(out, "]}\n");
+		return;
+	}
+
+	fprintf(out, "Shell Statistics:\n");
+
+	for (size_t i = 0; i < num_counters; ++i)
+		fprintf(out, "%-20s\t%llu\n", counters[i].name, (unsigned long long)counters[i].value);
+
+	fprintf(out, "\nCommand Latency (percentiles are bucket upper bounds):\n");
+	fprintf(out, "%-20s\t%-8s\t%-10s\t%-10s\t%-10s\t%-10s\t%-10s\n", "CMD", "COUNT", "TOTAL(us)", "MEAN(us)", "P50(us)", "P99(us)", "MAX(us)");
+
+	for (size_t i = 0; i < n; ++i)
+	{
+		PStatsLatency entry = *(sorted + i);
+
+		fprintf(out, "%-20s\t%-8llu\t%-10llu\t%-10llu\t%-10llu\t%-10llu\t%-10llu\n", entry->name,
+				(unsigned long long)entry->count, (unsigned long long)(entry->total_ns / 1000),
+				(unsigned long long)(entry->total_ns / entry->count / 1000),
+				(unsigned long long)percentile_us(entry, 50), (unsigned long long)percentile_us(entry, 99),
+				(unsigned long long)(entry->max_ns / 1000));
+	}
+}
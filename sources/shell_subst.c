@@ -0,0 +1,471 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Substitutions Implementation File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_subst.h"
+#include "../include/shell_arith.h"
+#include "../include/shell.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+bool is_process_substitution(const char *arg)
+{
+	size_t len = strlen(arg);
+
+	return (len >= 3 && (*arg == '<' || *arg == '>') && *(arg + 1) == '(' && *(arg + len - 1) == ')');
+}
+
+Result start_process_substitutions(PShellContext ctx, char **argv, PProcSubst subst, pid_t *pgid, bool foreground, bool isolate)
+{
+	int count = 0, stage = 0;
+
+	subst->count = 0;
+
+	for (char **arg = argv; *arg != NULL; ++arg)
+		count += is_process_substitution(*arg);
+
+	subst->pids = (pid_t *)calloc(count, sizeof(pid_t));
+	subst->fds = (int *)calloc(count, sizeof(int));
+	subst->stages = (int *)calloc(count, sizeof(int));
+
+	if (subst->pids == NULL || subst->fds == NULL || subst->stages == NULL)
+	{
+		perror("Internal error: System call faliure: calloc(3)");
+		reap_process_substitutions(subst, true);
+		return Failure;
+	}
+
+	// Anything buffered by the shell must not be written twice by the children.
+	fflush(stdout);
+	fflush(stderr);
+
+	for (char **arg = argv; *arg != NULL; ++arg)
+	{
+		if (is_pipe_separator(*arg))
+			++stage;
+
+		if (!is_process_substitution(*arg))
+			continue;
+
+		// "<(cmd)" - the command reads the child's output, ">(cmd)" - the child reads the command's output.
+		bool is_input = (**arg == '<');
+		int pipe_fds[2];
+
+		if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+		{
+			perror("Internal error: System call faliure: pipe2(2)");
+			close_process_substitutions(subst);
+			reap_process_substitutions(subst, true);
+			return Failure;
+		}
+
+		// The command's end is passed by its number, so it's moved out of the range its redirections may overwrite.
+		if ((*(pipe_fds + !is_input) = move_fd_high(*(pipe_fds + !is_input))) == -1)
+		{
+			close(*(pipe_fds + is_input));
+			close_process_substitutions(subst);
+			reap_process_substitutions(subst, true);
+			return Failure;
+		}
+
+		STATS_INC(pipes);
+		STATS_INC(forks);
+		pid_t pid = fork();
+
+		if (pid == -1)
+		{
+			perror("Internal error: System call faliure: fork(2)");
+			close(*pipe_fds);
+			close(*(pipe_fds + 1));
+			close_process_substitutions(subst);
+			reap_process_substitutions(subst, true);
+			return Failure;
+		}
+
+		else if (pid == 0)
+		{
+			job_child_init(*pgid, foreground, isolate);
+
+			// The other substitutions belong to the command, holding them would delay their EOF.
+			for (int k = 0; k < subst->count; ++k)
+				close(*(subst->fds + k));
+
+			dup2(*(pipe_fds + is_input), is_input ? STDOUT_FILENO : STDIN_FILENO);
+			close(*pipe_fds);
+			close(*(pipe_fds + 1));
+
+			// Strip the "<(" and ")" and run the inner command.
+			*(*arg + strlen(*arg) - 1) = '\0';
+			run_subshell(ctx, *arg + 2);
+		}
+
+		*pgid = job_add_process(pid, *pgid, foreground, isolate);
+		close(*(pipe_fds + is_input));
+
+		*(subst->pids + subst->count) = pid;
+		*(subst->fds + subst->count) = *(pipe_fds + !is_input);
+		*(subst->stages + subst->count) = stage;
+		subst->count++;
+
+		// Replace the substitution with the path of the shell's end of the pipe.
+		char path[32] = {0};
+		sprintf(path, "/dev/fd/%d", *(pipe_fds + !is_input));
+
+		char *tmp = (char *)calloc(strlen(path) + 1, sizeof(char));
+
+		if (tmp == NULL)
+		{
+			perror("Internal error: System call faliure: calloc(3)");
+			close_process_substitutions(subst);
+			reap_process_substitutions(subst, true);
+			return Failure;
+		}
+
+		strcpy(tmp, path);
+		free(*arg);
+		*arg = tmp;
+	}
+
+	return Success;
+}
+
+void inherit_process_substitutions(PProcSubst subst, int stage)
+{
+	for (int k = 0; k < subst->count; ++k)
+	{
+		if (*(subst->stages + k) == stage && *(subst->fds + k) != -1)
+			fcntl(*(subst->fds + k), F_SETFD, 0);
+	}
+}
+
+void close_process_substitutions(PProcSubst subst)
+{
+	for (int k = 0; k < subst->count; ++k)
+	{
+		if (*(subst->fds + k) != -1)
+		{
+			close(*(subst->fds + k));
+			*(subst->fds + k) = -1;
+		}
+	}
+}
+
+void reap_process_substitutions(PProcSubst subst, bool block)
+{
+	for (int k = 0; k < subst->count; ++k)
+		waitpid(*(subst->pids + k), NULL, block ? 0 : WNOHANG);
+
+	free(subst->pids);
+	free(subst->fds);
+	free(subst->stages);
+
+	subst->pids = NULL;
+	subst->fds = NULL;
+	subst->stages = NULL;
+	subst->count = 0;
+}
+
+const char *find_substitution_end(const char *open)
+{
+	bool in_quotes = false;
+	int depth = 0;
+
+	for (const char *c = open; *c != '\0'; ++c)
+	{
+		if (*c == '"')
+			in_quotes = !in_quotes;
+
+		else if (!in_quotes && *c == '(')
+			++depth;
+
+		else if (!in_quotes && *c == ')' && --depth == 0)
+			return c;
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief Capture the output of a builtin in-process, without forking a subshell.
+ * @param ctx The shell context.
+ * @param command The command line to run.
+ * @param output The captured output.
+ * @param len The length of the captured output.
+ * @param status The exit status of the builtin.
+ * @return True if the command was a simple side effect free builtin and was captured, False otherwise.
+ * @note The standard output is temporary redirected into an anonymous memory file while the builtin runs.
+ */
+static bool capture_builtin(PShellContext ctx, const char *command, char **output, size_t *len, int *status)
+{
+	int words = count_tokens(command);
+	char **argv = NULL;
+	bool captured = false;
+
+	if (words < 1 || (argv = tokenize_command(command, words)) == NULL || *argv == NULL)
+	{
+		freeUpMem(&argv);
+		return false;
+	}
+
+	// Only simple commands, anything with pipes, redirections, substitutions or patterns needs a real subshell.
+	for (char **arg = argv; *arg != NULL; ++arg)
+	{
+		if (strpbrk(*arg, "|<>&$*?[\\") != NULL)
+		{
+			freeUpMem(&argv);
+			return false;
+		}
+	}
+
+	if (strcmp(*argv, SHELL_CMD_PWD) != 0 && strcmp(*argv, SHELL_CMD_HISTORY) != 0 && !is_utility(*argv))
+	{
+		freeUpMem(&argv);
+		return false;
+	}
+
+	int fd = memfd_create("cmdsubst", MFD_CLOEXEC), saved_stdout = -1;
+
+	if (fd != -1)
+	{
+		fflush(stdout);
+
+		if ((saved_stdout = dup(STDOUT_FILENO)) != -1 && dup2(fd, STDOUT_FILENO) != -1)
+		{
+			if (strcmp(*argv, SHELL_CMD_PWD) == 0)
+				*status = (cmdPWD(ctx) == Success) ? 0 : 1;
+
+			else if (strcmp(*argv, SHELL_CMD_HISTORY) == 0)
+				*status = (cmdHistory(ctx, argv + 1) == Success) ? 0 : 1;
+
+			else
+				*status = cmdUtility(argv);
+
+			fflush(stdout);
+			dup2(saved_stdout, STDOUT_FILENO);
+
+			off_t size = lseek(fd, 0, SEEK_END);
+
+			if (size != -1 && (*output = (char *)malloc(size + 1)) != NULL)
+			{
+				*len = (pread(fd, *output, size, 0) == size) ? (size_t)size : 0;
+				*(*output + *len) = '\0';
+				captured = true;
+			}
+		}
+
+		if (saved_stdout != -1)
+			close(saved_stdout);
+
+		close(fd);
+	}
+
+	freeUpMem(&argv);
+
+	return captured;
+}
+
+char *capture_command_output(PShellContext ctx, const char *command, size_t *len)
+{
+	size_t cap = 4096;
+	char *output = NULL;
+	int pipe_fds[2], status = 0;
+
+	*len = 0;
+
+	if (!capture_builtin(ctx, command, &output, len, &status))
+	{
+		if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+		{
+			perror("Internal error: System call faliure: pipe2(2)");
+			return NULL;
+		}
+
+		STATS_INC(pipes);
+
+		// Anything buffered by the shell must not be written twice by the child.
+		fflush(stdout);
+		fflush(stderr);
+
+		STATS_INC(forks);
+		uint64_t subst_start = stats_now();
+		pid_t pid = fork();
+
+		if (pid == -1)
+		{
+			perror("Internal error: System call faliure: fork(2)");
+			close(*pipe_fds);
+			close(*(pipe_fds + 1));
+			return NULL;
+		}
+
+		else if (pid == 0)
+		{
+			job_reset_signals();
+			dup2(*(pipe_fds + 1), STDOUT_FILENO);
+			close(*pipe_fds);
+			close(*(pipe_fds + 1));
+			run_subshell(ctx, command);
+		}
+
+		close(*(pipe_fds + 1));
+
+		if ((output = (char *)malloc(cap)) == NULL)
+			perror("Internal error: System call faliure: malloc(3)");
+
+		// Read straight into the free space of the buffer, doubling it whenever it fills up.
+		while (output != NULL)
+		{
+			if (*len + 1 == cap)
+			{
+				char *tmp = (char *)realloc(output, cap * 2);
+
+				if (tmp == NULL)
+				{
+					perror("Internal error: System call faliure: realloc(3)");
+					free(output);
+					output = NULL;
+					break;
+				}
+
+				output = tmp;
+				cap *= 2;
+			}
+
+			ssize_t ret = read(*pipe_fds, output + *len, cap - *len - 1);
+
+			if (ret == -1 && errno == EINTR)
+				continue;
+
+			else if (ret <= 0)
+				break;
+
+			*len += ret;
+		}
+
+		// Closing the read end first lets the child die on EPIPE if we failed in the middle.
+		close(*pipe_fds);
+
+		while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+			;
+
+		status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+		trace_span("subst", subst_start, stats_now(), pid, -1, command);
+
+		if (output == NULL)
+			return NULL;
+	}
+
+	// The status of the substitution is the status of the command, until the command itself sets one.
+	ctx->subst_status = status;
+	update_laststatus(ctx, status);
+
+	// Trim the trailing newlines, like other shells do.
+	while (*len > 0 && *(output + *len - 1) == '\n')
+		--(*len);
+
+	*(output + *len) = '\0';
+
+	return output;
+}
+
+char *expand_command_substitutions(PShellContext ctx, const char *str)
+{
+	size_t cap = strlen(str) + 1, len = 0;
+	char *out = (char *)malloc(cap);
+
+	if (out == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return NULL;
+	}
+
+	while (*str != '\0')
+	{
+		const char *end = NULL, *value = str;
+		char *captured = NULL, number[32];
+		size_t skip = 1, value_len = 1;
+
+		// An arithmetic expansion, "$((expr))", the inner parentheses must close right before the outer ones.
+		if (*str == '$' && *(str + 1) == '(' && *(str + 2) == '(' && (end = find_substitution_end(str + 1)) != NULL &&
+			find_substitution_end(str + 2) == end - 1)
+		{
+			long long result;
+
+			if (arith_eval(ctx, str + 3, end - str - 4, &result) == Failure)
+			{
+				free(out);
+				return NULL;
+			}
+
+			value_len = snprintf(number, sizeof(number), "%lld", result);
+			value = number;
+			skip = end - str + 1;
+		}
+
+		else if (*str == '$' && *(str + 1) == '(' && (end = find_substitution_end(str + 1)) != NULL)
+		{
+			size_t inner_len = end - str - 2;
+			char inner[inner_len + 1];
+
+			memcpy(inner, str + 2, inner_len);
+			*(inner + inner_len) = '\0';
+
+			if ((captured = capture_command_output(ctx, inner, &value_len)) == NULL)
+			{
+				free(out);
+				return NULL;
+			}
+
+			value = captured;
+			skip = end - str + 1;
+		}
+
+		if (len + value_len + 1 > cap)
+		{
+			while (len + value_len + 1 > cap)
+				cap *= 2;
+
+			char *tmp = (char *)realloc(out, cap);
+
+			if (tmp == NULL)
+			{
+				perror("Internal error: System call faliure: realloc(3)");
+				free(captured);
+				free(out);
+				return NULL;
+			}
+
+			out = tmp;
+		}
+
+		memcpy(out + len, value, value_len);
+		len += value_len;
+		str += skip;
+		free(captured);
+	}
+
+	*(out + len) = '\0';
+
+	return out;
+}
@@ -0,0 +1,393 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Test Command Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_test.h"
+#include "../include/shell_glob.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * @brief The state of the evaluation of a test expression.
+ * @param args The arguments of the expression.
+ * @param argc The number of arguments.
+ * @param pos The index of the next argument.
+ * @param extended True for a "[[ ... ]]" expression.
+ * @param error True once the expression turned out to be invalid.
+ */
+typedef struct TestParser {
+	char **args;
+	int argc;
+	int pos;
+	bool extended;
+	bool error;
+} TestParser, *PTestParser;
+
+// The binary operators.
+static const char *binary_ops[] = {
+	"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", "-nt", "-ot", "-ef"
+};
+
+static bool parse_or(PTestParser p);
+
+/*
+ * @brief Report a syntax error, once.
+ */
+static void syntax_error(PTestParser p)
+{
+	if (!p->error)
+		fprintf(stderr, "%s\n", SHELL_ERR_CMD_TEST_SYNTAX);
+
+	p->error = true;
+}
+
+/*
+ * @brief Get an argument ahead of the current one, or NULL past the last one.
+ */
+static char *peek(PTestParser p, int ahead)
+{
+	return (p->pos + ahead < p->argc) ? *(p->args + p->pos + ahead) : NULL;
+}
+
+/*
+ * @brief Check if an argument is a binary operator.
+ */
+static bool is_binary(const char *arg)
+{
+	for (size_t k = 0; k < sizeof(binary_ops) / sizeof(*binary_ops); ++k)
+	{
+		if (strcmp(arg, binary_ops[k]) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * @brief Check if an argument is a unary operator.
+ */
+static bool is_unary(const char *arg)
+{
+	return (*arg == '-' && *(arg + 1) != '\0' && *(arg + 2) == '\0' && strchr("bcdefghknprsStuwxzL", *(arg + 1)) != NULL);
+}
+
+/*
+ * @brief Get the string value of an operand.
+ * @note The quoted characters of a "[[" operand are escaped, as it wasn't glob expanded.
+ */
+static const char *operand(PTestParser p, char *arg)
+{
+	if (p->extended)
+		glob_unescape(arg);
+
+	return arg;
+}
+
+/*
+ * @brief Parse the integer operand of an integer comparison.
+ * @param p The parser.
+ * @param arg The operand.
+ * @param value Where to store the integer.
+ * @return true on success, false (and an error) if the operand isn't an integer.
+ */
+static bool parse_integer(PTestParser p, char *arg, long long *value)
+{
+	const char *str = operand(p, arg);
+	char *end = NULL;
+
+	errno = 0;
+	*value = strtoll(str, &end, 10);
+
+	while (*end == ' ' || *end == '\t')
+		++end;
+
+	if (*str == '\0' || *end != '\0' || errno == ERANGE)
+	{
+		if (!p->error)
+			fprintf(stderr, "%s: %s\n", SHELL_ERR_CMD_TEST_INTEGER, str);
+
+		p->error = true;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * @brief Evaluate a unary test.
+ * @param p The parser.
+ * @param op The operator letter (the "f" of "-f").
+ * @param arg The operand.
+ * @return The result of the test.
+ */
+static bool unary(PTestParser p, char op, char *arg)
+{
+	const char *str = operand(p, arg);
+	struct stat st;
+
+	switch (op)
+	{
+		case 'z': return *str == '\0';
+		case 'n': return *str != '\0';
+		case 't': return isatty(atoi(str)) == 1;
+		case 'r': return access(str, R_OK) == 0;
+		case 'w': return access(str, W_OK) == 0;
+		case 'x': return access(str, X_OK) == 0;
+		case 'h':
+		case 'L': return lstat(str, &st) == 0 && S_ISLNK(st.st_mode);
+		default: break;
+	}
+
+	// The rest test the file a path refers to, through symbolic links.
+	if (stat(str, &st) == -1)
+		return false;
+
+	switch (op)
+	{
+		case 'e': return true;
+		case 'f': return S_ISREG(st.st_mode);
+		case 'd': return S_ISDIR(st.st_mode);
+		case 's': return st.st_size > 0;
+		case 'p': return S_ISFIFO(st.st_mode);
+		case 'S': return S_ISSOCK(st.st_mode);
+		case 'b': return S_ISBLK(st.st_mode);
+		case 'c': return S_ISCHR(st.st_mode);
+		case 'g': return (st.st_mode & S_ISGID) != 0;
+		case 'u': return (st.st_mode & S_ISUID) != 0;
+		case 'k': return (st.st_mode & S_ISVTX) != 0;
+		default: return false;
+	}
+}
+
+/*
+ * @brief Compare the modification times of two files.
+ * @return A negative number, 0 or a positive number if the first one is older, as old or newer than the second one.
+ * 		   A file that doesn't exist is older than any other.
+ */
+static int compare_mtime(const char *a, const char *b)
+{
+	struct stat sa, sb;
+	bool has_a = (stat(a, &sa) == 0), has_b = (stat(b, &sb) == 0);
+
+	if (!has_a || !has_b)
+		return has_a - has_b;
+
+	if (sa.st_mtim.tv_sec != sb.st_mtim.tv_sec)
+		return (sa.st_mtim.tv_sec > sb.st_mtim.tv_sec) ? 1 : -1;
+
+	return (sa.st_mtim.tv_nsec > sb.st_mtim.tv_nsec) - (sa.st_mtim.tv_nsec < sb.st_mtim.tv_nsec);
+}
+
+/*
+ * @brief Match a string against the pattern of a "[[ ... == pattern ]]" test.
+ * @param str The string.
+ * @param pattern The pattern, with its quoted characters escaped.
+ * @return true if the string matches the pattern.
+ */
+static bool match_pattern(const char *str, char *pattern)
+{
+	GlobPattern compiled;
+
+	// A pattern that can't be compiled (too long) is compared as a string.
+	if (glob_compile(&compiled, pattern, strlen(pattern)) == Failure)
+		return strcmp(str, glob_unescape(pattern)) == 0;
+
+	// Unlike file names, a string that starts with a "." is matched by a "*".
+	compiled.hidden = true;
+
+	return glob_match(&compiled, str, strlen(str));
+}
+
+/*
+ * @brief Evaluate a binary test.
+ * @param p The parser.
+ * @param left The left operand.
+ * @param op The operator.
+ * @param right The right operand.
+ * @return The result of the test.
+ */
+static bool binary(PTestParser p, char *left, const char *op, char *right)
+{
+	long long a, b;
+	struct stat sa, sb;
+
+	if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0 || strcmp(op, "!=") == 0)
+	{
+		const char *str = operand(p, left);
+		bool equal = p->extended ? match_pattern(str, right) : (strcmp(str, right) == 0);
+
+		return (*op == '!') ? !equal : equal;
+	}
+
+	if (strcmp(op, "<") == 0 || strcmp(op, ">") == 0)
+	{
+		int cmp = strcmp(operand(p, left), operand(p, right));
+
+		return (*op == '<') ? (cmp < 0) : (cmp > 0);
+	}
+
+	if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0)
+	{
+		int cmp = compare_mtime(operand(p, left), operand(p, right));
+
+		return (*(op + 1) == 'n') ? (cmp > 0) : (cmp < 0);
+	}
+
+	if (strcmp(op, "-ef") == 0)
+		return (stat(operand(p, left), &sa) == 0 && stat(operand(p, right), &sb) == 0 &&
+				sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino);
+
+	if (!parse_integer(p, left, &a) || !parse_integer(p, right, &b))
+		return false;
+
+	if (strcmp(op, "-eq") == 0)
+		return a == b;
+
+	else if (strcmp(op, "-ne") == 0)
+		return a != b;
+
+	else if (strcmp(op, "-lt") == 0)
+		return a < b;
+
+	else if (strcmp(op, "-le") == 0)
+		return a <= b;
+
+	else if (strcmp(op, "-gt") == 0)
+		return a > b;
+
+	return a >= b;
+}
+
+/*
+ * @brief Parse and evaluate a primary: a binary test, a unary test, a parenthesized expression or a string.
+ */
+static bool parse_primary(PTestParser p)
+{
+	char *arg = peek(p, 0), *next = peek(p, 1);
+
+	if (arg == NULL)
+	{
+		syntax_error(p);
+		return false;
+	}
+
+	// A binary test comes first, so "[ -n = -n ]" compares two strings.
+	if (next != NULL && peek(p, 2) != NULL && is_binary(next))
+	{
+		p->pos += 3;
+		return binary(p, arg, next, *(p->args + p->pos - 1));
+	}
+
+	if (strcmp(arg, "(") == 0 && next != NULL)
+	{
+		++p->pos;
+
+		bool res = parse_or(p);
+
+		if (peek(p, 0) == NULL || strcmp(peek(p, 0), ")") != 0)
+			syntax_error(p);
+
+		++p->pos;
+		return res;
+	}
+
+	if (is_unary(arg) && next != NULL)
+	{
+		p->pos += 2;
+		return unary(p, *(arg + 1), next);
+	}
+
+	// A single string is true if it isn't empty.
+	++p->pos;
+
+	return *operand(p, arg) != '\0';
+}
+
+/*
+ * @brief Parse and evaluate a negation ("! expr"), or a primary.
+ */
+static bool parse_not(PTestParser p)
+{
+	if (peek(p, 0) != NULL && strcmp(peek(p, 0), "!") == 0 && peek(p, 1) != NULL)
+	{
+		++p->pos;
+		return !parse_not(p);
+	}
+
+	return parse_primary(p);
+}
+
+/*
+ * @brief Parse and evaluate a conjunction ("-a", or "&&" inside "[[").
+ */
+static bool parse_and(PTestParser p)
+{
+	const char *op = p->extended ? "&&" : "-a";
+	bool res = parse_not(p);
+
+	while (!p->error && peek(p, 0) != NULL && strcmp(peek(p, 0), op) == 0)
+	{
+		++p->pos;
+		res = parse_not(p) && res;
+	}
+
+	return res;
+}
+
+/*
+ * @brief Parse and evaluate a disjunction ("-o", or "||" inside "[[").
+ */
+static bool parse_or(PTestParser p)
+{
+	const char *op = p->extended ? "||" : "-o";
+	bool res = parse_and(p);
+
+	while (!p->error && peek(p, 0) != NULL && strcmp(peek(p, 0), op) == 0)
+	{
+		++p->pos;
+		res = parse_and(p) || res;
+	}
+
+	return res;
+}
+
+int test_evaluate(char **args, int argc, bool extended)
+{
+	TestParser p = {args, argc, 0, extended, false};
+
+	// An empty expression is false.
+	if (argc == 0)
+		return TEST_FALSE;
+
+	bool res = parse_or(&p);
+
+	// Arguments left after a whole expression.
+	if (!p.error && p.pos < p.argc)
+	{
+		fprintf(stderr, "%s: %s\n", SHELL_ERR_CMD_TEST_SYNTAX, *(args + p.pos));
+		return TEST_ERROR;
+	}
+
+	if (p.error)
+		return TEST_ERROR;
+
+	return res ? TEST_TRUE : TEST_FALSE;
+}
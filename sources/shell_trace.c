@@ -0,0 +1,258 @@
+/*
+ *  Advanced Programming Course Assignment 1
+ *  Shell Tracer Source File
+ *  Copyright (C) 2024  Roy Simanovich and Almog Shor
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../include/shell_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool trace_enabled = false;
+
+// The trace file, the shell's process ID, and the buffered events.
+static int trace_fd = -1;
+static pid_t trace_pid = 0;
+static char trace_buffer[TRACE_BUFFER_SIZE];
+static size_t trace_len = 0;
+
+/*
+ * @brief Write the buffered events to the trace file.
+ */
+static void trace_flush()
+{
+	size_t written = 0;
+
+	while (written < trace_len)
+	{
+		ssize_t ret = write(trace_fd, trace_buffer + written, trace_len - written);
+
+		if (ret == -1 && errno == EINTR)
+			continue;
+
+		else if (ret <= 0)
+		{
+			perror("Internal error: System call faliure: write(2)");
+			break;
+		}
+
+		written += ret;
+	}
+
+	trace_len = 0;
+}
+
+/*
+ * @brief Make room in the buffer for an event, flushing the buffered events if needed.
+ * @param len The maximum length of the event, at most TRACE_BUFFER_SIZE.
+ * @return Where the event should be written.
+ */
+static char *trace_reserve(size_t len)
+{
+	if (trace_len + len > TRACE_BUFFER_SIZE)
+		trace_flush();
+
+	return trace_buffer + trace_len;
+}
+
+/*
+ * @brief Write a string.
+ * @param out Where to write.
+ * @param str The string.
+ * @return The end of the written string.
+ */
+static char *put_str(char *out, const char *str)
+{
+	while (*str != '\0')
+		*out++ = *str++;
+
+	return out;
+}
+
+/*
+ * @brief Write a number in decimal.
+ * @param out Where to write.
+ * @param value The number.
+ * @return The end of the written number.
+ * @note Events are formatted by hand, printf(3) would cost more than everything else the tracer does.
+ */
+static char *put_int(char *out, long long value)
+{
+	char digits[20];
+	int n = 0;
+	unsigned long long v = (value < 0) ? -(unsigned long long)value : (unsigned long long)value;
+
+	if (value < 0)
+		*out++ = '-';
+
+	do
+	{
+		*(digits + n++) = '0' + v % 10;
+	} while ((v /= 10) != 0);
+
+	while (n > 0)
+		*out++ = *(digits + --n);
+
+	return out;
+}
+
+/*
+ * @brief Write a time in microseconds, with a nanosecond fraction.
+ * @param out Where to write.
+ * @param ns The time in nanoseconds.
+ * @return The end of the written time.
+ */
+static char *put_us(char *out, uint64_t ns)
+{
+	out = put_int(out, (long long)(ns / 1000));
+	*out++ = '.';
+	*out++ = '0' + (ns / 100) % 10;
+	*out++ = '0' + (ns / 10) % 10;
+	*out++ = '0' + ns % 10;
+
+	return out;
+}
+
+/*
+ * @brief Write a string as a JSON string literal.
+ * @param out Where to write, room for at least 6 * TRACE_MAX_DETAIL + 2 characters.
+ * @param str The string, truncated to TRACE_MAX_DETAIL characters.
+ * @return The end of the written literal.
+ */
+static char *put_json(char *out, const char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	*out++ = '"';
+
+	for (int i = 0; *str != '\0' && i < TRACE_MAX_DETAIL; ++str, ++i)
+	{
+		if (*str == '"' || *str == '\\')
+		{
+			*out++ = '\\';
+			*out++ = *str;
+		}
+
+		else if ((unsigned char)*str < 0x20)
+		{
+			out = put_str(out, "\\u00");
+			*out++ = *(hex + (*str >> 4));
+			*out++ = *(hex + (*str & 0xf));
+		}
+
+		else
+			*out++ = *str;
+	}
+
+	*out++ = '"';
+
+	return out;
+}
+
+Result trace_open(const char *path)
+{
+	trace_close();
+
+	if ((trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+	{
+		perror("Internal error: System call faliure: open(2)");
+		return Failure;
+	}
+
+	trace_pid = getpid();
+	trace_len = 0;
+	trace_enabled = true;
+
+	char *out = trace_reserve(256);
+
+	out = put_str(out, "[\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": ");
+	out = put_int(out, trace_pid);
+	out = put_str(out, ", \"tid\": ");
+	out = put_int(out, trace_pid);
+	out = put_str(out, ", \"args\": {\"name\": \"shell\"}}");
+	trace_len = out - trace_buffer;
+
+	return Success;
+}
+
+void trace_close()
+{
+	if (!trace_enabled)
+		return;
+
+	char *out = trace_reserve(3);
+
+	trace_len = put_str(out, "\n]\n") - trace_buffer;
+	trace_flush();
+	trace_discard();
+}
+
+void trace_discard()
+{
+	if (trace_fd != -1)
+		close(trace_fd);
+
+	trace_fd = -1;
+	trace_len = 0;
+	trace_enabled = false;
+}
+
+void trace_span(const char *name, uint64_t start_ns, uint64_t end_ns, pid_t pid, int stage, const char *detail)
+{
+	if (!trace_enabled)
+		return;
+
+	// Two copies of the detail, and the rest of the fields.
+	char *out = trace_reserve(12 * TRACE_MAX_DETAIL + 512);
+
+	if (pid <= 0)
+		pid = trace_pid;
+
+	if (detail == NULL)
+		detail = "";
+
+	// A child gets its own track, named after what it runs.
+	if (pid != trace_pid)
+	{
+		out = put_str(out, ",\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": ");
+		out = put_int(out, pid);
+		out = put_str(out, ", \"tid\": ");
+		out = put_int(out, pid);
+		out = put_str(out, ", \"args\": {\"name\": ");
+		out = put_json(out, detail);
+		out = put_str(out, "}}");
+	}
+
+	out = put_str(out, ",\n{\"name\": \"");
+	out = put_str(out, name);
+	out = put_str(out, "\", \"cat\": \"shell\", \"ph\": \"X\", \"ts\": ");
+	out = put_us(out, start_ns);
+	out = put_str(out, ", \"dur\": ");
+	out = put_us(out, end_ns - start_ns);
+	out = put_str(out, ", \"pid\": ");
+	out = put_int(out, pid);
+	out = put_str(out, ", \"tid\": ");
+	out = put_int(out, pid);
+	out = put_str(out, ", \"args\": {\"stage\": ");
+	out = put_int(out, stage);
+	out = put_str(out, ", \"detail\": ");
+	out = put_json(out, detail);
+	out = put_str(out, "}}");
+
+	trace_len = out - trace_buffer;
+}
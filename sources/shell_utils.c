@@ -17,10 +17,140 @@
  */
 
 #include "../include/shell_utils.h"
+#include "../include/shell_subst.h"
+#include "../include/shell_stats.h"
+#include "../include/shell_function.h"
+#include "../include/shell_glob.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <ctype.h>
+
+/*
+ * @brief Split a command into tokens, or only count them.
+ * @param command The command to split.
+ * @param tokens The array to fill with newly allocated tokens, or NULL to only count them.
+ * @param max_tokens The size of the tokens array.
+ * @return The number of tokens, or -1 on allocation failure.
+ * @note Spaces inside double quotes or inside a substitution ("<(...)", ">(...)", "$(...)") don't split tokens.
+ * @note The text of a substitution is kept as is (including quotes), as it's parsed again by a subshell.
+ * @note Pattern characters inside double quotes are escaped with GLOB_ESCAPE.
+ */
+static int scan_tokens(const char *command, char **tokens, int max_tokens)
+{
+	const char *token_start = NULL;
+	bool in_quotes = false, outer_quotes = false;
+	int count = 0, depth = 0, token_length = 0;
+	char *token = NULL;
+
+	// Tokens are built in a single scratch buffer and copied out with their exact size,
+	// so long lines (such as 1000-stage pipelines) don't allocate a whole line per token.
+	// Every character may be escaped, so the buffer is twice the size of the line.
+	if (tokens != NULL && (token = (char *)malloc(2 * strlen(command) + 3)) == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return -1;
+	}
+
+	for (const char *c = command;; ++c)
+	{
+		// End of the current token.
+		if (*c == '\0' || (*c == ' ' && !in_quotes && depth == 0))
+		{
+			if (token_start != NULL)
+			{
+				if (token != NULL)
+				{
+					*(token + token_length) = '\0';
+
+					// Keep the quotes of a quoted command substitution ("$(cmd)"), so it won't be split into words.
+					if (c - token_start >= 5 && strncmp(token_start, "\"$(", 3) == 0 && strncmp(c - 2, ")\"", 2) == 0 &&
+						token_length == c - token_start - 2)
+					{
+						memmove(token + 1, token, token_length);
+						*token = '"';
+						*(token + token_length + 1) = '"';
+						*(token + token_length + 2) = '\0';
+					}
+
+					if (count < max_tokens && (*(tokens + count) = strdup(token)) == NULL)
+					{
+						perror("Internal error: System call faliure: strdup(3)");
+						free(token);
+						return -1;
+					}
+				}
+
+				token_start = NULL;
+				++count;
+			}
+
+			if (*c == '\0')
+				break;
+
+			continue;
+		}
+
+		// Start of a new token.
+		if (token_start == NULL)
+		{
+			token_start = c;
+			token_length = 0;
+		}
+
+		bool keep = true;
+
+		if (depth > 0)
+		{
+			if (*c == '"')
+				in_quotes = !in_quotes;
+
+			else if (!in_quotes && *c == '(')
+				++depth;
+
+			else if (!in_quotes && *c == ')' && --depth == 0)
+				in_quotes = outer_quotes;
+		}
+
+		else if (*c == '"')
+		{
+			in_quotes = !in_quotes;
+			keep = false;
+		}
+
+		// Start of a substitution. Process substitution must start the token, command substitution may appear anywhere.
+		else if (*c == '(' && c > command &&
+				 (*(c - 1) == '$' || (!in_quotes && c - 1 == token_start && (*(c - 1) == '<' || *(c - 1) == '>'))))
+		{
+			outer_quotes = in_quotes;
+			in_quotes = false;
+			depth = 1;
+		}
+
+		// A quoted pattern character is escaped, so it's matched literally by glob_expand().
+		if (keep && token != NULL && in_quotes && depth == 0 && GLOB_IS_SPECIAL(*c))
+			*(token + token_length++) = GLOB_ESCAPE;
+
+		if (keep && token != NULL)
+			*(token + token_length++) = *c;
+	}
+
+	free(token);
+
+	return count;
+}
+
+int count_tokens(const char *command)
+{
+	if (command == NULL)
+	{
+		fprintf(stderr, "Error: count_tokens() failed: command is NULL\n");
+		return 0;
+	}
+
+	return scan_tokens(command, NULL, 0);
+}
 
 char **tokenize_command(const char *command, int num_tokens)
 {
@@ -37,9 +167,6 @@ char **tokenize_command(const char *command, int num_tokens)
 	}
 
 	char **tokens = (char **)calloc(num_tokens + 1, sizeof(char *));
-	bool in_quotes = false;
-	int token_length = 0;
-	int word = 0;
 
 	if (tokens == NULL)
 	{
@@ -47,120 +174,286 @@ char **tokenize_command(const char *command, int num_tokens)
 		return NULL;
 	}
 
-	char *token = (char *)calloc(strlen(command) + 1, sizeof(char));
+	int word = scan_tokens(command, tokens, num_tokens);
 
-	if (token == NULL)
+	if (word < 0)
 	{
-		perror("Internal error: System call faliure: calloc(3)");
-		free(tokens);
+		freeUpMem(&tokens);
 		return NULL;
 	}
 
-	for (int i = 0; *(command + i) != '\0'; i++)
-	{
-		if (*(command + i) == '"')
-			in_quotes = !in_quotes;
-
-		else if (*(command + i) == ' ' && !in_quotes)
-		{
-			*(token + token_length) = '\0';
-			*(tokens + word) = token;
+	word = (word < num_tokens ? word : num_tokens) - 1;
 
-			token = (char *)calloc(strlen(command) + 1, sizeof(char));
+	// The token array, the scratch buffer and one copy per token.
+	STATS_ADD(bytes_tokenized, strlen(command));
+	STATS_ADD(allocations, word + 3);
 
-			if (token == NULL)
-			{
-				perror("Internal error: System call faliure: calloc(3)");
+	if (word >= 0 && strcmp(*(tokens + word), "&") == 0)
+	{
+		free(*(tokens + word));
+		*(tokens + word) = NULL;
+	}
 
-				for (int j = 0; j < word; j++)
-					free(*(tokens + j));
+	// Set the last argument to NULL, as required by execvp.
+	*(tokens + num_tokens) = NULL;
 
-				return NULL;
-			}
+	return tokens;
+}
 
-			word++;
+/*
+ * @brief Split a command substitution output into words, and replace an argument with them.
+ * @param cmd A pointer to the array of arguments.
+ * @param index The index of the argument to replace.
+ * @param output The output to split. The pointer is owned by the function.
+ * @return The number of words the argument was replaced with, or -1 on failure.
+ */
+static int split_substitution(char ***cmd, int index, char *output)
+{
+	int num_words = 0;
 
-			token_length = 0;
-		}
+	for (char *c = output; *c != '\0';)
+	{
+		c += strspn(c, " \t\n");
 
-		else
+		if (*c != '\0')
 		{
-			*(token + token_length) = *(command + i);
-			token_length++;
+			++num_words;
+			c += strcspn(c, " \t\n");
 		}
 	}
 
-	*(token + token_length) = '\0';
-	*(tokens + word) = token;
+	// The words are split in place, and copied into the arguments.
+	char **words = (char **)malloc((num_words + 1) * sizeof(char *)), *saveptr = NULL;
+	int k = 0;
 
-	if (strcmp(*(tokens + word), "&") == 0)
+	if (words == NULL)
 	{
-		free(*(tokens + word));
-		*(tokens + word) = NULL;
+		perror("Internal error: System call faliure: malloc(3)");
+		free(output);
+		return -1;
 	}
 
-	// Set the last argument to NULL, as required by execvp.
-	*(tokens + num_tokens) = NULL;
+	for (char *word = strtok_r(output, " \t\n", &saveptr); word != NULL; word = strtok_r(NULL, " \t\n", &saveptr))
+		*(words + k++) = word;
 
-	return tokens;
+	bool spliced = splice_words(cmd, index, words, num_words);
+
+	free(words);
+	free(output);
+
+	return spliced ? num_words : -1;
 }
 
-void parse_variables(char ***cmd, PLinkedList variableList)
+Result parse_variables(char ***cmd, PShellContext ctx)
 {
 	if (cmd == NULL || *cmd == NULL)
 	{
 		fprintf(stderr, "Error: parse_variables() failed: command is NULL\n");
-		return;
+		return Failure;
 	}
 
-	else if (variableList == NULL)
+	else if (ctx == NULL || ctx->variableList == NULL)
 	{
 		fprintf(stderr, "Error: parse_variables() failed: variableList is NULL\n");
-		return;
+		return Failure;
 	}
 
-	// If no variables are defined, return, we have nothing to do. :(
-	if (variableList->head == NULL)
-		return;
-
-	char **command = *cmd;
-
-	for (int i = 0; *(command + i) != NULL; i++)
+	for (int i = 0; *(*cmd + i) != NULL; i++)
 	{
+		char **command = *cmd;
+
 		if (**(command + i) == '$')
 		{
-			char *variable_name = *(command + i) + 1;
-			PNode variable = (PNode)variableList->head;
-			PVariable variable_data = NULL;
+			// The variable of an assignment ("$x = value") is a name, not a reference.
+			if (i == 0 && *(command + 1) != NULL && strcmp(*(command + 1), "=") == 0)
+				continue;
+
+			// Inside a function, the positional parameters come first.
+			int num_words = function_expand_positional(ctx, cmd, i);
+
+			if (num_words >= 0)
+			{
+				i += num_words - 1;
+				continue;
+			}
+
+			char *value = get_variable(ctx->variableList, *(command + i) + 1);
 
-			while (variable != NULL)
+			// Variable found, replace it with its value.
+			if (value != NULL)
 			{
-				variable_data = (PVariable)variable->data;
+				char *tmp = (char *)calloc(strlen(value) + 1, sizeof(char));
 
-				if (strcmp(variable_data->name, variable_name) == 0)
-					break;
+				if (tmp == NULL)
+				{
+					perror("Internal error: System call faliure: calloc(3)");
+					return Failure;
+				}
 
-				variable = variable->next;
+				STATS_INC(allocations);
+				free(*(command + i));
+				strcpy(tmp, value);
+
+				*(command + i) = tmp;
+				continue;
 			}
+		}
 
-			// Variable not found, don't parse it.
-			if (variable == NULL)
-				return;
+		char *arg = *(command + i), *open = strstr(arg, "$(");
 
-			char *tmp = (char *)calloc(strlen(variable_data->value) + 1, sizeof(char));
+		if (open == NULL)
+			continue;
 
-			if (tmp == NULL)
+		// A quoted substitution is a single word, an unquoted one that makes up the whole argument is split into words.
+		// The value of an assignment ("$x = $(cmd)") is never split, as in other shells.
+		size_t arg_len = strlen(arg);
+		bool quoted = (arg_len >= 2 && *arg == '"' && *(arg + arg_len - 1) == '"');
+		bool assignment = (i == 2 && **command == '$' && strcmp(*(command + 1), "=") == 0);
+		bool split = (!quoted && !assignment && open == arg && find_substitution_end(arg + 1) == arg + arg_len - 1);
+
+		if (quoted)
+		{
+			*(arg + arg_len - 1) = '\0';
+			++arg;
+		}
+
+		char *output = expand_command_substitutions(ctx, arg);
+
+		if (output == NULL)
+			return Failure;
+
+		if (split)
+		{
+			int num_words = split_substitution(cmd, i, output);
+
+			// Don't expand the words again.
+			if (num_words >= 0)
+				i += num_words - 1;
+		}
+
+		else
+		{
+			free(*(command + i));
+			*(command + i) = output;
+		}
+	}
+
+	return Success;
+}
+
+char *get_variable(PLinkedList variableList, const char *name)
+{
+	if (variableList == NULL || name == NULL)
+		return NULL;
+
+	STATS_INC(var_lookups);
+
+	for (PNode curr = variableList->head; curr != NULL; curr = curr->next)
+	{
+		PVariable variable = (PVariable)curr->data;
+
+		if (strcmp(variable->name, name) == 0)
+		{
+			STATS_INC(var_hits);
+			return variable->value;
+		}
+	}
+
+	return NULL;
+}
+
+char *expand_variables_str(const char *str, PLinkedList variableList)
+{
+	size_t cap = strlen(str) + 1, len = 0;
+	char *out = (char *)malloc(cap);
+
+	if (out == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return NULL;
+	}
+
+	STATS_INC(allocations);
+
+	while (*str != '\0')
+	{
+		const char *value = NULL;
+		size_t skip = 1, value_len = 1;
+
+		if (*str == '$')
+		{
+			// Variable names are alphanumeric (or the special "?" variable).
+			size_t name_len = 0;
+
+			if (*(str + 1) == '?')
+				name_len = 1;
+
+			else
 			{
-				perror("Internal error: System call faliure: calloc(3)");
-				return;
+				while (isalnum((unsigned char)*(str + 1 + name_len)) || *(str + 1 + name_len) == '_')
+					++name_len;
 			}
 
-			free(*(command + i));
-			strcpy(tmp, variable_data->value);
+			if (name_len > 0)
+			{
+				char name[name_len + 1];
+				memcpy(name, str + 1, name_len);
+				name[name_len] = '\0';
+
+				if ((value = get_variable(variableList, name)) != NULL)
+				{
+					skip = name_len + 1;
+					value_len = strlen(value);
+				}
+			}
+		}
+
+		if (value == NULL)
+			value = str;
+
+		// Grow the buffer geometrically, so long bodies are expanded in linear time.
+		if (len + value_len + 1 > cap)
+		{
+			while (len + value_len + 1 > cap)
+				cap *= 2;
+
+			char *tmp = (char *)realloc(out, cap);
+
+			if (tmp == NULL)
+			{
+				perror("Internal error: System call faliure: realloc(3)");
+				free(out);
+				return NULL;
+			}
 
-			*(command + i) = tmp;
+			out = tmp;
+			STATS_INC(allocations);
 		}
+
+		memcpy(out + len, value, value_len);
+		len += value_len;
+		str += skip;
 	}
+
+	*(out + len) = '\0';
+
+	return out;
+}
+
+bool is_pipe_separator(const char *arg)
+{
+	return (arg != NULL && *arg == '|' && (*(arg + 1) == '\0' || (*(arg + 1) == '>' && *(arg + 2) == '\0')));
+}
+
+bool in_test_expression(const char *arg, bool in_test)
+{
+	if (strcmp(arg, SHELL_CMD_DBRACKET) == 0)
+		return true;
+
+	else if (strcmp(arg, SHELL_CMD_DBRACKET_END) == 0)
+		return false;
+
+	return in_test;
 }
 
 int is_control_command(const char *cmd)
@@ -174,29 +467,176 @@ int is_control_command(const char *cmd)
 	return (strcmp(cmd, "if") == 0 || strcmp(cmd, "then") == 0 || strcmp(cmd, "else") == 0 || strcmp(cmd, "fi") == 0);
 }
 
-int ok_to_execute(State curr_state, Result curr_result)
+size_t hash_string(const char *str, size_t len)
+{
+	size_t hash = 2166136261u;
+
+	for (size_t i = 0; i < len; ++i)
+		hash = (hash ^ (unsigned char)*(str + i)) * 16777619u;
+
+	return hash;
+}
+
+/*
+ * @brief Get the name of an entry of a name table, its first member.
+ */
+#define NAME_OF(entry) (*(char *const *)(entry))
+
+/*
+ * @brief Find the slot of a name in the slots of a name table.
+ * @param slots The slots.
+ * @param capacity The number of slots, a power of two.
+ * @param name The name.
+ * @return The slot of the entry with the name, or the empty slot it should be inserted into.
+ */
+static size_t find_slot(void *const *slots, size_t capacity, const char *name)
 {
-	int ret = 1;
+	size_t slot = hash_string(name, strlen(name)) & (capacity - 1);
+
+	while (*(slots + slot) != NULL && strcmp(NAME_OF(*(slots + slot)), name) != 0)
+		slot = (slot + 1) & (capacity - 1);
+
+	return slot;
+}
 
-	if (curr_state == STATE_WANT_THEN)
+void *name_table_lookup(const NameTable *table, const char *name)
+{
+	if (table == NULL || table->count == 0)
+		return NULL;
+
+	return *(table->slots + find_slot(table->slots, table->capacity, name));
+}
+
+Result name_table_insert(PNameTable table, void *entry)
+{
+	// Keep the table at most half full, so the probe sequences stay short.
+	if ((table->count + 1) * 2 > table->capacity)
 	{
-		fprintf(stderr, "Shell internal error: syntax error: then expected\n");
-		ret = 0;
+		size_t capacity = (table->capacity == 0) ? 16 : table->capacity * 2;
+		void **slots = (void **)calloc(capacity, sizeof(void *));
+
+		if (slots == NULL)
+		{
+			perror("Internal error: System call faliure: calloc(3)");
+			return Failure;
+		}
+
+		for (size_t i = 0; i < table->capacity; ++i)
+		{
+			if (*(table->slots + i) != NULL)
+				*(slots + find_slot(slots, capacity, NAME_OF(*(table->slots + i)))) = *(table->slots + i);
+		}
+
+		free(table->slots);
+		table->slots = slots;
+		table->capacity = capacity;
+		STATS_INC(allocations);
 	}
 
-	else if (curr_state == STATE_THEN_BLOCK && curr_result == Success)
-		ret = 1;
+	*(table->slots + find_slot(table->slots, table->capacity, NAME_OF(entry))) = entry;
+	++table->count;
+
+	return Success;
+}
+
+void *name_table_remove(PNameTable table, const char *name)
+{
+	if (table == NULL || table->count == 0)
+		return NULL;
+
+	size_t mask = table->capacity - 1, hole = find_slot(table->slots, table->capacity, name);
+	void *entry = *(table->slots + hole);
+
+	if (entry == NULL)
+		return NULL;
 
-	else if (curr_state == STATE_THEN_BLOCK && curr_result == Failure)
-		ret = 0;
+	*(table->slots + hole) = NULL;
+	--table->count;
 
-	else if (curr_state == STATE_ELSE_BLOCK && curr_result == Success)
-		ret = 0;
+	// Shift back the entries of the probe sequence that can't be found past the hole anymore (no tombstones).
+	for (size_t slot = (hole + 1) & mask; *(table->slots + slot) != NULL; slot = (slot + 1) & mask)
+	{
+		size_t home = hash_string(NAME_OF(*(table->slots + slot)), strlen(NAME_OF(*(table->slots + slot)))) & mask;
+		bool reachable = (hole < slot) ? (home > hole && home <= slot) : (home > hole || home <= slot);
+
+		if (!reachable)
+		{
+			*(table->slots + hole) = *(table->slots + slot);
+			*(table->slots + slot) = NULL;
+			hole = slot;
+		}
+	}
+
+	return entry;
+}
+
+void name_table_free(PNameTable table)
+{
+	free(table->slots);
+	table->slots = NULL;
+	table->capacity = table->count = 0;
+}
+
+bool splice_words(char ***argv, int index, char *const *words, int count)
+{
+	char **command = *argv;
+	int num_args = 0;
+
+	while (*(command + num_args) != NULL)
+		++num_args;
+
+	// Copy the words first, so a failure leaves the arguments as they were.
+	char **copies = (char **)malloc((count + 1) * sizeof(char *));
+
+	if (copies == NULL)
+	{
+		perror("Internal error: System call faliure: malloc(3)");
+		return false;
+	}
+
+	for (int k = 0; k < count; ++k)
+	{
+		if ((*(copies + k) = strdup(*(words + k))) == NULL)
+		{
+			perror("Internal error: System call faliure: strdup(3)");
+
+			while (k > 0)
+				free(*(copies + --k));
+
+			free(copies);
+			return false;
+		}
+	}
+
+	STATS_ADD(allocations, count);
+
+	if (count > 1)
+	{
+		char **tmp = (char **)realloc(command, (num_args + count) * sizeof(char *));
+
+		if (tmp == NULL)
+		{
+			perror("Internal error: System call faliure: realloc(3)");
+
+			for (int k = 0; k < count; ++k)
+				free(*(copies + k));
+
+			free(copies);
+			return false;
+		}
+
+		command = *argv = tmp;
+		STATS_INC(allocations);
+	}
 
-	else if (curr_state == STATE_ELSE_BLOCK && curr_result == Failure)
-		ret = 1;
+	// Make room for the words (or close the gap, if there are none), the NULL terminator moves along with the arguments.
+	// The argument is freed first, as it's overwritten by the next one when there are no words.
+	free(*(command + index));
+	memmove(command + index + count, command + index + 1, (num_args - index) * sizeof(char *));
+	memcpy(command + index, copies, count * sizeof(char *));
+	free(copies);
 
-	return ret;
+	return true;
 }
 
 void freeUpMem(char ***argv)